@@ -0,0 +1,108 @@
+#include "ast/parser.hpp"
+#include "ast/sema.hpp"
+#include "lexer/lexer.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Heap traffic of building the AST of a generated translation unit. Every global operator new is counted while
+// parsing: with the AstContext the nodes cost a handful of 64 KiB blocks, where each node and each list of items
+// used to be allocations of their own. Arguments: [functions] [rounds]
+
+namespace
+{
+
+size_t allocations{ 0 };
+size_t allocated_bytes{ 0 };
+
+std::string generate(size_t functions)
+{
+    std::mt19937 rng{ 5 };
+    std::uniform_int_distribution<int> value{ 0, 999 };
+    std::uniform_int_distribution<int> shape{ 0, 3 };
+
+    std::string src;
+    for (size_t f = 0; f < functions; ++f)
+    {
+        src += std::format("int f{}()\n{{\n    int a = {};\n    int b = a * {} + {};\n", f, value(rng), value(rng),
+                           value(rng));
+        for (int i = shape(rng) + 1; i > 0; --i)
+        {
+            switch (shape(rng))
+            {
+            case 0: src += std::format("    a = (a - {}) * b;\n", value(rng)); break;
+            case 1:
+                src += std::format("    if (a < b)\n    {{\n        a = a + {};\n    }}\n    else\n    {{\n"
+                                   "        b = b / {};\n    }}\n",
+                                   value(rng), value(rng) + 1);
+                break;
+            case 2:
+                src += std::format("    {{\n        int c = a + b;\n        a = c * {};\n    }}\n", value(rng));
+                break;
+            default: src += "    ;\n"; break;
+            }
+        }
+        src += "    return a + b;\n}\n";
+    }
+    return src;
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    allocated_bytes += size;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+int main(int argc, char** argv)
+{
+    size_t const functions = argc > 1 ? std::stoul(argv[1]) : 20000;
+    size_t const rounds = argc > 2 ? std::stoul(argv[2]) : 5;
+
+    auto const& file = compiler::SourceManager::global().add_buffer("ast_arena_bench.c", generate(functions));
+    auto const tape = compiler::Lexer{ file }.tape();
+
+    std::vector<double> times;
+    compiler::ast::AstContext::Stats stats;
+    size_t mallocs{ 0 };
+    size_t malloc_bytes{ 0 };
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        compiler::Sema sema;
+        compiler::ast::AstContext context;
+        compiler::Parser parser{ tape, sema, context };
+
+        auto const before = allocations;
+        auto const before_bytes = allocated_bytes;
+        compiler::Stopwatch watch;
+        parser.parse();
+        times.emplace_back(watch.elapsed_ms());
+        mallocs = allocations - before;
+        malloc_bytes = allocated_bytes - before_bytes;
+        stats = context.stats();
+    }
+    std::sort(times.begin(), times.end());
+
+    std::cout << std::format("AST of {} functions, {} tokens, {} bytes of source\n", functions, tape.size(),
+                             file.content.size());
+    std::cout << std::format("{:>28} {:>12}\n", "nodes", stats.nodes);
+    std::cout << std::format("{:>28} {:>12}\n", "item lists", stats.lists);
+    std::cout << std::format("{:>28} {:>12}\n", "arena bytes", stats.bytes);
+    std::cout << std::format("{:>28} {:>12}\n", "allocations before, at least", stats.nodes + stats.lists);
+    std::cout << std::format("{:>28} {:>12}\n", "allocations now", mallocs);
+    std::cout << std::format("{:>28} {:>12}\n", "  of which arena blocks", stats.blocks);
+    std::cout << std::format("{:>28} {:>12}\n", "heap bytes now", malloc_bytes);
+    std::cout << std::format("{:>28} {:>12.3f}\n", "parse ms (median)", times[times.size() / 2]);
+}
@@ -0,0 +1,91 @@
+#include "lexer/chunked.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <thread>
+
+// Scaling of chunked lexing from one thread up to the core count of the machine, on a generated source of
+// configurable size. Arguments: [size in MB] [max threads, defaults to the core count]
+
+namespace
+{
+
+std::string generate(size_t bytes)
+{
+    std::mt19937 rng{ 7 };
+    std::uniform_int_distribution<int> value{ 0, 99999 };
+    std::uniform_int_distribution<int> name{ 0, 4095 };
+
+    std::string src;
+    src.reserve(bytes + 128);
+    src += "int main()\n{\n";
+    while (src.size() < bytes)
+    {
+        src += std::format("    int v{} = (v{} * {}) + v{} - {};\n", name(rng), name(rng), value(rng), name(rng),
+                           value(rng));
+    }
+    src += "}\n";
+    return src;
+}
+
+bool same_tape(compiler::tokens::Tape const& lhs, compiler::tokens::Tape const& rhs)
+{
+    auto same_token = [](auto const& a, auto const& b)
+    { return a.tag == b.tag && a.kind == b.kind && a.offset == b.offset && a.length == b.length; };
+    return lhs.literals == rhs.literals
+           && std::equal(lhs.tokens.begin(), lhs.tokens.end(), rhs.tokens.begin(), rhs.tokens.end(), same_token);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t const megabytes = argc > 1 ? std::stoul(argv[1]) : 64;
+    constexpr size_t rounds = 3;
+
+    auto const path = std::filesystem::temp_directory_path() / "chunked_lex_bench.c";
+    {
+        std::ofstream out{ path };
+        out << generate(megabytes * 1024 * 1024);
+    }
+    auto const& file = compiler::SourceManager::global().load(path);
+    std::filesystem::remove(path);
+
+    std::vector<size_t> thread_counts;
+    auto const cores = argc > 2 ? std::stoul(argv[2]) : std::max<size_t>(1, std::thread::hardware_concurrency());
+    for (size_t n = 1; n < cores; n *= 2)
+    {
+        thread_counts.emplace_back(n);
+    }
+    thread_counts.emplace_back(cores);
+
+    auto const reference = compiler::lex_chunked(file, 1);
+    double single_ms{ 0 };
+
+    std::cout << std::format("chunked lexing, {} MB, {} tokens, best of {} rounds\n", megabytes, reference.size() - 1,
+                             rounds);
+    std::cout << std::format("{:>8} {:>12} {:>10} {:>8}\n", "threads", "ms", "MB/s", "speedup");
+    for (auto threads : thread_counts)
+    {
+        double best{ std::numeric_limits<double>::max() };
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            compiler::Stopwatch watch;
+            auto const tape = compiler::lex_chunked(file, threads);
+            best = std::min(best, watch.elapsed_ms());
+            if (!same_tape(tape, reference))
+            {
+                std::cerr << "Tape mismatch with " << threads << " threads\n";
+                return 1;
+            }
+        }
+        if (threads == 1) single_ms = best;
+        auto const mb_per_s = static_cast<double>(file.content.size()) / 1e3 / best;
+        std::cout << std::format("{:>8} {:>12.2f} {:>10.1f} {:>7.2f}x\n", threads, best, mb_per_s, single_ms / best);
+    }
+}
@@ -0,0 +1,133 @@
+#include "ast/parser.hpp"
+#include "ast/sema.hpp"
+#include "lexer/lexer.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Parse time of single expressions of up to [terms] terms, by shape. Time per term has to stay flat as the
+// expressions grow, and every parse runs on a thread with a native stack of only [stack KiB], which the recursive
+// parser overflowed after a few thousand levels of nesting. Arguments: [terms] [rounds] [stack KiB]
+//
+// glibc returns freed memory to the system as soon as it can, which makes every round past a few MB of nodes page
+// fault its arena anew and hides the parser behind the kernel. Trimming is turned off for the measurement.
+
+namespace
+{
+
+std::string generate(std::string_view shape, size_t terms)
+{
+    std::string expr;
+    if (shape == "sum") // a + 1 + a + 2 ..., left associative
+    {
+        for (size_t i = 0; i < terms; ++i)
+        {
+            expr += i % 2 == 0 ? "a" : std::to_string(i % 1000);
+            if (i + 1 < terms) expr += " + ";
+        }
+    }
+    else if (shape == "assign") // a = a = ... = 1, right associative
+    {
+        for (size_t i = 1; i < terms; ++i)
+        {
+            expr += "a = ";
+        }
+        expr += "1";
+    }
+    else if (shape == "parens") // ((((a + 1) + 1) ...)
+    {
+        expr.append(terms - 1, '(');
+        expr += "a";
+        for (size_t i = 1; i < terms; ++i)
+        {
+            expr += " + 1)";
+        }
+    }
+    else if (shape == "prefix") // !!!...a
+    {
+        expr.append(terms - 1, '!');
+        expr += "a";
+    }
+    else // mixed precedence and grouping
+    {
+        for (size_t i = 0; i < terms / 4; ++i)
+        {
+            if (i != 0) expr += i % 3 == 0 ? " < " : " + ";
+            expr += std::format("(a * {} - !a) / (a + {})", i % 100, i % 7 + 1);
+        }
+    }
+    return std::format("int main()\n{{\n    int a = 1;\n    a = {};\n    return a;\n}}\n", expr);
+}
+
+// Runs `work` on a thread whose stack is `stack` bytes
+void on_small_stack(size_t stack, std::function<void()> work)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack);
+    pthread_t thread;
+    auto const entry = [](void* arg) -> void*
+    {
+        (*static_cast<std::function<void()>*>(arg))();
+        return nullptr;
+    };
+    if (pthread_create(&thread, &attr, entry, &work) != 0)
+    {
+        std::cerr << "Cannot create a thread with a stack of " << stack << " bytes\n";
+        std::exit(1);
+    }
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t const max_terms = argc > 1 ? std::stoul(argv[1]) : 100000;
+    size_t const rounds = argc > 2 ? std::stoul(argv[2]) : 5;
+    size_t const stack = (argc > 3 ? std::stoul(argv[3]) : 64) * 1024;
+#ifdef __GLIBC__
+    mallopt(M_TRIM_THRESHOLD, 1 << 30);
+    mallopt(M_MMAP_THRESHOLD, 1 << 30);
+#endif
+
+    std::cout << std::format("native stack of {} KiB\n", stack / 1024);
+    std::cout << std::format("{:>8} {:>8} {:>10} {:>12} {:>10}\n", "shape", "terms", "tokens", "parse ms", "ns/term");
+    for (std::string_view shape : { "sum", "assign", "parens", "prefix", "mixed" })
+    {
+        for (auto terms = max_terms / 8; terms <= max_terms; terms *= 2)
+        {
+            auto const name = std::format("expr_parse_bench_{}_{}.c", shape, terms);
+            auto const& file = compiler::SourceManager::global().add_buffer(name, generate(shape, terms));
+            auto const tape = compiler::Lexer{ file }.tape();
+
+            std::vector<double> times;
+            for (size_t round = 0; round < rounds; ++round)
+            {
+                compiler::Sema sema;
+                compiler::ast::AstContext context;
+                compiler::Parser parser{ tape, sema, context };
+                on_small_stack(stack,
+                               [&]
+                               {
+                                   compiler::Stopwatch watch;
+                                   parser.parse();
+                                   times.emplace_back(watch.elapsed_ms());
+                               });
+            }
+            std::sort(times.begin(), times.end());
+            auto const median = times[times.size() / 2];
+            std::cout << std::format("{:>8} {:>8} {:>10} {:>12.3f} {:>10.1f}\n", shape, terms, tape.size(), median,
+                                     median * 1e6 / static_cast<double>(terms));
+        }
+    }
+}
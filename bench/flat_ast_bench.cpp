@@ -0,0 +1,254 @@
+#include "ast/flat.hpp"
+#include "ast/parser.hpp"
+#include "ast/sema.hpp"
+#include "ast/visit.hpp"
+#include "lexer/lexer.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Memory and traversal time of the pointer AST against the FlatAst of the same generated translation unit. Both
+// walks count the nodes and sum the integer literals; the flat AST is walked once through its child indices, like the
+// pointer tree, and once as a plain scan of its columns, which is possible because no child is reached through a
+// pointer. Arguments: [functions] [rounds]
+
+namespace
+{
+
+using namespace compiler::ast;
+
+std::string generate(size_t functions)
+{
+    std::mt19937 rng{ 5 };
+    std::uniform_int_distribution<int> value{ 0, 999 };
+    std::uniform_int_distribution<int> shape{ 0, 3 };
+
+    std::string src;
+    for (size_t f = 0; f < functions; ++f)
+    {
+        src += std::format("int f{}()\n{{\n    int a = {};\n    int b = a * {} + {};\n", f, value(rng), value(rng),
+                           value(rng));
+        for (int i = shape(rng) + 1; i > 0; --i)
+        {
+            switch (shape(rng))
+            {
+            case 0: src += std::format("    a = (a - {}) * b;\n", value(rng)); break;
+            case 1:
+                src += std::format("    if (a < b)\n    {{\n        a = a + {};\n    }}\n    else\n    {{\n"
+                                   "        b = b / {};\n    }}\n",
+                                   value(rng), value(rng) + 1);
+                break;
+            case 2:
+                src += std::format("    {{\n        int c = a + b;\n        a = c * {};\n    }}\n", value(rng));
+                break;
+            default: src += "    ;\n"; break;
+            }
+        }
+        src += "    return a + b;\n}\n";
+    }
+    return src;
+}
+
+struct Totals
+{
+    size_t nodes{ 0 };
+    int64_t literals{ 0 };
+};
+
+class PointerWalk
+{
+public:
+    void items(Items const& items)
+    {
+        ++totals.nodes;
+        for (auto const* item : items.items())
+        {
+            if (auto const* decl = item->decl()) this->decl(*decl);
+            else stmt(*item->stmt());
+        }
+    }
+
+    Totals totals;
+
+private:
+    void decl(Declaration const& declaration)
+    {
+        ++totals.nodes;
+        visit(declaration, Overload{
+            [&](ObjDecl const& obj) {
+                expr(obj.iden());
+                if (obj.initalizer() != nullptr) expr(*obj.initalizer());
+            },
+            [&](FunctionDecl const& func) {
+                expr(func.iden());
+                stmt(func.body());
+            },
+        });
+    }
+
+    void stmt(Stmt const& statement)
+    {
+        ++totals.nodes;
+        visit(statement, Overload{
+            [&](ExprStmt const& expr_stmt) { expr(expr_stmt.expr()); },
+            [&](CompoundStmt const& compound) { items(compound.items()); },
+            [&](IfStmt const& if_stmt) {
+                expr(if_stmt.cond());
+                stmt(if_stmt.cons());
+                if (if_stmt.alt() != nullptr) stmt(*if_stmt.alt());
+            },
+            [&](ReturnStmt const& ret) {
+                if (ret.expr() != nullptr) expr(*ret.expr());
+            },
+            [&](NullStmt const&) {},
+        });
+    }
+
+    void expr(Expr const& expression)
+    {
+        ++totals.nodes;
+        visit(expression, Overload{
+            [&](IntLiteral const& literal) { totals.literals += literal.value(); },
+            [&](Iden const&) {},
+            [&](BinExpr const& bin) {
+                expr(bin.lhs());
+                expr(bin.rhs());
+            },
+            [&](UnaryExpr const& unary) { expr(unary.expr()); },
+        });
+    }
+};
+
+class IndexWalk
+{
+public:
+    explicit IndexWalk(FlatAst const& ast) : ast_{ ast } {}
+
+    void node(NodeId id)
+    {
+        using Kind = FlatAst::Kind;
+        ++totals.nodes;
+        switch (ast_.kind(id))
+        {
+        case Kind::IntLiteral: totals.literals += ast_.value(id); break;
+        case Kind::BinExpr:
+            node(ast_.lhs(id));
+            node(ast_.rhs(id));
+            break;
+        case Kind::UnaryExpr: node(ast_.operand(id)); break;
+        case Kind::ExprStmt: node(ast_.expr(id)); break;
+        case Kind::ReturnStmt: optional(ast_.expr(id)); break;
+        case Kind::IfStmt:
+            node(ast_.cond(id));
+            node(ast_.cons(id));
+            optional(ast_.alt(id));
+            break;
+        case Kind::CompoundStmt:
+            for (auto const child : ast_.items(id))
+            {
+                node(child);
+            }
+            break;
+        case Kind::ObjDecl:
+            node(ast_.iden(id));
+            optional(ast_.init(id));
+            break;
+        case Kind::FunctionDecl:
+            node(ast_.iden(id));
+            node(ast_.body(id));
+            break;
+        case Kind::Iden:
+        case Kind::NullStmt: break;
+        }
+    }
+
+    Totals totals;
+
+private:
+    void optional(NodeId id)
+    {
+        if (id != NodeId::None) node(id);
+    }
+
+    FlatAst const& ast_;
+};
+
+Totals scan(FlatAst const& ast)
+{
+    Totals totals{ ast.size(), 0 };
+    for (uint32_t i = 0; i < ast.size(); ++i)
+    {
+        auto const id = static_cast<NodeId>(i);
+        if (ast.kind(id) == FlatAst::Kind::IntLiteral) totals.literals += ast.value(id);
+    }
+    return totals;
+}
+
+template <typename Walk> double median_ms(size_t rounds, Walk&& walk)
+{
+    std::vector<double> times;
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        compiler::Stopwatch watch;
+        walk();
+        times.emplace_back(watch.elapsed_ms());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t const functions = argc > 1 ? std::stoul(argv[1]) : 20000;
+    size_t const rounds = argc > 2 ? std::stoul(argv[2]) : 9;
+
+    auto const& file = compiler::SourceManager::global().add_buffer("flat_ast_bench.c", generate(functions));
+    auto const tape = compiler::Lexer{ file }.tape();
+
+    compiler::Sema sema;
+    AstContext context;
+    compiler::Parser parser{ tape, sema, context };
+    auto const tu = parser.parse();
+
+    FlatAst flat;
+    auto const flatten_ms = median_ms(rounds, [&] { flat = FlatAst::flatten(*tu); });
+
+    Totals pointer;
+    auto const pointer_ms = median_ms(rounds, [&] {
+        PointerWalk walk;
+        walk.items(*tu->items());
+        pointer = walk.totals;
+    });
+    Totals indexed;
+    auto const index_ms = median_ms(rounds, [&] {
+        IndexWalk walk{ flat };
+        for (auto const item : flat.items())
+        {
+            walk.node(item);
+        }
+        indexed = walk.totals;
+    });
+    Totals scanned;
+    auto const scan_ms = median_ms(rounds, [&] { scanned = scan(flat); });
+
+    std::cout << std::format("AST of {} functions, {} tokens\n", functions, tape.size());
+    std::cout << std::format("{:>22} {:>12} {:>12}\n", "", "pointer", "flat");
+    // The pointer AST also has TypeDecl and Items nodes, the flat one keeps types and lists in side arrays
+    std::cout << std::format("{:>22} {:>12} {:>12}\n", "nodes", context.stats().nodes, flat.size());
+    std::cout << std::format("{:>22} {:>12} {:>12}\n", "bytes", context.stats().bytes, flat.bytes());
+    std::cout << std::format("{:>22} {:>12.3f} {:>12.3f}\n", "walk ms (median)", pointer_ms, index_ms);
+    std::cout << std::format("{:>22} {:>12} {:>12.3f}\n", "column scan ms", "", scan_ms);
+    std::cout << std::format("{:>22} {:>12} {:>12.3f}\n", "flatten ms", "", flatten_ms);
+    std::cout << std::format("{:>22} {:>12} {:>12}\n", "literal sum", pointer.literals, indexed.literals);
+    if (pointer.literals != indexed.literals || indexed.literals != scanned.literals)
+    {
+        std::cerr << "Walks disagree\n";
+        return 1;
+    }
+}
@@ -0,0 +1,150 @@
+#include "lexer/keywords.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Keyword recognition on identifier heavy input: the compile time perfect hash used by the lexer against the
+// std::unordered_map it replaced.
+
+namespace
+{
+
+using compiler::tokens::Keyword;
+
+// The table the lexer used before the perfect hash, kept verbatim as the baseline
+std::unordered_map<std::string_view, Keyword> const KEYWORDS{
+    { "auto", Keyword::Auto },         { "break", Keyword::Break },       { "case", Keyword::Case },
+    { "char", Keyword::Char },         { "const", Keyword::Const },       { "continue", Keyword::Continue },
+    { "default", Keyword::Default },   { "do", Keyword::Do },             { "double", Keyword::Double },
+    { "else", Keyword::Else },         { "enum", Keyword::Enum },         { "extern", Keyword::Extern },
+    { "float", Keyword::Float },       { "for", Keyword::For },           { "goto", Keyword::Goto },
+    { "if", Keyword::If },             { "inline", Keyword::Inline },     { "int", Keyword::Int },
+    { "long", Keyword::Long },         { "register", Keyword::Register }, { "restrict", Keyword::Restrict },
+    { "return", Keyword::Return },     { "short", Keyword::Short },       { "signed", Keyword::Signed },
+    { "sizeof", Keyword::Sizeof },     { "static", Keyword::Static },     { "struct", Keyword::Struct },
+    { "switch", Keyword::Switch },     { "typedef", Keyword::Typedef },   { "union", Keyword::Union },
+    { "unsigned", Keyword::Unsigned }, { "void", Keyword::Void },         { "volatile", Keyword::Volatile },
+    { "while", Keyword::While },       { "_Bool", Keyword::Bool },        { "_Complex", Keyword::Complex },
+    { "_Imaginary", Keyword::Imaginary },
+};
+
+constexpr compiler::tokens::KeywordTable table{};
+
+struct Corpus
+{
+    std::string storage;
+    std::vector<std::string_view> lexems;
+};
+
+// Roughly a third keywords, the rest identifiers of 1-16 characters, a share of them keyword look-alikes
+Corpus generate(size_t count)
+{
+    std::mt19937 rng{ 42 };
+    std::uniform_int_distribution<int> percent{ 0, 99 };
+    std::uniform_int_distribution<size_t> length{ 1, 16 };
+    std::uniform_int_distribution<size_t> keyword{ 0, KEYWORDS.size() - 1 };
+    constexpr std::string_view alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    std::uniform_int_distribution<size_t> letter{ 0, alphabet.size() - 11 };
+    std::uniform_int_distribution<size_t> any{ 0, alphabet.size() - 1 };
+
+    std::vector<std::string_view> spellings;
+    for (auto& [spelling, _] : KEYWORDS)
+    {
+        spellings.emplace_back(spelling);
+    }
+    std::sort(spellings.begin(), spellings.end());
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    Corpus corpus;
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto const start = corpus.storage.size();
+        auto const roll = percent(rng);
+        if (roll < 35)
+        {
+            corpus.storage += spellings[keyword(rng)];
+        }
+        else if (roll < 50)
+        {
+            corpus.storage += spellings[keyword(rng)];
+            corpus.storage += alphabet[any(rng)];
+        }
+        else
+        {
+            corpus.storage += alphabet[letter(rng)];
+            for (size_t n = length(rng); n > 1; --n)
+            {
+                corpus.storage += alphabet[any(rng)];
+            }
+        }
+        ranges.emplace_back(start, corpus.storage.size() - start);
+    }
+
+    for (auto [start, size] : ranges)
+    {
+        corpus.lexems.emplace_back(std::string_view{ corpus.storage }.substr(start, size));
+    }
+    return corpus;
+}
+
+template <typename Lookup> double best_ns_per_lookup(Corpus const& corpus, size_t rounds, Lookup&& lookup)
+{
+    double best{ std::numeric_limits<double>::max() };
+    size_t checksum{ 0 };
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        compiler::Stopwatch watch;
+        for (auto lexem : corpus.lexems)
+        {
+            checksum += lookup(lexem);
+        }
+        auto const elapsed = std::chrono::duration<double, std::nano>(watch.elapsed()).count();
+        best = std::min(best, elapsed / static_cast<double>(corpus.lexems.size()));
+    }
+    // Keeps the lookups observable
+    if (checksum == 0) std::cerr << "empty checksum\n";
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t const count = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+    constexpr size_t rounds = 10;
+    auto const corpus = generate(count);
+
+    for (auto lexem : corpus.lexems)
+    {
+        auto const it = KEYWORDS.find(lexem);
+        auto const expected = it == KEYWORDS.end() ? std::nullopt : std::optional{ it->second };
+        if (table(lexem) != expected)
+        {
+            std::cerr << "Mismatch on: " << lexem << '\n';
+            return 1;
+        }
+    }
+
+    auto const map_ns = best_ns_per_lookup(corpus, rounds,
+                                           [](std::string_view lexem) -> size_t
+                                           {
+                                               auto it = KEYWORDS.find(lexem);
+                                               return it == KEYWORDS.end() ? 1 : 2 + static_cast<size_t>(it->second);
+                                           });
+    auto const table_ns = best_ns_per_lookup(corpus, rounds,
+                                             [](std::string_view lexem) -> size_t
+                                             {
+                                                 auto keyword = table(lexem);
+                                                 return keyword ? 2 + static_cast<size_t>(*keyword) : 1;
+                                             });
+
+    std::cout << std::format("keyword lookup, {} lexems, best of {} rounds\n", count, rounds);
+    std::cout << std::format("  unordered_map: {:7.2f} ns/lookup\n", map_ns);
+    std::cout << std::format("  perfect hash:  {:7.2f} ns/lookup ({:.1f}x)\n", table_ns, map_ns / table_ns);
+}
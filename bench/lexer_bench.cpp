@@ -0,0 +1,245 @@
+#include "lexer/lexer.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Throughput of Lexer::advance over generated sources with different token mixes. The report is JSON on stdout
+// with a fixed key order and precision, so runs on different commits can be diffed or collected by a script.
+//
+// Usage: lexer_bench [--size=MB] [--rounds=N] [--mix=identifiers|operators|whitespace|comments|constants]...
+
+namespace
+{
+
+enum class Mix
+{
+    Identifiers,
+    Operators,
+    Whitespace,
+    Comments,
+    Constants,
+};
+
+constexpr std::array mixes{ Mix::Identifiers, Mix::Operators, Mix::Whitespace, Mix::Comments, Mix::Constants };
+
+std::string_view to_string(Mix mix)
+{
+    switch (mix)
+    {
+    case Mix::Identifiers: return "identifiers";
+    case Mix::Operators: return "operators";
+    case Mix::Whitespace: return "whitespace";
+    case Mix::Comments: return "comments";
+    case Mix::Constants: return "constants";
+    }
+    return "";
+}
+
+class Generator
+{
+public:
+    explicit Generator(Mix mix) : mix_{ mix } {}
+
+    std::string operator()(size_t bytes)
+    {
+        std::string src;
+        src.reserve(bytes + 256);
+        src += "int main()\n{\n";
+        while (src.size() < bytes)
+        {
+            switch (mix_)
+            {
+            case Mix::Identifiers: identifiers(src); break;
+            case Mix::Operators: operators(src); break;
+            case Mix::Whitespace: whitespace(src); break;
+            case Mix::Comments: comments(src); break;
+            case Mix::Constants: constants(src); break;
+            }
+        }
+        src += "}\n";
+        return src;
+    }
+
+private:
+    // Declarations and calls with long names and keywords, most bytes go to identifier runs
+    void identifiers(std::string& src)
+    {
+        constexpr std::array<std::string_view, 6> types{ "int",           "unsigned long", "const char",
+                                                         "signed short", "long long",     "_Bool" };
+        src += std::format("    {} {} = {}({}) + {};\n", pick(types), name(), name(), name(), name());
+    }
+
+    // Dense expressions, mostly one and two byte punctuators between short operands
+    void operators(std::string& src)
+    {
+        constexpr std::array<std::string_view, 18> ops{ "+",  "-",  "*",  "/",  "%",  "<<", ">>", "&",  "|",
+                                                        "^",  "&&", "||", "<",  ">=", "==", "!=", "<=", ">" };
+        constexpr std::array<std::string_view, 6> assign{ "=", "+=", "-=", "<<=", "&=", "|=" };
+        src += std::format("    {}{}", short_name(), pick(assign));
+        for (int terms = 0; terms < 6; ++terms)
+        {
+            src += std::format("({}{}{}){}", short_name(), pick(ops), number(), pick(ops));
+        }
+        src += std::format("!{}->{}[{}];\n", short_name(), short_name(), number());
+    }
+
+    // Sparse statements separated by long runs of blanks, tabs and empty lines
+    void whitespace(std::string& src)
+    {
+        constexpr std::string_view blanks = " \t\n\n\n\t\t\r\n  \v\f";
+        src += std::format("{} = {} + {};", short_name(), short_name(), number());
+        for (size_t run = 16 + rng_() % 112; run > 0; --run)
+        {
+            src += blanks[rng_() % blanks.size()];
+        }
+    }
+
+    // Documentation blocks, trailing line comments and string literals around a few statements
+    void comments(std::string& src)
+    {
+        src += "/*\n";
+        for (size_t line = 4 + rng_() % 28; line > 0; --line)
+        {
+            src += std::format(" * {} computes {} from {} and keeps it below {}\n", name(), name(), name(), number());
+        }
+        src += " */\n";
+        src += std::format("    {} = \"{} with an \\\"escaped\\\" quote\"; // {}\n", short_name(), name(), name());
+        src += std::format("    {} = '\\n' + '{}'; // see {}\n", short_name(), short_name(), name());
+    }
+
+    // Generated lookup tables: long rows of decimal and hex constants of every width, some with suffixes
+    void constants(std::string& src)
+    {
+        constexpr std::array<std::string_view, 6> suffixes{ "", "", "", "u", "ul", "ull" };
+        src += std::format("    {} =", short_name());
+        for (int column = 0; column < 8; ++column)
+        {
+            auto const value = (uint64_t{ rng_() } << 32 | rng_()) >> (rng_() % 64);
+            if (rng_() % 2 == 0)
+            {
+                src += std::format(" {}{} +", value, pick(suffixes));
+            }
+            else
+            {
+                src += std::format(" 0x{:X}{} +", value, pick(suffixes));
+            }
+        }
+        src += " 0;\n";
+    }
+
+    template <typename T, size_t N> T pick(std::array<T, N> const& from) { return from[rng_() % N]; }
+
+    std::string name() { return std::format("identifier_{}_{}", rng_() % 512, rng_() % 64); }
+    std::string short_name() { return std::string(1, static_cast<char>('a' + rng_() % 26)); }
+    std::string number() { return std::to_string(rng_() % 100000); }
+
+    Mix mix_;
+    std::mt19937 rng_{ 1234 };
+};
+
+struct Result
+{
+    Mix mix;
+    size_t bytes;
+    size_t tokens;
+    double best_ms;
+    double median_ms;
+};
+
+Result run(Mix mix, size_t megabytes, size_t rounds)
+{
+    auto const path = std::filesystem::temp_directory_path() / std::format("lexer_bench_{}.c", to_string(mix));
+    {
+        std::ofstream out{ path };
+        out << Generator{ mix }(megabytes * 1024 * 1024);
+    }
+    auto const& file = compiler::SourceManager::global().load(path);
+    std::filesystem::remove(path);
+
+    size_t tokens{ 0 };
+    std::vector<double> times;
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        compiler::Lexer lexer{ file };
+        tokens = 0;
+        compiler::Stopwatch watch;
+        while (lexer.advance().tag != compiler::tokens::Tag::EoF)
+        {
+            ++tokens;
+        }
+        times.emplace_back(watch.elapsed_ms());
+    }
+    std::sort(times.begin(), times.end());
+    return Result{ mix, file.content.size(), tokens, times.front(), times[times.size() / 2] };
+}
+
+std::string to_json(Result const& result)
+{
+    auto const seconds = result.best_ms / 1e3;
+    return std::format("    {{\"mix\": \"{}\", \"bytes\": {}, \"tokens\": {}, \"best_ms\": {:.3f}, "
+                       "\"median_ms\": {:.3f}, \"mb_per_s\": {:.2f}, \"tokens_per_s\": {:.0f}, "
+                       "\"ns_per_token\": {:.3f}}}",
+                       to_string(result.mix), result.bytes, result.tokens, result.best_ms, result.median_ms,
+                       static_cast<double>(result.bytes) / 1e6 / seconds, static_cast<double>(result.tokens) / seconds,
+                       result.best_ms * 1e6 / static_cast<double>(result.tokens));
+}
+
+bool parse_size(std::string_view text, size_t& out)
+{
+    auto const [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc{} && ptr == text.data() + text.size() && out > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t megabytes{ 16 };
+    size_t rounds{ 5 };
+    std::vector<Mix> selected;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view const arg{ argv[i] };
+        bool ok{ false };
+        if (arg.starts_with("--size="))
+        {
+            ok = parse_size(arg.substr(7), megabytes);
+        }
+        else if (arg.starts_with("--rounds="))
+        {
+            ok = parse_size(arg.substr(9), rounds);
+        }
+        else if (arg.starts_with("--mix="))
+        {
+            auto const it = std::find_if(mixes.begin(), mixes.end(),
+                                         [&](Mix mix) { return to_string(mix) == arg.substr(6); });
+            ok = it != mixes.end();
+            if (ok) selected.emplace_back(*it);
+        }
+        if (!ok)
+        {
+            std::cerr << "Invalid argument: " << arg << '\n';
+            return 1;
+        }
+    }
+    if (selected.empty()) selected.assign(mixes.begin(), mixes.end());
+
+    std::cout << std::format("{{\n  \"benchmark\": \"lexer\",\n  \"size_mb\": {},\n  \"rounds\": {},\n", megabytes,
+                             rounds);
+    std::cout << "  \"results\": [\n";
+    for (size_t i = 0; i < selected.size(); ++i)
+    {
+        std::cout << to_json(run(selected[i], megabytes, rounds)) << (i + 1 < selected.size() ? ",\n" : "\n");
+    }
+    std::cout << "  ]\n}\n";
+}
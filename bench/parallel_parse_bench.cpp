@@ -0,0 +1,113 @@
+#include "ast/parser.hpp"
+#include "ast/sema.hpp"
+#include "lexer/lexer.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Parse time of a generated translation unit of many functions by the number of jobs parsing function bodies. The
+// top level is parsed on one thread either way, so the speedup is bounded by the share of tokens in bodies. Every
+// job count has to produce the same AST as the sequential parse. Arguments: [functions] [rounds] [max jobs]
+//
+// glibc gives each thread its own heap and trims it as soon as blocks are freed, so without a trim threshold every
+// round of the threaded parses page faults its arenas anew while the sequential one reuses warm memory.
+
+namespace
+{
+
+std::string generate(size_t functions)
+{
+    std::mt19937 rng{ 5 };
+    std::uniform_int_distribution<int> value{ 0, 999 };
+    std::uniform_int_distribution<int> shape{ 0, 3 };
+
+    std::string src;
+    for (size_t f = 0; f < functions; ++f)
+    {
+        src += std::format("int f{}()\n{{\n    int a = {};\n    int b = a * {} + {};\n", f, value(rng), value(rng),
+                           value(rng));
+        for (int i = shape(rng) + 4; i > 0; --i)
+        {
+            switch (shape(rng))
+            {
+            case 0: src += std::format("    a = (a - {}) * b;\n", value(rng)); break;
+            case 1:
+                src += std::format("    if (a < b)\n    {{\n        a = a + {};\n    }}\n    else\n    {{\n"
+                                   "        b = b / {};\n    }}\n",
+                                   value(rng), value(rng) + 1);
+                break;
+            case 2:
+                src += std::format("    {{\n        int c = a + b;\n        a = c * {};\n    }}\n", value(rng));
+                break;
+            default: src += "    ;\n"; break;
+            }
+        }
+        src += "    return a + b;\n}\n";
+    }
+    return src;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t const functions = argc > 1 ? std::stoul(argv[1]) : 20000;
+    size_t const rounds = argc > 2 ? std::stoul(argv[2]) : 5;
+    size_t const max_jobs = argc > 3 ? std::stoul(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+#ifdef __GLIBC__
+    mallopt(M_TRIM_THRESHOLD, 1 << 30);
+#endif
+
+    auto const& file = compiler::SourceManager::global().add_buffer("parallel_parse_bench.c", generate(functions));
+    auto const tape = compiler::Lexer{ file }.tape();
+    std::cout << std::format("{} functions, {} tokens, {} hardware threads\n", functions, tape.size(),
+                             std::thread::hardware_concurrency());
+    std::cout << std::format("{:>6} {:>12} {:>10}\n", "jobs", "parse ms", "speedup");
+
+    std::string reference;
+    double sequential{ 0 };
+    for (size_t jobs = 1; jobs <= max_jobs; jobs *= 2)
+    {
+        std::vector<double> times;
+        std::string dump;
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            compiler::Sema sema;
+            compiler::ast::AstContext context;
+            compiler::Parser parser{ tape, sema, context, jobs };
+
+            compiler::Stopwatch watch;
+            auto const tu = parser.parse();
+            times.emplace_back(watch.elapsed_ms());
+            if (round == 0)
+            {
+                std::ostringstream os;
+                tu->stream(os);
+                dump = std::move(os).str();
+            }
+        }
+        std::sort(times.begin(), times.end());
+        auto const median = times[times.size() / 2];
+
+        if (jobs == 1)
+        {
+            reference = std::move(dump);
+            sequential = median;
+        }
+        else if (dump != reference)
+        {
+            std::cerr << std::format("AST parsed with {} jobs differs from the sequential one\n", jobs);
+            return 1;
+        }
+        std::cout << std::format("{:>6} {:>12.3f} {:>9.2f}x\n", jobs, median, sequential / median);
+    }
+}
@@ -0,0 +1,168 @@
+#include "lexer/incremental.hpp"
+#include "lexer/lexer.hpp"
+#include "util/stopwatch.hpp"
+#include <algorithm>
+#include <array>
+#include <format>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Incremental re-lexing after small edits against lexing the edited file from scratch. The incremental timing covers
+// applying the edit to the buffer as well. Every relexed tape is checked against the full one. Edits only ever produce
+// valid tokens, so no diagnostics get in the way of the timings. Arguments: [size in MB] [edits per kind]
+
+namespace
+{
+
+std::string generate(size_t bytes)
+{
+    std::mt19937 rng{ 11 };
+    std::uniform_int_distribution<int> value{ 0, 99999 };
+    std::uniform_int_distribution<int> name{ 0, 4095 };
+
+    std::string src;
+    src.reserve(bytes + 128);
+    src += "int main()\n{\n";
+    while (src.size() < bytes)
+    {
+        src += std::format("    int v{} = (v{} * {}) + 0x{:x}; // from v{}\n", name(rng), name(rng), value(rng),
+                           value(rng), name(rng));
+        if (value(rng) % 16 == 0)
+        {
+            src += std::format("    /* v{} is kept\n       below {} */\n", name(rng), value(rng));
+        }
+    }
+    src += "}\n";
+    return src;
+}
+
+enum class Kind
+{
+    Insert,  // A new identifier after some token
+    Blank,   // A token overwritten with spaces
+    Comment, // "// " at the start of a line
+    Wrap,    // A few lines put into a block comment
+};
+
+constexpr std::array kinds{ Kind::Insert, Kind::Blank, Kind::Comment, Kind::Wrap };
+
+std::string_view to_string(Kind kind)
+{
+    switch (kind)
+    {
+    case Kind::Insert: return "insert";
+    case Kind::Blank: return "blank";
+    case Kind::Comment: return "comment";
+    case Kind::Wrap: return "wrap";
+    }
+    return "";
+}
+
+size_t line_start(std::string_view text, size_t offset)
+{
+    auto const newline = offset == 0 ? std::string_view::npos : text.rfind('\n', offset - 1);
+    return newline == std::string_view::npos ? 0 : newline + 1;
+}
+
+struct EditText
+{
+    compiler::Edit edit;
+    std::string storage;
+};
+
+EditText make_edit(Kind kind, compiler::File const& file, compiler::tokens::Tape const& tape, std::mt19937& rng)
+{
+    std::uniform_int_distribution<size_t> pick{ 0, tape.size() - 2 };
+    auto const& tok = tape[pick(rng)];
+    auto const text = file.content;
+    EditText result{ { tok.offset + tok.length, 0, {} }, {} };
+    switch (kind)
+    {
+    case Kind::Insert: result.storage = std::format(" inserted_{} ", rng() % 1000); break;
+    case Kind::Blank:
+        result.edit = { tok.offset, tok.length, {} };
+        result.storage.assign(tok.length, ' ');
+        break;
+    case Kind::Comment:
+        result.edit.offset = line_start(text, tok.offset);
+        result.storage = "// ";
+        break;
+    case Kind::Wrap:
+    {
+        auto const from = line_start(text, tok.offset);
+        auto to = from;
+        for (size_t lines = 1 + rng() % 4; lines > 0 && to < text.size(); --lines)
+        {
+            to = std::min(text.size(), text.find('\n', to) + 1);
+        }
+        result.edit = { from, to - from, {} };
+        result.storage = std::format("/*{}*/", text.substr(from, to - from));
+        break;
+    }
+    }
+    result.edit.text = result.storage;
+    return result;
+}
+
+bool same_tape(compiler::tokens::Tape const& lhs, compiler::tokens::Tape const& rhs)
+{
+    auto same_token = [](auto const& a, auto const& b)
+    {
+        return a.tag == b.tag && a.kind == b.kind && a.file == b.file && a.offset == b.offset && a.length == b.length
+               && a.payload == b.payload;
+    };
+    return lhs.literals == rhs.literals
+           && std::equal(lhs.tokens.begin(), lhs.tokens.end(), rhs.tokens.begin(), rhs.tokens.end(), same_token);
+}
+
+double median(std::vector<double> times)
+{
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t const megabytes = argc > 1 ? std::stoul(argv[1]) : 1;
+    size_t const edits = argc > 2 ? std::stoul(argv[2]) : 25;
+
+    auto& file = compiler::SourceManager::global().add_editable("relex_bench.c", generate(megabytes << 20));
+    auto tape = compiler::Lexer{ file }.tape();
+    std::mt19937 rng{ 3 };
+
+    std::cout << std::format("relexing after an edit, {} MB, {} tokens, {} edits per kind\n", megabytes, tape.size(),
+                             edits);
+    std::cout << std::format("{:>8} {:>12} {:>12} {:>8}\n", "edit", "edit us", "full us", "speedup");
+    for (auto kind : kinds)
+    {
+        std::vector<double> relex_us;
+        std::vector<double> full_us;
+        for (size_t i = 0; i < edits; ++i)
+        {
+            auto const change = make_edit(kind, file, tape, rng);
+
+            compiler::Stopwatch relex_watch;
+            compiler::apply_edit(file, change.edit);
+            auto relexed = compiler::relex(std::move(tape), file, change.edit);
+            relex_us.emplace_back(relex_watch.elapsed_ms() * 1e3);
+
+            compiler::Stopwatch full_watch;
+            auto const full = compiler::Lexer{ file }.tape();
+            full_us.emplace_back(full_watch.elapsed_ms() * 1e3);
+
+            if (!same_tape(relexed, full))
+            {
+                std::cerr << "Tape mismatch after a " << to_string(kind) << " edit at " << change.edit.offset << '\n';
+                return 1;
+            }
+            tape = std::move(relexed);
+        }
+        auto const relex = median(relex_us);
+        auto const full = median(full_us);
+        std::cout << std::format("{:>8} {:>12.1f} {:>12.1f} {:>7.1f}x\n", to_string(kind), relex, full, full / relex);
+    }
+}
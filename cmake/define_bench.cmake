@@ -0,0 +1,6 @@
+include_guard()
+
+function(define_bench BENCHNAME FILENAME)
+    add_executable(${BENCHNAME} ${FILENAME})
+    target_link_libraries(${BENCHNAME} PRIVATE ${MAIN_LIB_NAME})
+endfunction()
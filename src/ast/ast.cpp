@@ -1,8 +1,10 @@
 #include "ast.hpp"
+#include "dfs.hpp"
 #include "lexer/reflection.hpp"
 #include "sema.hpp"
 #include "type.hpp"
 #include "util/ice.hpp"
+#include <array>
 #include <limits>
 
 namespace compiler::ast
@@ -34,104 +36,150 @@ constexpr bool is_assign_op(tokens::Punctuator op)
     return false;
 }
 
-} // namespace
-
-std::ostream& Item::stream(std::ostream& os) const
+bool same_type(TypeDecl const& lhs, TypeDecl const& rhs)
 {
-    value_->stream(os);
-    return os;
+    return *lhs.type() == *rhs.type() && lhs.storage() == rhs.storage();
 }
 
-std::ostream& TranslationUnit::stream(std::ostream& os) const { return items_->stream(os); }
-
-std::ostream& Items::stream(std::ostream& os) const
+// Whether two nodes agree in everything but their location and children
+bool same_node(Node const& lhs, Node const& rhs)
 {
-    for (auto& item : items_)
+    if (lhs.kind() != rhs.kind()) return false;
+    switch (lhs.kind())
+    {
+    case NodeKind::BinExpr: return static_cast<BinExpr const&>(lhs).op() == static_cast<BinExpr const&>(rhs).op();
+    case NodeKind::UnaryExpr:
+        return static_cast<UnaryExpr const&>(lhs).op() == static_cast<UnaryExpr const&>(rhs).op();
+    case NodeKind::IntLiteral:
     {
-        item->stream(os);
+        auto const& a = static_cast<IntLiteral const&>(lhs);
+        auto const& b = static_cast<IntLiteral const&>(rhs);
+        return a.value() == b.value() && a.form().pack() == b.form().pack();
+    }
+    case NodeKind::Iden: return static_cast<Iden const&>(lhs).symbol() == static_cast<Iden const&>(rhs).symbol();
+    case NodeKind::TypeDecl: return same_type(static_cast<TypeDecl const&>(lhs), static_cast<TypeDecl const&>(rhs));
+    default: return true;
     }
-    return os;
 }
 
-std::ostream& CompoundStmt::stream(std::ostream& os) const
+} // namespace
+
+namespace
 {
-    os << "{\n";
-    items_->stream(os);
-    os << "}\n";
-    return os;
-}
 
-std::ostream& ObjDecl::stream(std::ostream& os) const
+// Text of a node that comes before its children
+void open(Node const& node, std::ostream& os)
 {
-    type_->stream(os);
-    iden_->stream(os);
-    if (init_ != nullptr)
+    switch (node.kind())
     {
-        os << " = ";
-        init_->stream(os);
+    case NodeKind::BinExpr: os << "("; break;
+    case NodeKind::UnaryExpr: os << "( " << tokens::to_string(static_cast<UnaryExpr const&>(node).op()) << " "; break;
+    case NodeKind::IfStmt: os << "if ("; break;
+    case NodeKind::CompoundStmt: os << "{\n"; break;
+    case NodeKind::ReturnStmt: os << "return "; break;
+    case NodeKind::IntLiteral:
+    case NodeKind::Iden:
+    case NodeKind::TypeDecl:
+    case NodeKind::NullStmt: node.stream(os); break;
+    default: break;
     }
-    os << ";\n";
-    return os;
 }
 
-std::ostream& FunctionDecl::stream(std::ostream& os) const
+// Text of a node that goes after its child `done`, between it and the next one
+void between(Node const& node, size_t done, std::ostream& os)
 {
-    return_->stream(os);
-    iden_->stream(os);
-    os << "()\n";
-    body_->stream(os);
-    return os;
+    switch (node.kind())
+    {
+    case NodeKind::BinExpr:
+        if (done == 0) os << " " << tokens::to_string(static_cast<BinExpr const&>(node).op()) << " ";
+        break;
+    case NodeKind::IfStmt:
+        if (done == 0) os << ")\n";
+        else if (done == 1 && static_cast<IfStmt const&>(node).alt() != nullptr) os << "else\n";
+        break;
+    case NodeKind::ObjDecl:
+        if (done == 1 && static_cast<ObjDecl const&>(node).initalizer() != nullptr) os << " = ";
+        break;
+    case NodeKind::FunctionDecl:
+        if (done == 1) os << "()\n";
+        break;
+    default: break;
+    }
 }
 
-std::ostream& Iden::stream(std::ostream& os) const { return os << name_; }
-
-std::ostream& UnaryExpr::stream(std::ostream& os) const
+// Text of a node that comes after its children
+void close(Node const& node, std::ostream& os)
 {
-    os << "( " << tokens::to_string(op_) << " ";
-    operand_->stream(os);
-    return os << " )";
+    switch (node.kind())
+    {
+    case NodeKind::BinExpr: os << ")"; break;
+    case NodeKind::UnaryExpr: os << " )"; break;
+    case NodeKind::CompoundStmt: os << "}\n"; break;
+    case NodeKind::ReturnStmt: os << "\n"; break;
+    case NodeKind::ObjDecl:
+    case NodeKind::ExprStmt: os << ";\n"; break;
+    default: break;
+    }
 }
 
-std::ostream& BinExpr::stream(std::ostream& os) const
+// Writes the subtree at `root` in a walk that keeps its path on the heap, the depth of expressions is not bounded by
+// the native stack
+std::ostream& write(Node const& root, std::ostream& os)
 {
-    os << "(";
-    lhs_->stream(os);
-    os << " " << tokens::to_string(op_) << " ";
-    rhs_->stream(os);
-    os << ")";
+    struct Open
+    {
+        Node const* node;
+        size_t done; // Children written so far
+    };
+    std::vector<Open> path;
+    dfs(
+        root,
+        [&](Node const& node)
+        {
+            open(node, os);
+            path.emplace_back(Open{ &node, 0 });
+        },
+        [&](Node const& node)
+        {
+            path.pop_back();
+            close(node, os);
+            if (!path.empty()) between(*path.back().node, path.back().done++, os);
+        });
     return os;
 }
 
-std::ostream& IfStmt::stream(std::ostream& os) const
-{
-    os << "if (";
-    cond_->stream(os);
-    os << ")\n";
-    cons_->stream(os);
+} // namespace
 
-    if (alt_ != nullptr)
-    {
-        os << "else\n";
-        alt_->stream(os);
-    }
-    return os;
-}
+std::ostream& Item::stream(std::ostream& os) const { return write(*this, os); }
 
-std::ostream& ReturnStmt::stream(std::ostream& os) const
-{
-    os << "return ";
-    expr_->stream(os);
-    return os << "\n";
-}
+std::ostream& TranslationUnit::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& Items::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& CompoundStmt::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& ObjDecl::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& FunctionDecl::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& Iden::stream(std::ostream& os) const { return os << name(); }
+
+std::ostream& UnaryExpr::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& BinExpr::stream(std::ostream& os) const { return write(*this, os); }
 
-std::ostream& ExprStmt::stream(std::ostream& os) const
+std::ostream& IfStmt::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& ReturnStmt::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& ExprStmt::stream(std::ostream& os) const { return write(*this, os); }
+
+std::ostream& IntLiteral::stream(std::ostream& os) const
 {
-    expr_->stream(os);
-    return os << ";\n";
+    if (form_.character) return os << std::to_string(value_);
+    return os << std::to_string(static_cast<uint64_t>(value_));
 }
 
-std::ostream& IntLiteral::stream(std::ostream& os) const { return os << std::to_string(value_); }
-
 std::ostream& TypeDecl::stream(std::ostream& os) const
 {
     std::string type;
@@ -149,10 +197,25 @@ std::ostream& TypeDecl::stream(std::ostream& os) const
 
 // end stream implementations
 // Expr checks
-Type const* UnaryExpr::check(Sema&)
+
+Type const* Expr::check(Sema& sema)
 {
-    switch (op_)
+    dfs(*this, nop, [&](Node& node) {
+        auto& expr = static_cast<Expr&>(node);
+        expr.type_ = expr.check_node(sema);
+    });
+    return type_;
+}
+
+Type const* UnaryExpr::check_node(Sema& sema) { return type_of(sema, loc(), op_, operand_->type()); }
+
+Type const* UnaryExpr::type_of(Sema& sema, Loc loc, tokens::Punctuator op, Type const* operand)
+{
+    if (operand == nullptr) return nullptr;
+    switch (op)
     {
+    case tokens::Punctuator::Exclaim: return sema.get_type(BasicType::Int);
+    // Parsed, but neither typed nor generated yet
     case tokens::Punctuator::PlusPlus:
     case tokens::Punctuator::MinusMinus:
     case tokens::Punctuator::Ampersand:
@@ -160,58 +223,76 @@ Type const* UnaryExpr::check(Sema&)
     case tokens::Punctuator::Plus:
     case tokens::Punctuator::Minus:
     case tokens::Punctuator::Tilde:
-    case tokens::Punctuator::Exclaim:
+        loc.err() << "Unary operator '" << tokens::to_string(op) << "' is not supported\n";
+        return nullptr;
     default: REPORT_ICE("Unexpected operator for UnaryExpression");
     }
 }
 
-Type const* IntLiteral::check(Sema& sema)
+Type const* IntLiteral::check_node(Sema& sema) { return type_of(sema, loc(), value_, form_); }
+
+Type const* IntLiteral::type_of(Sema& sema, Loc loc, int64_t bits, tokens::IntForm form)
 {
-    // TODO only decimal constant without suffixes support now
-    if (value_ <= std::numeric_limits<int>::max())
-    {
-        return type_ = sema.get_type(BasicType::Int);
-    }
+    if (form.character) return sema.get_type(BasicType::Int);
 
-    if (value_ <= std::numeric_limits<long int>::max())
+    // First type of the list which can represent the value (C11 6.4.4.1). The suffix sets the lowest rank, a u
+    // suffix rules out the signed types and only octal and hex constants fall back on unsigned ones.
+    struct Candidate
     {
-        return type_ = sema.get_type(BasicType::LongInt);
-    }
-
-    if (value_ <= std::numeric_limits<long long int>::max())
+        BasicType basic;
+        bool is_signed;
+        uint64_t max;
+    };
+    constexpr std::array<Candidate, 6> candidates{ {
+        { BasicType::Int, true, std::numeric_limits<int>::max() },
+        { BasicType::Int, false, std::numeric_limits<unsigned>::max() },
+        { BasicType::LongInt, true, std::numeric_limits<long>::max() },
+        { BasicType::LongInt, false, std::numeric_limits<unsigned long>::max() },
+        { BasicType::LongLongInt, true, std::numeric_limits<long long>::max() },
+        { BasicType::LongLongInt, false, std::numeric_limits<unsigned long long>::max() },
+    } };
+
+    auto const value = static_cast<uint64_t>(bits);
+    for (size_t i = 2 * form.longs; i < candidates.size(); ++i)
     {
-        return type_ = sema.get_type(BasicType::LongLongInt);
+        auto const& candidate = candidates[i];
+        if (candidate.is_signed && form.is_unsigned) continue;
+        if (!candidate.is_signed && !form.is_unsigned && form.decimal) continue;
+        if (value <= candidate.max) return sema.new_type(Type{ candidate.basic, candidate.is_signed });
     }
-    REPORT_ICE("Unsupported constant");
+
+    // A decimal constant beyond long long, the lexer already refused anything past 64 bits
+    loc.wrn() << "Integer constant is so large that it is unsigned\n";
+    return sema.new_type(Type{ BasicType::LongLongInt, false });
 }
 
-Type const* BinExpr::check(Sema& sema)
-{
-    auto lhs = lhs_->check(sema);
-    auto rhs = rhs_->check(sema);
+Type const* BinExpr::check_node(Sema& sema) { return type_of(sema, loc(), op_, lhs_->type(), rhs_->type()); }
 
-    if (is_assign_op(op_))
+Type const* BinExpr::type_of(Sema& sema, Loc loc, tokens::Punctuator op, Type const* lhs, Type const* rhs)
+{
+    if (lhs == nullptr || rhs == nullptr) return nullptr;
+    if (is_assign_op(op))
     {
 
-        Type::implicit_conversion(loc(), *lhs, *rhs);
+        Type::implicit_conversion(loc, *lhs, *rhs);
         // TODO lhs convert rhs to lhs,
         if (!lhs->is_modifyable_lvalue()) // TODO shouldn't this also check whether underlying expr is Iden / table
                                           // access?
         {
-            loc().err() << "Cannot assign to non modifyable lvalue\n";
-            return type_;
+            loc.err() << "Cannot assign to non modifyable lvalue\n";
+            return nullptr;
         }
-        return type_ = lhs;
+        return lhs;
     }
 
-    auto converted = Type::implicit_conversion(loc(), *lhs, *rhs);
-    return type_ = sema.new_type(converted);
+    auto converted = Type::implicit_conversion(loc, *lhs, *rhs);
+    return sema.new_type(converted);
 }
 
-Type const* Iden::check(Sema& sema)
+Type const* Iden::check_node(Sema& sema)
 {
     referenced_ = sema.lookup(*this);
-    return type_ = referenced_->type().type();
+    return referenced_->type().type();
 }
 // End expr checks
 // Stmnt checks
@@ -241,7 +322,7 @@ void ExprStmt::check(Sema& sema) { expr_->check(sema); }
 void IfStmt::check(Sema& sema)
 {
     auto expr_t = cond_->check(sema);
-    if (!expr_t->is_scalar())
+    if (expr_t != nullptr && !expr_t->is_scalar())
     {
         loc().err() << "Value of the expression is not convertible to bool\n";
     }
@@ -269,6 +350,7 @@ void ReturnStmt::check(Sema& sema)
     }
 
     auto ret_expr_t = expr_->check(sema);
+    if (ret_expr_t == nullptr) return;
     auto converted = Type::implicit_conversion(loc(), *func.type().type(), *ret_expr_t);
     sema.new_type(converted);
 }
@@ -281,4 +363,77 @@ void ObjDecl::add(Sema& sema) const { sema.add(*this); }
 
 void FunctionDecl::add(Sema& sema) const { sema.add(*this); }
 
+uint64_t FunctionDecl::structural_hash() const
+{
+    // Statements keep no hash of their own. Their pre-order walk is hashed instead, together with whatever tells how
+    // many children a node has, which is as unambiguous as a Merkle tree over them. Expressions bring their own hash.
+    Hasher hasher;
+    auto const type = [&](TypeDecl const& decl)
+    {
+        auto const& t = *decl.type();
+        hasher.add(uint64_t{ to_underlying(t.basic_type()) } | uint64_t{ t.is_signed() } << 8
+                   | uint64_t{ t.qualifiers().to_ulong() } << 9 | uint64_t{ to_underlying(decl.storage()) } << 16);
+    };
+    auto const node = [&](Node const& n)
+    {
+        hasher.add(static_cast<uint64_t>(n.kind()));
+        if (Expr::is(n.kind()))
+        {
+            hasher.add(static_cast<Expr const&>(n).hash());
+            return false;
+        }
+        switch (n.kind())
+        {
+        case NodeKind::IfStmt: hasher.add(uint64_t{ static_cast<IfStmt const&>(n).alt() != nullptr }); break;
+        case NodeKind::ReturnStmt: hasher.add(uint64_t{ static_cast<ReturnStmt const&>(n).expr() != nullptr }); break;
+        case NodeKind::ObjDecl:
+            hasher.add(uint64_t{ static_cast<ObjDecl const&>(n).initalizer() != nullptr });
+            break;
+        case NodeKind::TypeDecl: type(static_cast<TypeDecl const&>(n)); break;
+        case NodeKind::Items: hasher.add(uint64_t{ static_cast<Items const&>(n).items().size() }); break;
+        default: break;
+        }
+        return true;
+    };
+
+    type(*return_);
+    hasher.add(uint64_t{ args_.size() });
+    for (auto const* arg : args_)
+    {
+        dfs(*arg, node);
+    }
+    dfs(*body_, node);
+    return hasher.digest();
+}
+
+bool FunctionDecl::same_structure(FunctionDecl const& other) const
+{
+    if (!same_type(*return_, *other.return_) || args_.size() != other.args_.size()) return false;
+
+    // Both trees are walked side by side, pairs of nodes in the same place have to agree and have as many children
+    std::vector<std::pair<Node const*, Node const*>> pending{ { body_, other.body_ } };
+    for (size_t i = 0; i < args_.size(); ++i)
+    {
+        pending.emplace_back(args_[i], other.args_[i]);
+    }
+    std::vector<Node const*> lhs;
+    std::vector<Node const*> rhs;
+    while (!pending.empty())
+    {
+        auto const [a, b] = pending.back();
+        pending.pop_back();
+        if (!same_node(*a, *b)) return false;
+        lhs.clear();
+        rhs.clear();
+        detail::children(*a, lhs);
+        detail::children(*b, rhs);
+        if (lhs.size() != rhs.size()) return false;
+        for (size_t i = 0; i < lhs.size(); ++i)
+        {
+            pending.emplace_back(lhs[i], rhs[i]);
+        }
+    }
+    return true;
+}
+
 } // namespace compiler::ast
@@ -1,30 +1,94 @@
 #pragma once
+#include "context.hpp"
 #include "lexer/token.hpp"
 #include "loc.hpp"
 #include "sema.fwd.hpp"
 #include "type.hpp"
+#include "util/hash.hpp"
+#include <concepts>
 #include <iostream>
-#include <memory>
-#include <vector>
+#include <span>
 
 namespace compiler::ast
 {
 
-template <typename T> using Ptr = std::unique_ptr<T>;
+// Nodes are owned by the AstContext which made them
+template <typename T> using Ptr = T*;
+
+// Concrete class of a Node. Kinds of one abstract base are kept contiguous so membership is a range check.
+enum class NodeKind : uint8_t
+{
+    // Expr
+    BinExpr,
+    IntLiteral,
+    Iden,
+    UnaryExpr,
+    // Stmt
+    ExprStmt,
+    IfStmt,
+    CompoundStmt,
+    ReturnStmt,
+    NullStmt,
+    // Declaration
+    ObjDecl,
+    FunctionDecl,
+
+    TypeDecl,
+    Item,
+    Items,
+    TranslationUnit,
+};
+
+constexpr std::string_view to_string(NodeKind kind)
+{
+    switch (kind)
+    {
+    case NodeKind::BinExpr: return "BinExpr";
+    case NodeKind::IntLiteral: return "IntLiteral";
+    case NodeKind::Iden: return "Iden";
+    case NodeKind::UnaryExpr: return "UnaryExpr";
+    case NodeKind::ExprStmt: return "ExprStmt";
+    case NodeKind::IfStmt: return "IfStmt";
+    case NodeKind::CompoundStmt: return "CompoundStmt";
+    case NodeKind::ReturnStmt: return "ReturnStmt";
+    case NodeKind::NullStmt: return "NullStmt";
+    case NodeKind::ObjDecl: return "ObjDecl";
+    case NodeKind::FunctionDecl: return "FunctionDecl";
+    case NodeKind::TypeDecl: return "TypeDecl";
+    case NodeKind::Item: return "Item";
+    case NodeKind::Items: return "Items";
+    case NodeKind::TranslationUnit: return "TranslationUnit";
+    }
+    return "<Unknown>";
+}
+
+// Hash of a node made of its kind, its own data and the hashes of its children, in that order
+template <std::same_as<uint64_t>... Children>
+constexpr uint64_t merkle(NodeKind kind, uint64_t data, Children... children)
+{
+    auto hash = Hasher::combine(static_cast<uint64_t>(kind), data);
+    ((hash = Hasher::combine(hash, children)), ...);
+    return hash;
+}
 
 class Node
 {
 public:
-    explicit Node(Loc loc) : loc_{ loc } {}
-    virtual ~Node() = default;
+    Node(NodeKind kind, Loc loc) : loc_{ loc }, kind_{ kind } {}
 
     Loc loc() const { return loc_; }
+    NodeKind kind() const { return kind_; }
 
     void dump() const { stream(std::cout) << std::endl; }
     virtual std::ostream& stream(std::ostream&) const = 0;
 
+protected:
+    // Nodes live in an AstContext and are never destroyed one by one
+    ~Node() = default;
+
 private:
     Loc loc_;
+    NodeKind kind_;
 };
 
 class Expr : public Node
@@ -32,10 +96,21 @@ class Expr : public Node
 public:
     using Node::Node;
 
-    virtual Type const* check(Sema&) = 0;
+    static bool is(NodeKind kind) { return kind >= NodeKind::BinExpr && kind <= NodeKind::UnaryExpr; }
+
+    // Checks the whole expression, operands before their operator and without recursion
+    Type const* check(Sema&);
+    Type const* type() const { return type_; }
+    // Structural hash of the whole expression, set on construction from the operands. Locations and types are left
+    // out, so equal expressions written in different places hash the same.
+    uint64_t hash() const { return hash_; }
 
 protected:
+    // Types this node alone, the operands are checked already
+    virtual Type const* check_node(Sema&) = 0;
+
     Type const* type_ = nullptr;
+    uint64_t hash_{ 0 };
 };
 
 class Stmt : public Node
@@ -43,27 +118,34 @@ class Stmt : public Node
 public:
     using Node::Node;
 
+    static bool is(NodeKind kind) { return kind >= NodeKind::ExprStmt && kind <= NodeKind::NullStmt; }
+
     virtual void check(Sema&) = 0;
 };
 
 class BinExpr : public Expr
 {
 public:
-    explicit BinExpr(Loc loc, Ptr<Expr>&& lhs, tokens::Punctuator op, Ptr<Expr>&& rhs) :
-        Expr(loc),
+    explicit BinExpr(Loc loc, Ptr<Expr> lhs, tokens::Punctuator op, Ptr<Expr> rhs) :
+        Expr(NodeKind::BinExpr, loc),
         op_{ op },
-        lhs_{ std::move(lhs) },
-        rhs_{ std::move(rhs) }
+        lhs_{ lhs },
+        rhs_{ rhs }
     {
+        hash_ = merkle(NodeKind::BinExpr, static_cast<uint64_t>(op), lhs->hash(), rhs->hash());
     }
 
-    const Type* check(Sema&) override;
     std::ostream& stream(std::ostream&) const override;
+    // Type of `lhs op rhs`, null if either operand has none
+    static Type const* type_of(Sema&, Loc loc, tokens::Punctuator op, Type const* lhs, Type const* rhs);
 
     tokens::Punctuator op() const { return op_; }
     Expr const& lhs() const { return *lhs_; }
     Expr const& rhs() const { return *rhs_; }
 
+protected:
+    Type const* check_node(Sema&) override;
+
 private:
     tokens::Punctuator op_;
     Ptr<Expr> lhs_;
@@ -73,49 +155,72 @@ private:
 class IntLiteral : public Expr
 {
 public:
-    IntLiteral(Loc loc, int64_t value) : Expr(loc), value_{ value } {}
+    // `value` holds the bits of the constant, it is only negative for character constants
+    IntLiteral(Loc loc, int64_t value, tokens::IntForm form = {}) :
+        Expr(NodeKind::IntLiteral, loc),
+        value_{ value },
+        form_{ form }
+    {
+        hash_ = merkle(NodeKind::IntLiteral, static_cast<uint64_t>(value), uint64_t{ form.pack() });
+    }
 
-    const Type* check(Sema&) override;
     std::ostream& stream(std::ostream&) const override;
+    static Type const* type_of(Sema&, Loc loc, int64_t value, tokens::IntForm form);
     int64_t value() const { return value_; }
+    tokens::IntForm form() const { return form_; }
+
+protected:
+    Type const* check_node(Sema&) override;
 
 private:
     int64_t value_;
+    tokens::IntForm form_;
 };
 
 class Iden : public Expr
 {
 public:
-    Iden(Loc loc, std::string const& name) : Expr(loc), name_{ name } {}
+    // Symbols are numbered per process, the spelling is hashed so the hash stays the same across runs
+    Iden(Loc loc, Symbol name) : Expr(NodeKind::Iden, loc), name_{ name }
+    {
+        hash_ = merkle(NodeKind::Iden, Interner::global().hash(name));
+    }
 
-    std::string_view name() const { return name_; }
+    Symbol symbol() const { return name_; }
+    std::string_view name() const { return Interner::global().text(name_); }
 
-    const Type* check(Sema&) override;
     std::ostream& stream(std::ostream&) const override;
 
     class ObjDecl const* referenced() const { return referenced_; }
 
+protected:
+    Type const* check_node(Sema&) override;
+
 private:
-    std::string name_;
+    Symbol name_;
     ObjDecl const* referenced_{ nullptr };
 };
 
 class UnaryExpr : public Expr
 {
 public:
-    UnaryExpr(Loc loc, tokens::Punctuator op, Ptr<Expr>&& operand) :
-        Expr(loc),
+    UnaryExpr(Loc loc, tokens::Punctuator op, Ptr<Expr> operand) :
+        Expr(NodeKind::UnaryExpr, loc),
         op_{ op },
-        operand_{ std::move(operand) }
+        operand_{ operand }
     {
+        hash_ = merkle(NodeKind::UnaryExpr, static_cast<uint64_t>(op), operand->hash());
     }
 
-    Type const* check(Sema&) override;
     std::ostream& stream(std::ostream&) const override;
+    static Type const* type_of(Sema&, Loc loc, tokens::Punctuator op, Type const* operand);
 
     tokens::Punctuator op() const { return op_; }
     Expr& expr() const { return *operand_; }
 
+protected:
+    Type const* check_node(Sema&) override;
+
 private:
     tokens::Punctuator op_;
     Ptr<Expr> operand_;
@@ -124,7 +229,7 @@ private:
 class ExprStmt : public Stmt
 {
 public:
-    ExprStmt(Loc loc, Ptr<Expr>&& expr) : Stmt(loc), expr_{ std::move(expr) } {}
+    ExprStmt(Loc loc, Ptr<Expr> expr) : Stmt(NodeKind::ExprStmt, loc), expr_{ expr } {}
 
     void check(Sema&) override;
     std::ostream& stream(std::ostream&) const override;
@@ -137,11 +242,11 @@ private:
 class IfStmt : public Stmt
 {
 public:
-    IfStmt(Loc loc, Ptr<Expr>&& cond, Ptr<Stmt>&& cons, Ptr<Stmt>&& alt) :
-        Stmt(loc),
-        cond_{ std::move(cond) },
-        cons_{ std::move(cons) },
-        alt_{ std::move(alt) }
+    IfStmt(Loc loc, Ptr<Expr> cond, Ptr<Stmt> cons, Ptr<Stmt> alt) :
+        Stmt(NodeKind::IfStmt, loc),
+        cond_{ cond },
+        cons_{ cons },
+        alt_{ alt }
     {
     }
 
@@ -150,7 +255,7 @@ public:
 
     Expr const& cond() const { return *cond_; }
     Stmt const& cons() const { return *cons_; };
-    Stmt const* alt() const { return alt_.get(); };
+    Stmt const* alt() const { return alt_; };
 
 private:
     Ptr<Expr> cond_;
@@ -170,7 +275,12 @@ enum class Storage : uint8_t
 class TypeDecl : public Node
 {
 public:
-    TypeDecl(Loc loc, Type const* type, Storage storage) : Node(loc), storage_{ storage }, type_{ type } {}
+    TypeDecl(Loc loc, Type const* type, Storage storage) :
+        Node(NodeKind::TypeDecl, loc),
+        storage_{ storage },
+        type_{ type }
+    {
+    }
     virtual std::ostream& stream(std::ostream&) const override;
 
     void set_default_storage(Storage implicit) { storage_ = storage_ == Storage::Unspecified ? implicit : storage_; }
@@ -187,6 +297,8 @@ class Declaration : public Node
 {
 public:
     using Node::Node;
+
+    static bool is(NodeKind kind) { return kind == NodeKind::ObjDecl || kind == NodeKind::FunctionDecl; }
     virtual void add(Sema&) const = 0;
 };
 
@@ -195,11 +307,11 @@ class ObjDecl : public Declaration
     friend Sema;
 
 public:
-    ObjDecl(Loc loc, Ptr<TypeDecl>&& type, Ptr<Iden>&& iden, Ptr<Expr>&& init) :
-        Declaration(loc),
-        type_{ std::move(type) },
-        iden_{ std::move(iden) },
-        init_{ std::move(init) }
+    ObjDecl(Loc loc, Ptr<TypeDecl> type, Ptr<Iden> iden, Ptr<Expr> init) :
+        Declaration(NodeKind::ObjDecl, loc),
+        type_{ type },
+        iden_{ iden },
+        init_{ init }
     {
         // TODO this only works for variables inside functions
         type_->set_default_storage(Storage::Auto);
@@ -209,7 +321,7 @@ public:
     void add(Sema&) const override;
     TypeDecl const& type() const { return *type_; }
     Iden const& iden() const { return *iden_; };
-    Expr const* initalizer() const { return init_.get(); }
+    Expr const* initalizer() const { return init_; }
 
 private:
     Ptr<TypeDecl> type_;
@@ -220,13 +332,16 @@ private:
 class Item : public Node
 {
 public:
-    explicit Item(Ptr<Declaration>&& decl) : Node(decl->loc()), value_{ std::move(decl) } {}
-    explicit Item(Ptr<Stmt>&& stmt) : Node(stmt->loc()), value_{ std::move(stmt) } {}
+    explicit Item(Ptr<Declaration> decl) : Node(NodeKind::Item, decl->loc()), value_{ decl } {}
+    explicit Item(Ptr<Stmt> stmt) : Node(NodeKind::Item, stmt->loc()), value_{ stmt } {}
 
-    Stmt const* stmt() const { return dynamic_cast<Stmt const*>(value_.get()); }
-    Stmt* stmt() { return dynamic_cast<Stmt*>(value_.get()); }
-    Declaration const* decl() const { return dynamic_cast<Declaration const*>(value_.get()); }
-    Declaration* decl() { return dynamic_cast<Declaration*>(value_.get()); }
+    Stmt const* stmt() const { return Stmt::is(value_->kind()) ? static_cast<Stmt const*>(value_) : nullptr; }
+    Stmt* stmt() { return Stmt::is(value_->kind()) ? static_cast<Stmt*>(value_) : nullptr; }
+    Declaration const* decl() const
+    {
+        return Declaration::is(value_->kind()) ? static_cast<Declaration const*>(value_) : nullptr;
+    }
+    Declaration* decl() { return Declaration::is(value_->kind()) ? static_cast<Declaration*>(value_) : nullptr; }
 
     std::ostream& stream(std::ostream& os) const override;
     void check(Sema&);
@@ -238,20 +353,20 @@ private:
 class Items : public Node
 {
 public:
-    explicit Items(Loc loc, std::vector<Ptr<Item>>&& itms) : Node(loc), items_{ std::move(itms) } {}
+    explicit Items(Loc loc, std::span<Ptr<Item> const> itms) : Node(NodeKind::Items, loc), items_{ itms } {}
 
-    std::vector<Ptr<Item>> const& items() const { return items_; }
+    std::span<Ptr<Item> const> items() const { return items_; }
     std::ostream& stream(std::ostream& os) const override;
     void check(Sema&);
 
 private:
-    std::vector<Ptr<Item>> items_;
+    std::span<Ptr<Item> const> items_; // In the arena
 };
 
 class CompoundStmt : public Stmt
 {
 public:
-    explicit CompoundStmt(Loc loc, Ptr<Items>&& itms) : Stmt(loc), items_(std::move(itms)) {}
+    explicit CompoundStmt(Loc loc, Ptr<Items> itms) : Stmt(NodeKind::CompoundStmt, loc), items_(itms) {}
 
     std::ostream& stream(std::ostream& os) const override;
     void check(Sema& sema) override;
@@ -267,15 +382,16 @@ class FunctionDecl : public Declaration
     friend Sema;
 
 public:
-    FunctionDecl(Loc loc, Ptr<TypeDecl>&& type, Ptr<Iden>&& iden, std::vector<Ptr<ObjDecl>>&& args,
-                 Ptr<CompoundStmt>&& body) :
-        Declaration(loc),
-        return_{ std::move(type) },
-        iden_{ std::move(iden) },
-        args_{ std::move(args) },
-        body_{ std::move(body) }
+    FunctionDecl(Loc loc, Ptr<TypeDecl> type, Ptr<Iden> iden, std::span<Ptr<ObjDecl> const> args,
+                 Ptr<CompoundStmt> body) :
+        Declaration(NodeKind::FunctionDecl, loc),
+        return_{ type },
+        iden_{ iden },
+        args_{ args },
+        body_{ body }
     {
         return_->set_default_storage(Storage::Extern);
+        if (body_ != nullptr) hash_ = structural_hash();
     }
 
     void add(Sema&) const override;
@@ -283,24 +399,39 @@ public:
 
     TypeDecl const& type() const { return *return_; }
     Iden const& iden() const { return *iden_; }
+    std::span<Ptr<ObjDecl> const> args() const { return args_; }
     CompoundStmt const& body() const { return *body_; }
+    // For bodies parsed after their declaration
+    void set_body(Ptr<CompoundStmt> body)
+    {
+        body_ = body;
+        hash_ = structural_hash();
+    }
+    // Structural hash of the signature and the body, without the name of the function and without locations:
+    // functions with the same hash can share one definition
+    uint64_t hash() const { return hash_; }
+    // Whether the two functions are the same but for their names and locations, which equal hashes do not prove
+    bool same_structure(FunctionDecl const& other) const;
 
 private:
     Ptr<TypeDecl> return_;
     Ptr<Iden> iden_;
-    std::vector<Ptr<ObjDecl>> args_;
+    std::span<Ptr<ObjDecl> const> args_; // In the arena
     Ptr<CompoundStmt> body_; // TODO could be made optional to mean incomplete type definition
+    uint64_t hash_{ 0 };
+
+    uint64_t structural_hash() const;
 };
 
 class ReturnStmt : public Stmt
 {
 public:
-    ReturnStmt(Loc loc, Ptr<Expr>&& value) : Stmt(loc), expr_{ std::move(value) } {}
+    ReturnStmt(Loc loc, Ptr<Expr> value) : Stmt(NodeKind::ReturnStmt, loc), expr_{ value } {}
 
     void check(Sema&) override;
     std::ostream& stream(std::ostream& os) const override;
 
-    Expr const* expr() const { return expr_.get(); }
+    Expr const* expr() const { return expr_; }
 
 private:
     Ptr<Expr> expr_;
@@ -309,7 +440,7 @@ private:
 class NullStmt : public Stmt
 {
 public:
-    explicit NullStmt(Loc loc) : Stmt(loc) {}
+    explicit NullStmt(Loc loc) : Stmt(NodeKind::NullStmt, loc) {}
 
     void check(Sema&) override {};
     std::ostream& stream(std::ostream& os) const override { return os << ";\n"; }
@@ -318,12 +449,10 @@ public:
 class TranslationUnit : public Node
 {
 public:
-    TranslationUnit(std::string_view filename, Ptr<Items>&& items) : Node(Loc{ filename }), items_{ std::move(items) }
-    {
-    }
+    TranslationUnit(Loc loc, Ptr<Items> items) : Node(NodeKind::TranslationUnit, loc), items_{ items } {}
 
     std::ostream& stream(std::ostream&) const override;
-    Ptr<Items> const& items() const { return items_; }
+    Ptr<Items> items() const { return items_; }
     void check(Sema&);
 
 private:
@@ -1,37 +1,119 @@
 #pragma once
 #include "ast.hpp"
+#include "dfs.hpp"
 #include "graph.hpp"
+#include "lexer/reflection.hpp"
+#include <cctype>
 #include <format>
-#include <unordered_map>
+#include <limits>
+#include <string>
+#include <vector>
 
 namespace compiler::ast
 {
 
+// Bounds of an AST dump, nodes past either are left out
+struct GraphLimits
+{
+    size_t depth{ std::numeric_limits<size_t>::max() }; // Below the root
+    size_t nodes{ std::numeric_limits<size_t>::max() };
+};
+
+// Streams the subtree at a node as a graph::StreamAdapter. The walk keeps only the path to the current node, so the
+// size of the tree does not matter, only its depth. A node whose children are cut by the depth limit gets a "..."
+// child, and the nodes left out by the node limit are counted in a last vertex.
 class GraphAdapter
 {
 public:
-    explicit GraphAdapter(ast::TranslationUnit const& tu) : data_{ tu } {}
+    explicit GraphAdapter(Node const& root, GraphLimits limits = {}) : root_{ root }, limits_{ limits } {}
 
     std::string name() const
     {
-        return std::format("AST_{}", data_.loc().filename());
+        // DOT identifiers are alphanumeric
+        auto name = std::format("AST_{}", root_.loc().filename());
+        for (auto& c : name)
+        {
+            if (!std::isalnum(static_cast<unsigned char>(c))) c = '_';
+        }
+        return name;
     }
 
-    // std::vector<graph::Edge> edges() const
-    // {
-    //     std::vector<graph::Edge> edges;
-    //
-    //     edges.emplace_back();
-    // }
-    //
-    // std::vector<graph::Vertex> vertices() const
-    // {
-    //       
-    // }
+    template <typename Vertex, typename Edge> void stream(Vertex&& vertex, Edge&& edge) const
+    {
+        std::vector<size_t> path; // Vertices of the ancestors of the current node
+        std::vector<Node const*> children;
+        std::string text;
+        size_t next{ 0 };
+        size_t skipped{ 0 };
+        dfs(root_,
+            [&](Node const& node, size_t depth)
+            {
+                if (next >= limits_.nodes)
+                {
+                    ++skipped;
+                    return true;
+                }
+                path.resize(depth);
+                auto const idx = next++;
+                text.clear();
+                label(node, text);
+                vertex(idx, text);
+                if (!path.empty()) edge(path.back(), idx);
+                path.emplace_back(idx);
+                if (depth < limits_.depth) return true;
+
+                children.clear();
+                detail::children(node, children);
+                if (!children.empty())
+                {
+                    vertex(next, "...");
+                    edge(idx, next++);
+                }
+                return false;
+            });
+        if (skipped != 0)
+        {
+            vertex(next, std::format("{} more nodes", skipped));
+        }
+    }
+
+    // What a node shows of itself, escaped for record shaped DOT nodes
+    static void label(Node const& node, std::string& out)
+    {
+        auto const escaped = [&](std::string_view text)
+        {
+            for (auto const c : text)
+            {
+                if (std::string_view{ "{}|<>\"\\" }.find(c) != std::string_view::npos) out += '\\';
+                out += c;
+            }
+        };
+        switch (node.kind())
+        {
+        case NodeKind::BinExpr: escaped(tokens::to_string(static_cast<BinExpr const&>(node).op())); break;
+        case NodeKind::IntLiteral: out += std::to_string(static_cast<IntLiteral const&>(node).value()); break;
+        case NodeKind::Iden: escaped(static_cast<Iden const&>(node).name()); break;
+        case NodeKind::UnaryExpr: escaped(tokens::to_string(static_cast<UnaryExpr const&>(node).op())); break;
+        case NodeKind::ExprStmt: out += "ExprStmt"; break;
+        case NodeKind::IfStmt: out += "IfStmt"; break;
+        case NodeKind::CompoundStmt: out += "CompoundStmt"; break;
+        case NodeKind::ReturnStmt: out += "ReturnStmt"; break;
+        case NodeKind::NullStmt: out += "NullStmt"; break;
+        case NodeKind::ObjDecl: out += "ObjDecl"; break;
+        case NodeKind::FunctionDecl:
+            out += "FunctionDecl ";
+            escaped(static_cast<FunctionDecl const&>(node).iden().name());
+            break;
+        case NodeKind::TypeDecl: escaped(static_cast<TypeDecl const&>(node).type()->format()); break;
+        case NodeKind::Item: out += "Item"; break;
+        case NodeKind::Items: out += "Items"; break;
+        case NodeKind::TranslationUnit: out += "TranslationUnit"; break;
+        }
+    }
 
 private:
-    ast::TranslationUnit const& data_;
-    std::unordered_map<Node*, size_t> node_to_idx;
+    Node const& root_;
+    GraphLimits limits_;
 };
 
 } // namespace compiler::ast
@@ -0,0 +1,473 @@
+#include "cache.hpp"
+#include "sema.hpp"
+#include "util/hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace compiler::ast
+{
+namespace
+{
+
+// Images of another build may disagree on the numbering of kinds, operators and forms
+constexpr std::string_view build = "ast-cache-3 " __DATE__ " " __TIME__;
+constexpr uint64_t magic = 0x31'54'53'41'43'43'00'00; // "\0\0CCAST1"
+
+enum class Origin : uint8_t
+{
+    Main,   // The cached source itself
+    Path,   // An included file, loaded again by path
+    Buffer, // Text made while preprocessing, stored in the image
+};
+
+struct Header
+{
+    uint64_t magic;
+    uint64_t build;
+    uint64_t content_hash;
+    uint64_t content_size;
+    uint64_t path_hash;
+};
+
+// Type and storage class of a declaration
+struct PackedType
+{
+    BasicType basic;
+    bool is_signed;
+    uint8_t quals;
+    Storage storage;
+};
+
+// Sections are 8 byte aligned, so every column can be copied out of the mapping as is
+class Writer
+{
+public:
+    template <typename T> void value(T const& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out_.append(reinterpret_cast<char const*>(&value), sizeof(T));
+        pad();
+    }
+
+    template <typename T> void array(std::span<T const> values)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        value(static_cast<uint64_t>(values.size()));
+        out_.append(reinterpret_cast<char const*>(values.data()), values.size_bytes());
+        pad();
+    }
+
+    void string(std::string_view text) { array(std::span<char const>{ text.data(), text.size() }); }
+
+    std::string const& bytes() const { return out_; }
+
+private:
+    void pad() { out_.resize((out_.size() + 7) & ~size_t{ 7 }); }
+
+    std::string out_;
+};
+
+// Reads what a Writer wrote, every read fails softly once the image turns out to be truncated
+class Reader
+{
+public:
+    explicit Reader(std::string_view bytes) : bytes_{ bytes } {}
+
+    template <typename T> bool value(T& value)
+    {
+        if (!take(sizeof(T))) return false;
+        std::memcpy(&value, bytes_.data() + pos_ - sizeof(T), sizeof(T));
+        skip_padding();
+        return true;
+    }
+
+    // `fill` is only there for types without a default constructor, every element is overwritten
+    template <typename T> bool array(std::vector<T>& values, T const& fill = T{})
+    {
+        uint64_t count{ 0 };
+        if (!value(count) || count > bytes_.size() / sizeof(T) || !take(count * sizeof(T))) return false;
+        values.resize(count, fill);
+        std::memcpy(values.data(), bytes_.data() + pos_ - count * sizeof(T), count * sizeof(T));
+        skip_padding();
+        return true;
+    }
+
+    bool string(std::string_view& text)
+    {
+        uint64_t length{ 0 };
+        if (!value(length) || !take(length)) return false;
+        text = bytes_.substr(pos_ - length, length);
+        skip_padding();
+        return true;
+    }
+
+private:
+    bool take(size_t size)
+    {
+        if (size > bytes_.size() - pos_) return false;
+        pos_ += size;
+        return true;
+    }
+
+    void skip_padding() { pos_ = std::min(bytes_.size(), (pos_ + 7) & ~size_t{ 7 }); }
+
+    std::string_view bytes_;
+    size_t pos_{ 0 };
+};
+
+// Read-only mapping of a whole image, empty if there is none
+class Mapping
+{
+public:
+    explicit Mapping(std::filesystem::path const& path)
+    {
+        auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st{};
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            auto const size = static_cast<size_t>(st.st_size);
+            void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                data_ = mapped;
+                size_ = size;
+            }
+        }
+        ::close(fd);
+    }
+    ~Mapping()
+    {
+        if (data_ != nullptr) ::munmap(data_, size_);
+    }
+
+    Mapping(Mapping const&) = delete;
+    Mapping& operator=(Mapping const&) = delete;
+
+    std::string_view bytes() const { return { static_cast<char const*>(data_), size_ }; }
+
+private:
+    void* data_{ nullptr };
+    size_t size_{ 0 };
+};
+
+} // namespace
+
+AstCache::AstCache(std::filesystem::path dir, std::filesystem::path const& source,
+                   std::span<std::filesystem::path const> include_dirs) :
+    dir_{ std::move(dir) },
+    seed_{ Hasher::of(build) }
+{
+    std::error_code ec;
+    auto const canonical = std::filesystem::weakly_canonical(source, ec);
+    path_hash_ = Hasher::of((ec ? source : canonical).string());
+    seed_ = Hasher::combine(seed_, path_hash_);
+    // The same source may include other files under other include directories
+    for (auto const& include : include_dirs)
+    {
+        seed_ = Hasher::combine(seed_, Hasher::of(include.string()));
+    }
+}
+
+std::filesystem::path AstCache::image(File const& main) const
+{
+    return dir_ / std::format("{:016x}.ast", Hasher::combine(seed_, Hasher::of(main.content)));
+}
+
+std::optional<FlatAst> AstCache::load(File const& main, Sema& sema) const
+{
+    Mapping const mapping{ image(main) };
+    Reader in{ mapping.bytes() };
+
+    Header header{};
+    if (!in.value(header) || header.magic != magic || header.build != Hasher::of(build)
+        || header.content_hash != Hasher::of(main.content) || header.content_size != main.content.size()
+        || header.path_hash != path_hash_)
+    {
+        return std::nullopt;
+    }
+
+    // Included files, all unchanged or the image is stale
+    uint64_t count{ 0 };
+    if (!in.value(count)) return std::nullopt;
+    std::unordered_map<std::string_view, FileId> included;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t hash{ 0 };
+        std::string_view path;
+        std::error_code ec;
+        if (!in.value(hash) || !in.string(path) || !std::filesystem::is_regular_file(path, ec)) return std::nullopt;
+        auto const& file = SourceManager::global().load(path);
+        if (Hasher::of(file.content) != hash) return std::nullopt;
+        included.emplace(path, file.id);
+    }
+
+    // Paths the includes passed over, a file at any of them would be found instead
+    if (!in.value(count)) return std::nullopt;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        std::string_view path;
+        std::error_code ec;
+        if (!in.string(path) || std::filesystem::is_regular_file(path, ec)) return std::nullopt;
+    }
+
+    std::vector<FileId> files;
+    if (!in.value(count)) return std::nullopt;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        Origin origin{};
+        std::string_view name;
+        if (!in.value(origin) || !in.string(name)) return std::nullopt;
+        switch (origin)
+        {
+        case Origin::Main: files.emplace_back(main.id); break;
+        case Origin::Path:
+        {
+            auto const it = included.find(name);
+            if (it == included.end()) return std::nullopt;
+            files.emplace_back(it->second);
+            break;
+        }
+        case Origin::Buffer:
+        {
+            std::string_view text;
+            if (!in.string(text)) return std::nullopt;
+            files.emplace_back(SourceManager::global().add_buffer(std::string{ name }, text).id);
+            break;
+        }
+        default: return std::nullopt;
+        }
+    }
+
+    std::vector<Symbol> symbols;
+    if (!in.value(count)) return std::nullopt;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        std::string_view spelling;
+        if (!in.string(spelling)) return std::nullopt;
+        symbols.emplace_back(Interner::global().intern(spelling));
+    }
+
+    FlatAst ast;
+    std::vector<PackedType> types;
+    if (!in.array(ast.kinds_) || !in.array(ast.locs_, Loc{ 0, 0 }) || !in.array(ast.a_) || !in.array(ast.b_)
+        || !in.array(ast.c_) || !in.array(ast.lists_) || !in.array(ast.literals_) || !in.array(types)
+        || !in.value(ast.items_first_) || !in.value(ast.items_count_))
+    {
+        return std::nullopt;
+    }
+    auto const rows = ast.kinds_.size();
+    if (ast.locs_.size() != rows || ast.a_.size() != rows || ast.b_.size() != rows || ast.c_.size() != rows)
+    {
+        return std::nullopt;
+    }
+
+    // Every reference has to stay inside the image: rows are in post-order so children come before their parent,
+    // and each column holds what the kind of its row says it does. Expressions are scanned as contiguous ranges of
+    // rows, so their operands must also be laid out as flatten() lays them out.
+    using Kind = FlatAst::Kind;
+    auto const is = [&](uint32_t child, size_t row, Kind first, Kind last)
+    { return child < row && ast.kinds_[child] >= first && ast.kinds_[child] <= last; };
+    auto const expr = [&](uint32_t child, size_t row) { return is(child, row, Kind::IntLiteral, Kind::UnaryExpr); };
+    auto const stmt = [&](uint32_t child, size_t row) { return is(child, row, Kind::ExprStmt, Kind::CompoundStmt); };
+    auto const iden = [&](uint32_t child, size_t row) { return is(child, row, Kind::Iden, Kind::Iden); };
+    auto const none = static_cast<uint32_t>(NodeId::None);
+    auto const punctuator = [](uint32_t op)
+    { return op >= to_underlying(tokens::Punctuator::LBracket) && op <= to_underlying(tokens::Punctuator::HashHash); };
+    auto const list = [&](uint64_t begin, uint64_t size) { return begin + size <= ast.lists_.size(); };
+    std::vector<uint32_t> firsts(rows); // First row of the subtree of each expression
+    for (size_t i = 0; i < rows; ++i)
+    {
+        firsts[i] = static_cast<uint32_t>(i);
+        auto const a = ast.a_[i];
+        auto const b = ast.b_[i];
+        auto const c = ast.c_[i];
+        auto const valid = [&]
+        {
+            switch (ast.kinds_[i])
+            {
+            case Kind::IntLiteral: return a < ast.literals_.size() && c < 32;
+            case Kind::Iden: return a < symbols.size() && b == none;
+            case Kind::BinExpr:
+                if (!expr(a, i) || !expr(b, i) || !punctuator(c) || b + 1 != i || a + 1 != firsts[b]) return false;
+                firsts[i] = firsts[a];
+                return true;
+            case Kind::UnaryExpr:
+                if (!expr(a, i) || !punctuator(c) || a + 1 != i) return false;
+                firsts[i] = firsts[a];
+                return true;
+            case Kind::ExprStmt: return expr(a, i);
+            case Kind::IfStmt: return expr(a, i) && stmt(b, i) && (c == none || stmt(c, i));
+            case Kind::ReturnStmt: return a == none || expr(a, i);
+            case Kind::NullStmt: return true;
+            case Kind::CompoundStmt: return list(a, b);
+            case Kind::ObjDecl: return iden(a, i) && (b == none || expr(b, i)) && c < types.size();
+            case Kind::FunctionDecl:
+                return iden(a, i) && is(b, i, Kind::CompoundStmt, Kind::CompoundStmt) && c < types.size();
+            }
+            return false;
+        }();
+        if (!valid) return std::nullopt;
+    }
+    for (auto const item : ast.lists_)
+    {
+        auto const index = static_cast<uint32_t>(item);
+        if (index >= rows || ast.kinds_[index] < Kind::ExprStmt) return std::nullopt;
+    }
+    if (!list(ast.items_first_, ast.items_count_)) return std::nullopt;
+
+    // Back to the ids of this process
+    for (auto& loc : ast.locs_)
+    {
+        if (loc.file() >= files.size()) return std::nullopt;
+        loc = Loc{ files[loc.file()], loc.offset() };
+    }
+    for (size_t i = 0; i < rows; ++i)
+    {
+        if (ast.kinds_[i] != FlatAst::Kind::Iden) continue;
+        ast.a_[i] = static_cast<uint32_t>(symbols[ast.a_[i]]);
+    }
+    // Few distinct types, each is only looked up in the Sema once
+    std::unordered_map<uint32_t, Type const*> interned;
+    ast.types_.reserve(types.size());
+    for (auto const& packed : types)
+    {
+        if (packed.basic > BasicType::Void || packed.storage > Storage::Register) return std::nullopt;
+        auto const key = static_cast<uint32_t>(packed.basic) | packed.is_signed << 8 | packed.quals << 16;
+        auto [it, inserted] = interned.try_emplace(key, nullptr);
+        if (inserted)
+        {
+            it->second = sema.new_type(Type{ packed.basic, packed.is_signed, Type::Qualifiers{ packed.quals } });
+        }
+        ast.types_.emplace_back(FlatAst::DeclType{ it->second, packed.storage });
+    }
+    return ast;
+}
+
+void AstCache::store(File const& main, FlatAst const& ast, std::span<Preprocessor::Dependency const> dependencies,
+                     std::span<std::filesystem::path const> absent) const
+{
+    Writer out;
+    out.value(Header{ magic, Hasher::of(build), Hasher::of(main.content), main.content.size(), path_hash_ });
+
+    out.value(static_cast<uint64_t>(dependencies.size()));
+    for (auto const& dependency : dependencies)
+    {
+        out.value(Hasher::of(SourceManager::global().file(dependency.file).content));
+        out.string(dependency.path.string());
+    }
+    out.value(static_cast<uint64_t>(absent.size()));
+    for (auto const& path : absent)
+    {
+        out.string(path.string());
+    }
+
+    // Only the files locations point into, numbered in order of appearance
+    std::unordered_map<FileId, uint32_t> file_index;
+    std::vector<FileId> files;
+    auto locs = ast.locs_;
+    for (auto& loc : locs)
+    {
+        auto [it, inserted] = file_index.try_emplace(loc.file(), static_cast<uint32_t>(files.size()));
+        if (inserted) files.emplace_back(loc.file());
+        loc = Loc{ it->second, loc.offset() };
+    }
+    out.value(static_cast<uint64_t>(files.size()));
+    for (auto const id : files)
+    {
+        auto const dependency = std::find_if(dependencies.begin(), dependencies.end(),
+                                             [&](auto const& dep) { return dep.file == id; });
+        auto const& file = SourceManager::global().file(id);
+        if (id == main.id)
+        {
+            out.value(Origin::Main);
+            out.string(file.name);
+        }
+        else if (dependency != dependencies.end())
+        {
+            out.value(Origin::Path);
+            out.string(dependency->path.string());
+        }
+        else
+        {
+            out.value(Origin::Buffer);
+            out.string(file.name);
+            out.string(file.content);
+        }
+    }
+
+    std::unordered_map<Symbol, uint32_t> symbol_index;
+    std::vector<Symbol> symbols;
+    auto a = ast.a_;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (ast.kinds_[i] != FlatAst::Kind::Iden) continue;
+        auto const symbol = static_cast<Symbol>(a[i]);
+        auto [it, inserted] = symbol_index.try_emplace(symbol, static_cast<uint32_t>(symbols.size()));
+        if (inserted) symbols.emplace_back(symbol);
+        a[i] = it->second;
+    }
+    out.value(static_cast<uint64_t>(symbols.size()));
+    for (auto const symbol : symbols)
+    {
+        out.string(Interner::global().text(symbol));
+    }
+
+    std::vector<PackedType> types;
+    types.reserve(ast.types_.size());
+    for (auto const& [type, storage] : ast.types_)
+    {
+        auto const quals = static_cast<uint8_t>(type->qualifiers().to_ulong());
+        types.emplace_back(PackedType{ type->basic_type(), type->is_signed(), quals, storage });
+    }
+
+    out.array(std::span<FlatAst::Kind const>{ ast.kinds_ });
+    out.array(std::span<Loc const>{ locs });
+    out.array(std::span<uint32_t const>{ a });
+    // Identifiers are resolved again after loading
+    std::vector<uint32_t> b = ast.b_;
+    for (size_t i = 0; i < b.size(); ++i)
+    {
+        if (ast.kinds_[i] == FlatAst::Kind::Iden) b[i] = static_cast<uint32_t>(NodeId::None);
+    }
+    out.array(std::span<uint32_t const>{ b });
+    out.array(std::span<uint32_t const>{ ast.c_ });
+    out.array(std::span<NodeId const>{ ast.lists_ });
+    out.array(std::span<int64_t const>{ ast.literals_ });
+    out.array(std::span<PackedType const>{ types });
+    out.value(ast.items_first_);
+    out.value(ast.items_count_);
+
+    // Written aside and renamed, so concurrent compilations never see half an image
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    auto const target = image(main);
+    auto temporary = target;
+    temporary += std::format(".{}.tmp", ::getpid());
+    {
+        std::ofstream file{ temporary, std::ios::binary | std::ios::trunc };
+        file.write(out.bytes().data(), static_cast<std::streamsize>(out.bytes().size()));
+        if (!file)
+        {
+            main.loc(0).wrn() << "Cannot write the AST cache " << temporary.string() << '\n';
+            std::filesystem::remove(temporary, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, target, ec);
+    if (ec)
+    {
+        main.loc(0).wrn() << "Cannot write the AST cache " << target.string() << ": " << ec.message() << '\n';
+        std::filesystem::remove(temporary, ec);
+    }
+}
+
+} // namespace compiler::ast
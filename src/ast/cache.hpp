@@ -0,0 +1,40 @@
+#pragma once
+#include "flat.hpp"
+#include "lexer/preprocessor.hpp"
+#include "sema.fwd.hpp"
+#include <filesystem>
+#include <optional>
+#include <span>
+
+namespace compiler::ast
+{
+
+// Directory of FlatAst images, one per source, named by a hash of the source bytes, of its canonical path, of the
+// include directories and of the compiler build. The path is part of it since quoted includes are looked up next to
+// the source. An image records the hash of every file the source included and the paths its includes found nothing
+// at on the way. It is only used while the hashes all still match and none of those paths has appeared, so editing a
+// header or adding one that an include now finds first invalidates it as well. Symbols, types and file ids only mean something within one
+// process: an image stores them as spellings, as values and as paths or buffer contents, everything else is the
+// columns as they are. Loading maps the image and copies the columns out in bulk.
+class AstCache
+{
+public:
+    // `source` is the path the main file is read from
+    AstCache(std::filesystem::path dir, std::filesystem::path const& source,
+             std::span<std::filesystem::path const> include_dirs);
+
+    // The AST of `main` if there is a valid image of it, its types are made in `sema`
+    std::optional<FlatAst> load(File const& main, Sema& sema) const;
+    // Failing to write an image is only warned about
+    void store(File const& main, FlatAst const& ast, std::span<Preprocessor::Dependency const> dependencies,
+               std::span<std::filesystem::path const> absent) const;
+
+private:
+    std::filesystem::path image(File const& main) const;
+
+    std::filesystem::path dir_;
+    uint64_t seed_;
+    uint64_t path_hash_; // Of the canonical path of the source
+};
+
+} // namespace compiler::ast
@@ -0,0 +1,41 @@
+#include "context.hpp"
+
+namespace compiler::ast
+{
+
+AstContext::Stats AstContext::stats() const
+{
+    auto total = stats_;
+    for (auto const& fork : forks_)
+    {
+        auto const stats = fork->stats();
+        total.nodes += stats.nodes;
+        total.lists += stats.lists;
+        total.bytes += stats.bytes;
+        total.blocks += stats.blocks;
+    }
+    return total;
+}
+
+void* AstContext::grow(size_t size, size_t align)
+{
+    // Oversized requests get a block of their own, the current block keeps being filled
+    if (size + align > block_size / 4)
+    {
+        auto& block = blocks_.emplace_back(std::make_unique_for_overwrite<std::byte[]>(size + align));
+        ++stats_.blocks;
+        void* result = block.get();
+        auto space = size + align;
+        std::align(align, size, result, space);
+        stats_.bytes += size;
+        return result;
+    }
+
+    blocks_.emplace_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+    ++stats_.blocks;
+    cursor_ = blocks_.back().get();
+    end_ = cursor_ + block_size;
+    return allocate(size, align);
+}
+
+} // namespace compiler::ast
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace compiler::ast
+{
+
+// Owns every node of a translation unit. Nodes are bump allocated in parse order from large blocks and are released
+// all at once with the context, no destructor is ever run: nodes must be trivially destructible, their lists of
+// children are copied into the arena as well.
+class AstContext
+{
+public:
+    struct Stats
+    {
+        size_t nodes{ 0 };
+        size_t lists{ 0 };
+        size_t bytes{ 0 };  // Handed out, including alignment padding
+        size_t blocks{ 0 }; // Heap allocations backing all of the above
+    };
+
+    AstContext() = default;
+    AstContext(AstContext const&) = delete;
+    AstContext& operator=(AstContext const&) = delete;
+
+    template <typename T, typename... Args> T* make(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena nodes are never destroyed");
+        ++stats_.nodes;
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Arena copy of `elements`, which is typically a parser scratch buffer
+    template <typename T> std::span<T const> list(std::span<T const> elements)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (elements.empty()) return {};
+        ++stats_.lists;
+        auto* copy = static_cast<T*>(allocate(elements.size_bytes(), alignof(T)));
+        std::uninitialized_copy(elements.begin(), elements.end(), copy);
+        return { copy, elements.size() };
+    }
+
+    // Including the forks
+    Stats stats() const;
+
+    // A context owned by this one, for filling from another thread. It lives as long as this context does.
+    AstContext& fork() { return *forks_.emplace_back(std::make_unique<AstContext>()); }
+
+private:
+    void* allocate(size_t size, size_t align)
+    {
+        auto const padding = (align - reinterpret_cast<uintptr_t>(cursor_) % align) % align;
+        if (size + padding > static_cast<size_t>(end_ - cursor_)) return grow(size, align);
+        auto* result = cursor_ + padding;
+        cursor_ = result + size;
+        stats_.bytes += size + padding;
+        return result;
+    }
+
+    void* grow(size_t size, size_t align);
+
+    static constexpr size_t block_size = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* cursor_{ nullptr };
+    std::byte* end_{ nullptr };
+    Stats stats_;
+    std::vector<std::unique_ptr<AstContext>> forks_;
+};
+
+} // namespace compiler::ast
@@ -1,13 +1,151 @@
 #pragma once
 #include "ast.hpp"
+#include <concepts>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace compiler::ast
 {
 
-template <typename T>
-auto dfs(TranslationUnit const& tu, T&& action)
+// Callback doing nothing, for the side of dfs that is not needed
+inline constexpr auto nop = [](auto&&...) {};
+
+namespace detail
+{
+
+// Appends the children of `node` in source order, absent optional children are skipped
+inline void children(Node const& node, std::vector<Node const*>& out)
+{
+    auto const add = [&](Node const* child) {
+        if (child != nullptr) out.emplace_back(child);
+    };
+    switch (node.kind())
+    {
+    case NodeKind::BinExpr:
+    {
+        auto const& bin = static_cast<BinExpr const&>(node);
+        add(&bin.lhs());
+        add(&bin.rhs());
+        break;
+    }
+    case NodeKind::UnaryExpr: add(&static_cast<UnaryExpr const&>(node).expr()); break;
+    case NodeKind::IntLiteral:
+    case NodeKind::Iden:
+    case NodeKind::NullStmt:
+    case NodeKind::TypeDecl: break;
+    case NodeKind::ExprStmt: add(&static_cast<ExprStmt const&>(node).expr()); break;
+    case NodeKind::IfStmt:
+    {
+        auto const& if_stmt = static_cast<IfStmt const&>(node);
+        add(&if_stmt.cond());
+        add(&if_stmt.cons());
+        add(if_stmt.alt());
+        break;
+    }
+    case NodeKind::CompoundStmt: add(&static_cast<CompoundStmt const&>(node).items()); break;
+    case NodeKind::ReturnStmt: add(static_cast<ReturnStmt const&>(node).expr()); break;
+    case NodeKind::ObjDecl:
+    {
+        auto const& obj = static_cast<ObjDecl const&>(node);
+        add(&obj.type());
+        add(&obj.iden());
+        add(obj.initalizer());
+        break;
+    }
+    case NodeKind::FunctionDecl:
+    {
+        auto const& func = static_cast<FunctionDecl const&>(node);
+        add(&func.type());
+        add(&func.iden());
+        for (auto const* arg : func.args())
+        {
+            add(arg);
+        }
+        add(&func.body());
+        break;
+    }
+    case NodeKind::Item:
+    {
+        auto const& item = static_cast<Item const&>(node);
+        if (auto const* decl = item.decl()) add(decl);
+        else add(item.stmt());
+        break;
+    }
+    case NodeKind::Items:
+        for (auto const* item : static_cast<Items const&>(node).items())
+        {
+            add(item);
+        }
+        break;
+    case NodeKind::TranslationUnit: add(static_cast<TranslationUnit const&>(node).items()); break;
+    }
+}
+
+// Calls `callback` with the node and, if it takes one, the depth of the node below the root
+template <typename Callback, typename N> decltype(auto) call(Callback& callback, N& node, size_t depth)
+{
+    if constexpr (std::invocable<Callback&, N&, size_t>) return callback(node, depth);
+    else return callback(node);
+}
+
+} // namespace detail
+
+// Depth first walk of the subtree at `root` that keeps its path on the heap instead of the call stack, so the depth
+// of the tree is only bounded by memory. `pre` is called before the children of a node are visited and `post` after
+// them, both with the node and optionally its depth. If `pre` returns a bool, false skips the children of that node;
+// its `post` is still called. Walking a non-const node hands out non-const nodes.
+template <typename N, typename Pre, typename Post>
+    requires std::derived_from<std::remove_const_t<N>, Node>
+void dfs(N& root, Pre&& pre, Post&& post)
 {
-        
+    using Visited = std::conditional_t<std::is_const_v<N>, Node const, Node>;
+    struct Frame
+    {
+        Node const* node;
+        size_t depth;
+        bool entered;
+    };
+    std::vector<Frame> stack{ { &root, 0, false } };
+    std::vector<Node const*> children;
+    while (!stack.empty())
+    {
+        auto& frame = stack.back();
+        // Nodes are only const through the accessors used to find them, the tree itself is as mutable as `root`
+        auto& node = const_cast<Visited&>(*frame.node);
+        auto const depth = frame.depth;
+        if (frame.entered)
+        {
+            stack.pop_back();
+            detail::call(post, node, depth);
+            continue;
+        }
+        frame.entered = true;
+
+        if constexpr (std::same_as<decltype(detail::call(pre, node, depth)), bool>)
+        {
+            if (!detail::call(pre, node, depth)) continue;
+        }
+        else
+        {
+            detail::call(pre, node, depth);
+        }
+
+        // Pushed in reverse so the first child is on top
+        children.clear();
+        detail::children(node, children);
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+        {
+            stack.emplace_back(Frame{ *it, depth + 1, false });
+        }
+    }
 }
 
+template <typename N, typename Pre>
+    requires std::derived_from<std::remove_const_t<N>, Node>
+void dfs(N& root, Pre&& pre)
+{
+    dfs(root, std::forward<Pre>(pre), nop);
 }
+
+} // namespace compiler::ast
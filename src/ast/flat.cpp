@@ -0,0 +1,356 @@
+#include "flat.hpp"
+#include "dfs.hpp"
+#include "sema.hpp"
+#include "visit.hpp"
+#include "util/ice.hpp"
+#include <utility>
+
+namespace compiler::ast
+{
+
+using Kind = FlatAst::Kind;
+
+NodeId FlatAst::add(Kind kind, Loc loc, uint32_t a, uint32_t b, uint32_t c)
+{
+    auto const id = static_cast<NodeId>(kinds_.size());
+    kinds_.emplace_back(kind);
+    locs_.emplace_back(loc);
+    a_.emplace_back(a);
+    b_.emplace_back(b);
+    c_.emplace_back(c);
+    return id;
+}
+
+NodeId FlatAst::first(NodeId id) const
+{
+    while (true)
+    {
+        switch (kind(id))
+        {
+        case Kind::BinExpr: id = lhs(id); break;
+        case Kind::UnaryExpr: id = operand(id); break;
+        default: return id;
+        }
+    }
+}
+
+size_t FlatAst::bytes() const
+{
+    return kinds_.capacity() * sizeof(Kind) + locs_.capacity() * sizeof(Loc)
+           + (a_.capacity() + b_.capacity() + c_.capacity()) * sizeof(uint32_t) + lists_.capacity() * sizeof(NodeId)
+           + literals_.capacity() * sizeof(int64_t) + types_.capacity() * sizeof(DeclType);
+}
+
+// Appends the rows of a pointer AST, children first
+class FlatBuilder
+{
+public:
+    explicit FlatBuilder(FlatAst& ast) : ast_{ ast } {}
+
+    std::pair<uint32_t, uint32_t> items(Items const& items)
+    {
+        // Nested lists are stacked on top of the enclosing ones until they are complete
+        auto const base = stack_.size();
+        for (auto const* item : items.items())
+        {
+            stack_.emplace_back(item->decl() != nullptr ? decl(*item->decl()) : stmt(*item->stmt()));
+        }
+        auto const first = static_cast<uint32_t>(ast_.lists_.size());
+        ast_.lists_.insert(ast_.lists_.end(), stack_.begin() + static_cast<ptrdiff_t>(base), stack_.end());
+        stack_.resize(base);
+        return { first, static_cast<uint32_t>(ast_.lists_.size() - first) };
+    }
+
+private:
+    static uint32_t id(NodeId node) { return static_cast<uint32_t>(node); }
+
+    NodeId decl(Declaration const& declaration)
+    {
+        return visit(declaration, Overload{
+            [&](ObjDecl const& obj) {
+                auto const iden = expr(obj.iden());
+                auto const init = obj.initalizer() != nullptr ? expr(*obj.initalizer()) : NodeId::None;
+                return ast_.add(Kind::ObjDecl, obj.loc(), id(iden), id(init), type(obj.type()));
+            },
+            [&](FunctionDecl const& func) {
+                auto const iden = expr(func.iden());
+                auto const body = stmt(func.body());
+                return ast_.add(Kind::FunctionDecl, func.loc(), id(iden), id(body), type(func.type()));
+            },
+        });
+    }
+
+    uint32_t type(TypeDecl const& decl)
+    {
+        ast_.types_.emplace_back(FlatAst::DeclType{ decl.type(), decl.storage() });
+        return static_cast<uint32_t>(ast_.types_.size() - 1);
+    }
+
+    NodeId stmt(Stmt const& statement)
+    {
+        auto const loc = statement.loc();
+        return visit(statement, Overload{
+            [&](ExprStmt const& expr_stmt) { return ast_.add(Kind::ExprStmt, loc, id(expr(expr_stmt.expr()))); },
+            [&](CompoundStmt const& compound) {
+                auto const [first, count] = items(compound.items());
+                return ast_.add(Kind::CompoundStmt, loc, first, count);
+            },
+            [&](IfStmt const& if_stmt) {
+                auto const cond = expr(if_stmt.cond());
+                auto const cons = stmt(if_stmt.cons());
+                auto const alt = if_stmt.alt() != nullptr ? stmt(*if_stmt.alt()) : NodeId::None;
+                return ast_.add(Kind::IfStmt, loc, id(cond), id(cons), id(alt));
+            },
+            [&](ReturnStmt const& ret) {
+                auto const value = ret.expr() != nullptr ? expr(*ret.expr()) : NodeId::None;
+                return ast_.add(Kind::ReturnStmt, loc, id(value));
+            },
+            [&](NullStmt const&) { return ast_.add(Kind::NullStmt, loc); },
+        });
+    }
+
+    NodeId expr(Expr const& expression)
+    {
+        // Without recursion: operands are appended first and wait on the stack for their operator
+        auto const pop = [&] {
+            auto const operand = stack_.back();
+            stack_.pop_back();
+            return id(operand);
+        };
+        dfs(expression, nop, [&](Node const& node) {
+            auto const loc = node.loc();
+            stack_.emplace_back(visit(static_cast<Expr const&>(node), Overload{
+                [&](IntLiteral const& literal) {
+                    ast_.literals_.emplace_back(literal.value());
+                    auto const index = static_cast<uint32_t>(ast_.literals_.size() - 1);
+                    return ast_.add(Kind::IntLiteral, loc, index, 0, literal.form().pack());
+                },
+                [&](Iden const& iden) {
+                    return ast_.add(Kind::Iden, loc, static_cast<uint32_t>(iden.symbol()), id(NodeId::None));
+                },
+                [&](BinExpr const& bin) {
+                    auto const rhs = pop();
+                    auto const lhs = pop();
+                    return ast_.add(Kind::BinExpr, loc, lhs, rhs, static_cast<uint32_t>(bin.op()));
+                },
+                [&](UnaryExpr const& unary) {
+                    return ast_.add(Kind::UnaryExpr, loc, pop(), 0, static_cast<uint32_t>(unary.op()));
+                },
+            }));
+        });
+        auto const root = stack_.back();
+        stack_.pop_back();
+        return root;
+    }
+
+    FlatAst& ast_;
+    std::vector<NodeId> stack_;
+};
+
+FlatAst FlatAst::flatten(TranslationUnit const& tu)
+{
+    FlatAst ast;
+    FlatBuilder builder{ ast };
+    std::tie(ast.items_first_, ast.items_count_) = builder.items(*tu.items());
+    return ast;
+}
+
+Ptr<TranslationUnit> FlatAst::tree(AstContext& context, Loc unit) const
+{
+    std::vector<Node*> nodes(size(), nullptr);
+    std::vector<Ptr<Item>> scratch;
+    auto const as_expr = [&](NodeId id) { return id != NodeId::None ? static_cast<Expr*>(nodes[index(id)]) : nullptr; };
+    auto const as_stmt = [&](NodeId id) { return id != NodeId::None ? static_cast<Stmt*>(nodes[index(id)]) : nullptr; };
+    auto const type_decl = [&](NodeId id) { return context.make<TypeDecl>(loc(id), type(id).type, type(id).storage); };
+    auto const item_list = [&](std::span<NodeId const> ids, Loc at)
+    {
+        scratch.clear();
+        for (auto const id : ids)
+        {
+            auto* node = nodes[index(id)];
+            scratch.emplace_back(Declaration::is(node->kind()) ? context.make<Item>(static_cast<Declaration*>(node))
+                                                              : context.make<Item>(static_cast<Stmt*>(node)));
+        }
+        return context.make<Items>(at, context.list<Ptr<Item>>(scratch));
+    };
+
+    for (uint32_t i = 0; i < size(); ++i)
+    {
+        auto const id = static_cast<NodeId>(i);
+        auto const at = locs_[i];
+        Node* node{ nullptr };
+        switch (kinds_[i])
+        {
+        case Kind::IntLiteral: node = context.make<IntLiteral>(at, value(id), form(id)); break;
+        case Kind::Iden: node = context.make<Iden>(at, symbol(id)); break;
+        case Kind::BinExpr: node = context.make<BinExpr>(at, as_expr(lhs(id)), op(id), as_expr(rhs(id))); break;
+        case Kind::UnaryExpr: node = context.make<UnaryExpr>(at, op(id), as_expr(operand(id))); break;
+        case Kind::ExprStmt: node = context.make<ExprStmt>(at, as_expr(expr(id))); break;
+        case Kind::IfStmt:
+            node = context.make<IfStmt>(at, as_expr(cond(id)), as_stmt(cons(id)), as_stmt(alt(id)));
+            break;
+        case Kind::ReturnStmt: node = context.make<ReturnStmt>(at, as_expr(expr(id))); break;
+        case Kind::NullStmt: node = context.make<NullStmt>(at); break;
+        case Kind::CompoundStmt: node = context.make<CompoundStmt>(at, item_list(items(id), at)); break;
+        case Kind::ObjDecl:
+        {
+            auto* name = static_cast<Iden*>(nodes[index(iden(id))]);
+            node = context.make<ObjDecl>(at, type_decl(id), name, as_expr(init(id)));
+            break;
+        }
+        case Kind::FunctionDecl:
+        {
+            auto* name = static_cast<Iden*>(nodes[index(iden(id))]);
+            auto* compound = static_cast<CompoundStmt*>(nodes[index(body(id))]);
+            node = context.make<FunctionDecl>(at, type_decl(id), name, std::span<Ptr<ObjDecl> const>{}, compound);
+            break;
+        }
+        }
+        nodes[i] = node;
+    }
+    return context.make<TranslationUnit>(unit, item_list(items(), unit));
+}
+
+// The checks of the pointer AST, sharing its typing rules, plus the scopes of function bodies
+class FlatChecker
+{
+public:
+    FlatChecker(FlatAst& ast, Sema& sema) : ast_{ ast }, sema_{ sema } {}
+
+    void item(NodeId id)
+    {
+        switch (ast_.kind(id))
+        {
+        case Kind::ObjDecl:
+            sema_.add(ast_, id);
+            if (auto const init = ast_.init(id); init != NodeId::None) expr(init);
+            break;
+        case Kind::FunctionDecl:
+        {
+            sema_.add(ast_, id);
+            auto const enclosing = std::exchange(function_, id);
+            stmt(ast_.body(id));
+            function_ = enclosing;
+            break;
+        }
+        default: stmt(id); break;
+        }
+    }
+
+private:
+    void stmt(NodeId id)
+    {
+        auto const loc = ast_.loc(id);
+        switch (ast_.kind(id))
+        {
+        case Kind::ExprStmt: expr(ast_.expr(id)); break;
+        case Kind::IfStmt:
+        {
+            auto const cond = expr(ast_.cond(id));
+            if (cond != nullptr && !cond->is_scalar())
+            {
+                loc.err() << "Value of the expression is not convertible to bool\n";
+            }
+            stmt(ast_.cons(id));
+            if (auto const alt = ast_.alt(id); alt != NodeId::None) stmt(alt);
+            break;
+        }
+        case Kind::ReturnStmt: ret(id); break;
+        case Kind::NullStmt: break;
+        case Kind::CompoundStmt:
+            sema_.push();
+            for (auto const child : ast_.items(id))
+            {
+                item(child);
+            }
+            sema_.pop();
+            break;
+        default: REPORT_ICE("Unhandled statement");
+        }
+    }
+
+    void ret(NodeId id)
+    {
+        auto const loc = ast_.loc(id);
+        if (function_ == NodeId::None)
+        {
+            loc.err() << "Return statement outside of a function\n";
+            return;
+        }
+        auto const& declared = *ast_.type(function_).type;
+        auto const value = ast_.expr(id);
+        if (declared.is_void())
+        {
+            if (value != NodeId::None)
+            {
+                expr(value);
+                loc.err() << "Function declared with \'void\' cannot return a value\n";
+            }
+            return;
+        }
+        if (value == NodeId::None)
+        {
+            loc.err() << "Function should return a value\n";
+            return;
+        }
+        if (auto const type = expr(value))
+        {
+            sema_.new_type(Type::implicit_conversion(loc, declared, *type));
+        }
+    }
+
+    Type const* expr(NodeId root)
+    {
+        [[maybe_unused]] auto const base = types_.size();
+        auto const pop = [&] {
+            auto const type = types_.back();
+            types_.pop_back();
+            return type;
+        };
+        for (auto i = FlatAst::index(ast_.first(root)); i <= FlatAst::index(root); ++i)
+        {
+            auto const id = static_cast<NodeId>(i);
+            auto const loc = ast_.loc(id);
+            switch (ast_.kind(id))
+            {
+            case Kind::IntLiteral:
+                types_.emplace_back(IntLiteral::type_of(sema_, loc, ast_.value(id), ast_.form(id)));
+                break;
+            case Kind::Iden:
+            {
+                auto const decl = sema_.lookup(ast_, id);
+                ast_.b_[i] = static_cast<uint32_t>(decl);
+                types_.emplace_back(decl != NodeId::None ? ast_.type(decl).type : nullptr);
+                break;
+            }
+            case Kind::BinExpr:
+            {
+                auto const rhs = pop();
+                auto const lhs = pop();
+                types_.emplace_back(BinExpr::type_of(sema_, loc, ast_.op(id), lhs, rhs));
+                break;
+            }
+            case Kind::UnaryExpr: types_.emplace_back(UnaryExpr::type_of(sema_, loc, ast_.op(id), pop())); break;
+            default: REPORT_ICE("Unhandled expression");
+            }
+        }
+        assert(types_.size() == base + 1);
+        return pop();
+    }
+
+    FlatAst& ast_;
+    Sema& sema_;
+    NodeId function_{ NodeId::None };
+    std::vector<Type const*> types_; // Operands of expr()
+};
+
+void FlatAst::check(Sema& sema)
+{
+    FlatChecker checker{ *this, sema };
+    for (auto const id : items())
+    {
+        checker.item(id);
+    }
+}
+
+} // namespace compiler::ast
@@ -0,0 +1,127 @@
+#pragma once
+#include "ast.hpp"
+#include <cassert>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace compiler::ast
+{
+
+// Index of a node in a FlatAst
+enum class NodeId : uint32_t
+{
+    None = std::numeric_limits<uint32_t>::max(),
+};
+
+// The AST as a table: one row per node spread over parallel columns, children referred to by 32 bit index and lists
+// of children stored as contiguous ranges of one shared array. Rows are in post-order, every child comes before its
+// parent. No column holds a pointer into the tree, so walks are index arithmetic over a few dense arrays and the
+// columns can be written out and read back as they are.
+class FlatAst
+{
+public:
+    // Meaning of the operand columns a, b and c per kind
+    enum class Kind : uint8_t
+    {
+        IntLiteral,   // a: literal index, c: IntForm
+        Iden,         // a: Symbol, b: ObjDecl it refers to once checked
+        BinExpr,      // a: lhs, b: rhs, c: Punctuator
+        UnaryExpr,    // a: operand, c: Punctuator
+        ExprStmt,     // a: expression
+        IfStmt,       // a: condition, b: then, c: else or None
+        ReturnStmt,   // a: value or None
+        NullStmt,     //
+        CompoundStmt, // a: first item, b: item count, in the list array
+        ObjDecl,      // a: Iden, b: initializer or None, c: declared type
+        FunctionDecl, // a: Iden, b: body, c: declared type
+    };
+
+    struct DeclType
+    {
+        Type const* type;
+        Storage storage;
+    };
+
+    static FlatAst flatten(TranslationUnit const& tu);
+    // The pointer AST back, made in `context`. Rows are in post-order so this is one pass without recursion. Lists
+    // of items take the location of their statement, `unit` is that of the translation unit.
+    Ptr<TranslationUnit> tree(AstContext& context, Loc unit) const;
+
+    // Resolves identifiers and checks types. Unlike TranslationUnit::check this descends into function bodies.
+    void check(Sema& sema);
+
+    size_t size() const { return kinds_.size(); }
+    // First row of the expression at `id`. The rows of an expression are contiguous and end with its root, so it
+    // can be evaluated by a scan of [first, id] with a stack of operands instead of by recursion.
+    NodeId first(NodeId id) const;
+    // Bytes held by the columns
+    size_t bytes() const;
+
+    Kind kind(NodeId id) const { return kinds_[index(id)]; }
+    Loc loc(NodeId id) const { return locs_[index(id)]; }
+    std::span<NodeId const> items() const { return list(items_first_, items_count_); }
+
+    int64_t value(NodeId id) const { return literals_[slot(id, Kind::IntLiteral, a_)]; }
+    tokens::IntForm form(NodeId id) const { return tokens::IntForm::unpack(slot(id, Kind::IntLiteral, c_)); }
+    Symbol symbol(NodeId id) const { return static_cast<Symbol>(slot(id, Kind::Iden, a_)); }
+    NodeId declaration(NodeId id) const { return static_cast<NodeId>(slot(id, Kind::Iden, b_)); }
+    tokens::Punctuator op(NodeId id) const { return static_cast<tokens::Punctuator>(c_[index(id)]); }
+    NodeId lhs(NodeId id) const { return node(id, Kind::BinExpr, a_); }
+    NodeId rhs(NodeId id) const { return node(id, Kind::BinExpr, b_); }
+    NodeId operand(NodeId id) const { return node(id, Kind::UnaryExpr, a_); }
+    // Expression of an ExprStmt or ReturnStmt
+    NodeId expr(NodeId id) const { return static_cast<NodeId>(a_[index(id)]); }
+    NodeId cond(NodeId id) const { return node(id, Kind::IfStmt, a_); }
+    NodeId cons(NodeId id) const { return node(id, Kind::IfStmt, b_); }
+    NodeId alt(NodeId id) const { return node(id, Kind::IfStmt, c_); }
+    std::span<NodeId const> items(NodeId id) const
+    {
+        return list(slot(id, Kind::CompoundStmt, a_), b_[index(id)]);
+    }
+    // Of an ObjDecl or FunctionDecl
+    NodeId iden(NodeId id) const { return static_cast<NodeId>(a_[index(id)]); }
+    DeclType const& type(NodeId id) const { return types_[c_[index(id)]]; }
+    NodeId init(NodeId id) const { return node(id, Kind::ObjDecl, b_); }
+    NodeId body(NodeId id) const { return node(id, Kind::FunctionDecl, b_); }
+
+private:
+    friend class FlatBuilder;
+    friend class FlatChecker;
+    friend class AstCache;
+
+    static uint32_t index(NodeId id)
+    {
+        assert(id != NodeId::None);
+        return static_cast<uint32_t>(id);
+    }
+
+    uint32_t slot(NodeId id, [[maybe_unused]] Kind expected, std::vector<uint32_t> const& column) const
+    {
+        assert(kind(id) == expected);
+        return column[index(id)];
+    }
+
+    NodeId node(NodeId id, Kind expected, std::vector<uint32_t> const& column) const
+    {
+        return static_cast<NodeId>(slot(id, expected, column));
+    }
+
+    std::span<NodeId const> list(uint32_t first, uint32_t count) const { return { lists_.data() + first, count }; }
+
+    NodeId add(Kind kind, Loc loc, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+
+    std::vector<Kind> kinds_;
+    std::vector<Loc> locs_;
+    std::vector<uint32_t> a_;
+    std::vector<uint32_t> b_;
+    std::vector<uint32_t> c_;
+
+    std::vector<NodeId> lists_;
+    std::vector<int64_t> literals_;
+    std::vector<DeclType> types_;
+    uint32_t items_first_{ 0 };
+    uint32_t items_count_{ 0 };
+};
+
+} // namespace compiler::ast
@@ -1,7 +1,10 @@
 #include "parser.hpp"
 #include "sema.hpp"
 #include "util/ice.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <thread>
 
 namespace compiler
 {
@@ -61,7 +64,138 @@ std::pair<int8_t, int8_t> Parser::binding_power(tokens::Punctuator punct) const
 
 ast::Ptr<ast::TranslationUnit> Parser::parse()
 {
-    return std::make_unique<ast::TranslationUnit>(lexer_.loc().filename(), items());
+    if (jobs_ == 1) return context_.make<ast::TranslationUnit>(Loc{ tape_.file, 0 }, items());
+
+    ast::Ptr<ast::TranslationUnit> tu{ nullptr };
+    {
+        // Held back to come out in source order with the diagnostics of the bodies
+        Loc::Capture top_level;
+        top_level_ = &top_level;
+        tu = context_.make<ast::TranslationUnit>(Loc{ tape_.file, 0 }, items());
+        between_.emplace_back(top_level.take());
+        top_level_ = nullptr;
+    }
+    parse_bodies();
+    return tu;
+}
+
+std::optional<size_t> Parser::skip_body() const
+{
+    if (!match(tokens::Punctuator::LBrace)) return std::nullopt;
+    size_t depth{ 0 };
+    for (auto pos = pos_; tape_[pos].tag != tokens::Tag::EoF; ++pos)
+    {
+        auto const& tok = tape_[pos];
+        if (tok.tag != tokens::Tag::Punctuator) continue;
+        if (tok.punctuator() == tokens::Punctuator::LBrace) ++depth;
+        else if (tok.punctuator() == tokens::Punctuator::RBrace && --depth == 0) return pos + 1;
+    }
+    // Unbalanced, left to compound_stmt to report
+    return std::nullopt;
+}
+
+void Parser::parse_bodies()
+{
+    // Contiguous runs of bodies of about the same number of tokens, one per job
+    size_t total{ 0 };
+    for (auto const& body : deferred_)
+    {
+        total += body.end - body.begin;
+    }
+    auto const share = total / jobs_ + 1;
+
+    std::vector<std::span<Deferred const>> runs;
+    size_t first{ 0 };
+    size_t tokens{ 0 };
+    for (size_t i = 0; i < deferred_.size(); ++i)
+    {
+        tokens += deferred_[i].end - deferred_[i].begin;
+        if (tokens >= share || i + 1 == deferred_.size())
+        {
+            runs.emplace_back(deferred_.data() + first, i + 1 - first);
+            first = i + 1;
+            tokens = 0;
+        }
+    }
+
+    // Forked on this thread, each run only touches its own
+    std::vector<ast::AstContext*> contexts;
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        contexts.emplace_back(&context_.fork());
+    }
+    RunLog log{ deferred_.size(), std::move(between_) };
+    between_.clear();
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 0; i < runs.size(); ++i)
+        {
+            workers.emplace_back(
+                [&, i]
+                {
+                    Run run{ log, static_cast<size_t>(runs[i].data() - deferred_.data()), {} };
+                    Parser parser{ tape_, sema_, *contexts[i] };
+                    parser.run_ = &run;
+                    for (auto const& body : runs[i])
+                    {
+                        parser.pos_ = body.begin;
+                        body.func->set_body(parser.compound_stmt());
+                        log.end(run.body++, run.capture.take());
+                    }
+                });
+        }
+    }
+    log.flush();
+    deferred_.clear();
+}
+
+void Parser::RunLog::end(size_t body, std::string text)
+{
+    {
+        std::lock_guard lock{ mutex_ };
+        texts_[body] = std::move(text);
+        ended_[body] = true;
+    }
+    ended_cv_.notify_all();
+}
+
+void Parser::RunLog::abort(size_t body, std::string text)
+{
+    std::unique_lock lock{ mutex_ };
+    auto const before = ended_.begin() + static_cast<std::ptrdiff_t>(body);
+    ended_cv_.wait(lock, [&] { return std::find(ended_.begin(), before, false) == before; });
+    texts_[body] = std::move(text);
+    write(body + 1);
+    // Other workers may still be reading the tape, so nothing static is torn down under them
+    std::cout.flush();
+    std::cerr.flush();
+    std::_Exit(1);
+}
+
+void Parser::RunLog::flush() const { write(texts_.size()); }
+
+// The first `count` bodies and what the top level reported before each, and after the last body once all are there
+void Parser::RunLog::write(size_t count) const
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i < between_.size()) std::cerr << between_[i];
+        std::cerr << texts_[i];
+    }
+    if (count == texts_.size() && count < between_.size()) std::cerr << between_[count];
+}
+
+void Parser::fail()
+{
+    if (run_ != nullptr) run_->log.abort(run_->body, run_->capture.take());
+    if (top_level_ != nullptr)
+    {
+        // The bodies deferred so far all come before the failure, so do their diagnostics
+        between_.emplace_back(top_level_->take());
+        top_level_ = nullptr;
+        parse_bodies();
+    }
+    exit(1);
 }
 
 bool Parser::is_type_keyword(tokens::Keyword k) const
@@ -119,7 +253,7 @@ ast::Storage Parser::storage(std::vector<tokens::Keyword> const& keywords) const
     }
     if (specifier_count > 1)
     {
-        lexer_.loc().err() << "Mutliple storage specifiers are dissallowed\n";
+        loc().err() << "Mutliple storage specifiers are dissallowed\n";
     }
     return strg;
 }
@@ -127,15 +261,14 @@ ast::Storage Parser::storage(std::vector<tokens::Keyword> const& keywords) const
 ast::Ptr<ast::TypeDecl> Parser::type()
 {
     std::vector<tokens::Keyword> specifiers;
-    auto const loc = lexer_.peek().loc;
+    auto const loc = peek().loc();
 
     while (true)
     {
-        auto res = lexer_.peek();
-        auto key = std::get_if<tokens::Keyword>(&res.value);
-        if (key == nullptr || !is_type_keyword(*key)) break;
+        auto key = peek().as_keyword();
+        if (!key || !is_type_keyword(*key)) break;
         specifiers.emplace_back(*key);
-        lexer_.advance();
+        advance();
     }
 
     if (specifiers.size() == 0)
@@ -145,12 +278,12 @@ ast::Ptr<ast::TypeDecl> Parser::type()
     auto strg = storage(specifiers);
 
     Type typ{ loc, std::move(specifiers) };
-    return std::make_unique<ast::TypeDecl>(loc, sema_.new_type(typ), strg);
+    return context_.make<ast::TypeDecl>(loc, sema_.new_type(typ), strg);
 }
 
 ast::Ptr<ast::Declaration> Parser::declaration()
 {
-    auto const loc = lexer_.peek().loc;
+    auto const loc = peek().loc();
     auto ret_t = type();
     if (ret_t == nullptr)
     {
@@ -162,39 +295,46 @@ ast::Ptr<ast::Declaration> Parser::declaration()
     if (match_consume(tokens::Punctuator::LParen))
     {
         // TODO Parse parameter list
-        std::vector<ast::Ptr<ast::ObjDecl>> args;
         expect(tokens::Punctuator::RParen);
+        std::span<ast::Ptr<ast::ObjDecl> const> const args{};
+        if (auto const end = jobs_ > 1 ? skip_body() : std::nullopt)
+        {
+            auto const func = context_.make<ast::FunctionDecl>(loc, ret_t, iden, args, nullptr);
+            if (top_level_ != nullptr) between_.emplace_back(top_level_->take());
+            deferred_.emplace_back(Deferred{ func, pos_, *end });
+            pos_ = *end;
+            return func;
+        }
         auto compound = compound_stmt();
-        return std::make_unique<ast::FunctionDecl>(loc, std::move(ret_t), std::move(iden), std::move(args),
-                                                   std::move(compound));
+        return context_.make<ast::FunctionDecl>(loc, ret_t, iden, args, compound);
     }
 
     ast::Ptr<ast::Expr> initalizer{ match_consume(tokens::Punctuator::Equal) ? expr() : nullptr };
     expect(tokens::Punctuator::Semicolon);
-    return std::make_unique<ast::ObjDecl>(loc, std::move(ret_t), std::move(iden), std::move(initalizer));
+    return context_.make<ast::ObjDecl>(loc, ret_t, iden, initalizer);
 }
 
 ast::Ptr<ast::Iden> Parser::identifier()
 {
-    auto token = lexer_.advance();
+    auto token = advance();
     if (token.tag != tokens::Tag::Identifier)
     {
-        token.loc.err() << "Expected identifier, found: " << token.format();
+        token.loc().err() << "Expected identifier, found: " << token.format();
         return nullptr;
     }
-    return std::make_unique<ast::Iden>(token.loc, std::get<std::string>(token.value));
+    return context_.make<ast::Iden>(token.loc(), token.symbol());
 }
 
 ast::Ptr<ast::Stmt> Parser::selection_statement()
 {
-    auto const tok = lexer_.peek();
+    auto const tok = peek();
     expect(tokens::Keyword::If);
     expect(tokens::Punctuator::LParen);
     auto cond = expr();
     expect(tokens::Punctuator::RParen);
     auto cons = statement();
     auto alt = match_consume(tokens::Keyword::Else) ? statement() : nullptr;
-    return std::make_unique<ast::IfStmt>(tok.loc, std::move(cond), std::move(cons), std::move(alt));
+    return context_.make<ast::IfStmt>(tok.loc(), cond, cons, alt);
 }
 
 ast::Ptr<ast::Stmt> Parser::statement()
@@ -205,7 +345,7 @@ ast::Ptr<ast::Stmt> Parser::statement()
     // iteration-statement
     // jump-statement
 
-    auto const tok = lexer_.peek();
+    auto const tok = peek();
     if (match(tokens::Punctuator::LBrace))
     {
         return compound_stmt();
@@ -218,101 +358,132 @@ ast::Ptr<ast::Stmt> Parser::statement()
 
     if (match_consume(tokens::Punctuator::Semicolon))
     {
-        return std::make_unique<ast::NullStmt>(tok.loc);
+        return context_.make<ast::NullStmt>(tok.loc());
     }
 
     if (match_consume(tokens::Keyword::Return))
     {
         ast::Ptr<ast::Expr> ret_val{ match(tokens::Punctuator::Semicolon) ? nullptr : expr() };
         expect(tokens::Punctuator::Semicolon);
-        return std::make_unique<ast::ReturnStmt>(tok.loc, std::move(ret_val));
+        return context_.make<ast::ReturnStmt>(tok.loc(), ret_val);
     }
 
     auto exp = expr();
     expect(tokens::Punctuator::Semicolon);
-    return std::make_unique<ast::ExprStmt>(tok.loc, std::move(exp));
+    return context_.make<ast::ExprStmt>(tok.loc(), exp);
 }
 
 ast::Ptr<ast::Items> Parser::items()
 {
-    Loc loc{ lexer_.loc() };
+    auto const items_loc{ loc() };
     auto get_item = [&]() -> ast::Ptr<ast::Item>
     {
-        auto const tok = lexer_.peek();
-        if (auto k = std::get_if<tokens::Keyword>(&tok.value); k != nullptr && is_type_keyword(*k))
+        auto const tok = peek();
+        if (auto k = tok.as_keyword(); k && is_type_keyword(*k))
         {
-            return std::make_unique<ast::Item>(declaration());
+            return context_.make<ast::Item>(declaration());
         }
-        return std::make_unique<ast::Item>(statement());
+        return context_.make<ast::Item>(statement());
     };
 
-    std::vector<ast::Ptr<ast::Item>> items;
+    // Nested blocks stack their items on top of the enclosing ones, only the finished list goes to the arena
+    auto const base = item_stack_.size();
     while (!match(tokens::Punctuator::RBrace) && !match(tokens::Tag::EoF))
     {
-        items.emplace_back(get_item());
+        item_stack_.emplace_back(get_item());
     }
 
-    return std::make_unique<ast::Items>(loc, std::move(items));
+    auto const list = context_.list<ast::Ptr<ast::Item>>({ item_stack_.data() + base, item_stack_.size() - base });
+    item_stack_.resize(base);
+    return context_.make<ast::Items>(items_loc, list);
 }
 
 ast::Ptr<ast::CompoundStmt> Parser::compound_stmt()
 {
-    auto const loc{ lexer_.peek().loc };
+    auto const loc{ peek().loc() };
     expect(tokens::Punctuator::LBrace);
     auto its = items();
     expect(tokens::Punctuator::RBrace);
-    return std::make_unique<ast::CompoundStmt>(loc, std::move(its));
+    return context_.make<ast::CompoundStmt>(loc, its);
 }
 
 ast::Ptr<ast::IntLiteral> Parser::constant()
 {
-    auto const tok = lexer_.advance();
+    auto const tok = advance();
     assert(tok.tag == tokens::Tag::Constant);
-    return std::make_unique<ast::IntLiteral>(tok.loc, std::get<int64_t>(tok.value));
+    return context_.make<ast::IntLiteral>(tok.loc(), tape_.literal(tok), tok.int_form());
 }
 
-ast::Ptr<ast::Expr> Parser::unary_expr()
+ast::Ptr<ast::Expr> Parser::expr()
 {
-    auto const atom{ lexer_.peek() };
-    switch (atom.tag)
-    {
-    case tokens::Tag::Identifier: return identifier();
-    case tokens::Tag::Constant: return constant();
-    case tokens::Tag::Punctuator:
+    // Each round reads one operand, with the prefix operators and parentheses before it, then reduces the pending
+    // constructs it completes. `min_bp` is what the recursive formulation would have passed down, constructs
+    // remember the one to return to.
+    using Kind = Pending::Kind;
+    auto const base = expr_stack_.size();
+    int8_t min_bp{ 0 };
+    while (true)
     {
-        if (match_consume(tokens::Punctuator::LParen))
+        ast::Ptr<ast::Expr> lhs{ nullptr };
+        while (lhs == nullptr)
         {
-            auto e = expr();
-            expect(tokens::Punctuator::RParen);
-            return e;
+            auto const atom{ peek() };
+            switch (atom.tag)
+            {
+            case tokens::Tag::Identifier: lhs = identifier(); break;
+            case tokens::Tag::Constant: lhs = constant(); break;
+            case tokens::Tag::Punctuator:
+            {
+                auto const p = atom.punctuator();
+                if (p == tokens::Punctuator::LParen)
+                {
+                    advance();
+                    expr_stack_.emplace_back(Pending{ Kind::Paren, p, min_bp, atom.loc(), nullptr });
+                    min_bp = 0;
+                    continue;
+                }
+                if (auto bp = prefix_binding_power(p); bp != -1)
+                {
+                    advance();
+                    expr_stack_.emplace_back(Pending{ Kind::Prefix, p, min_bp, atom.loc(), nullptr });
+                    min_bp = bp;
+                    continue;
+                }
+            }
+                [[fallthrough]];
+            default: REPORT_ICE("Unrecognized expression atom ");
+            }
         }
-        auto const p = std::get<tokens::Punctuator>(atom.value);
-        if (auto bp = prefix_binding_power(p); bp != -1)
+
+        while (true)
         {
-            lexer_.advance();
-            return std::make_unique<ast::UnaryExpr>(atom.loc, p, expr(bp));
-        }
-    }
-        [[fallthrough]];
-    default: REPORT_ICE("Unrecognized expression atom ");
-    }
-}
+            auto const tok = peek();
+            if (tok.tag == tokens::Tag::Punctuator)
+            {
+                auto const op = tok.punctuator();
+                auto const [lbp, rbp] = binding_power(op);
+                if (lbp >= min_bp)
+                {
+                    advance();
+                    expr_stack_.emplace_back(Pending{ Kind::Binary, op, min_bp, lhs->loc(), lhs });
+                    min_bp = rbp;
+                    break;
+                }
+            }
 
-ast::Ptr<ast::Expr> Parser::expr(int8_t min_bp)
-{
-    auto lhs = unary_expr();
-    while (true)
-    {
-        auto const tok = lexer_.peek();
-        auto const op = std::get<tokens::Punctuator>(tok.value);
-        auto const [lbp, rbp] = binding_power(op);
-        if (lbp < min_bp) break;
-        lexer_.advance();
-        auto const loc = lhs->loc();
-        auto rhs = expr(rbp);
-        lhs = std::make_unique<ast::BinExpr>(loc, std::move(lhs), op, std::move(rhs));
+            // `lhs` is complete at this level, hand it to the construct waiting for it
+            if (expr_stack_.size() == base) return lhs;
+            auto const pending = expr_stack_.back();
+            expr_stack_.pop_back();
+            min_bp = pending.min_bp;
+            switch (pending.kind)
+            {
+            case Kind::Binary: lhs = context_.make<ast::BinExpr>(pending.loc, pending.lhs, pending.op, lhs); break;
+            case Kind::Prefix: lhs = context_.make<ast::UnaryExpr>(pending.loc, pending.op, lhs); break;
+            case Kind::Paren: expect(tokens::Punctuator::RParen); break;
+            }
+        }
     }
-    return lhs;
 }
 
 } // namespace compiler
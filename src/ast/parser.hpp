@@ -1,7 +1,11 @@
 #pragma once
 #include "ast.hpp"
-#include "lexer/lexer.hpp"
 #include "lexer/reflection.hpp"
+#include "lexer/tape.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
 
 namespace compiler
 {
@@ -9,15 +13,72 @@ namespace compiler
 class Parser
 {
 public:
-    explicit Parser(File const& file, Sema& sema) : lexer_{ file }, sema_{ sema } {}
+    // With more than one job, function bodies are skipped at first and parsed by that many threads once the top level
+    // is complete, each into its own fork of `context`
+    explicit Parser(tokens::Tape const& tape, Sema& sema, ast::AstContext& context, size_t jobs = 1) :
+        tape_{ tape },
+        sema_{ sema },
+        context_{ context },
+        jobs_{ jobs }
+    {
+    }
 
     ast::Ptr<ast::TranslationUnit> parse();
 
 private:
+    // Function whose body is still to be parsed, [begin, end) are the tokens of its braces
+    struct Deferred
+    {
+        ast::FunctionDecl* func;
+        size_t begin;
+        size_t end;
+    };
+
+    // Diagnostics of the deferred bodies and of the top level around them, passed on in source order whichever order
+    // the bodies are parsed in. `between[i]` is what the top level reported before body i, the last entry what it
+    // reported after the last body.
+    class RunLog
+    {
+    public:
+        RunLog(size_t bodies, std::vector<std::string> between) :
+            between_{ std::move(between) },
+            texts_(bodies),
+            ended_(bodies, false)
+        {
+        }
+
+        void end(size_t body, std::string text);
+        // Waits for the bodies before `body`, reports everything up to `body` and ends the process from whichever
+        // thread it is on
+        [[noreturn]] void abort(size_t body, std::string text);
+        void flush() const;
+
+    private:
+        void write(size_t count) const;
+
+        std::mutex mutex_;
+        std::condition_variable ended_cv_;
+        std::vector<std::string> between_;
+        std::vector<std::string> texts_;
+        std::vector<bool> ended_;
+    };
+
+    // Body a worker parser is on
+    struct Run
+    {
+        RunLog& log;
+        size_t body;
+        Loc::Capture capture;
+    };
+
     ast::Ptr<ast::Declaration> declaration();
+    // Position past the brace closing the compound statement at the current position, if there is one
+    std::optional<size_t> skip_body() const;
+    void parse_bodies();
 
-    ast::Ptr<ast::Expr> unary_expr();
-    ast::Ptr<ast::Expr> expr(int8_t min_bp = 0);
+    // Pratt parser driven by an explicit stack instead of recursion, so nesting depth and expression length only
+    // cost heap memory
+    ast::Ptr<ast::Expr> expr();
     ast::Ptr<ast::Stmt> statement();
     ast::Ptr<ast::Stmt> selection_statement();
     ast::Ptr<ast::Items> items();
@@ -28,23 +89,24 @@ private:
 
     ast::Storage storage(std::vector<tokens::Keyword> const& keywords) const;
 
-    template <typename T> bool match(T expected) const
+    tokens::Token const& peek(size_t ahead = 0) const { return tape_[pos_ + ahead]; }
+
+    tokens::Token const& advance()
     {
-        auto const peeked = lexer_.peek();
-        if (auto p = std::get_if<T>(&peeked.value); p != nullptr && *p == expected)
-        {
-            return true;
-        }
-        return false;
+        auto const& tok = tape_[pos_];
+        pos_ += pos_ + 1 < tape_.size();
+        return tok;
     }
 
-    bool match(tokens::Tag expected) const { return lexer_.peek().tag == expected; }
+    Loc loc() const { return peek().loc(); }
+
+    template <typename T> bool match(T expected) const { return peek().is(expected); }
 
     template <typename T> bool match_consume(T tok)
     {
         if (match(tok))
         {
-            lexer_.advance();
+            advance();
             return true;
         }
         return false;
@@ -54,17 +116,45 @@ private:
     {
         if (!match_consume(tok))
         {
-            lexer_.loc().err() << "Unexpected token encountered, expected: " << tokens::to_string(tok) << '\n';
-            exit(1);
+            loc().err() << "Unexpected token encountered, expected: " << tokens::to_string(tok) << '\n';
+            fail();
         }
     }
 
+    // Construct of an expression that is waiting for its operand, what expr() keeps on its stack
+    struct Pending
+    {
+        enum class Kind : uint8_t
+        {
+            Binary, // `lhs op` waiting for its right operand
+            Prefix, // `op` waiting for its operand
+            Paren,  // `(` waiting for the expression and the closing parenthesis
+        };
+        Kind kind;
+        tokens::Punctuator op;
+        int8_t min_bp; // Of the expression the construct is an operand of
+        Loc loc;
+        ast::Ptr<ast::Expr> lhs;
+    };
+
+    // Stops the compilation on an error the parser cannot recover from
+    [[noreturn]] void fail();
     bool is_type_keyword(tokens::Keyword k) const;
     int8_t prefix_binding_power(tokens::Punctuator punct) const;
     std::pair<int8_t, int8_t> binding_power(tokens::Punctuator punct) const;
 
-    Lexer lexer_;
+    tokens::Tape const& tape_;
+    size_t pos_{ 0 };
     Sema& sema_;
+    ast::AstContext& context_;
+    std::vector<ast::Ptr<ast::Item>> item_stack_;
+    std::vector<Pending> expr_stack_;
+    size_t jobs_;
+    std::vector<Deferred> deferred_;
+    Run* run_{ nullptr };
+    // Top level diagnostics while bodies are deferred, cut where each body was skipped
+    Loc::Capture* top_level_{ nullptr };
+    std::vector<std::string> between_;
 };
 
 } // namespace compiler
@@ -11,7 +11,7 @@ void Sema::add(ast::ObjDecl const& declared)
 {
     auto& scope_decls = scope_.objs_.back();
     auto it = std::find_if(scope_decls.begin(), scope_decls.end(), [&declared](auto const* present)
-                           { return declared.iden_->name() == present->iden_->name(); });
+                           { return declared.iden_->symbol() == present->iden_->symbol(); });
     if (it != scope_decls.end())
     {
         declared.loc().err() << std::format("Redefinition of {}", declared.iden_->name());
@@ -29,7 +29,7 @@ void Sema::add(ast::FunctionDecl const& func)
         return;
     }
     auto it = std::find_if(scope_.functions_.begin(), scope_.functions_.end(),
-                           [&func](auto const* present) { return func.iden_->name() == present->iden_->name(); });
+                           [&func](auto const* present) { return func.iden_->symbol() == present->iden_->symbol(); });
     if (it != scope_.functions_.end())
     {
         func.loc().err() << std::format("Redefinition of: {}", func.iden_->name());
@@ -43,7 +43,7 @@ ast::ObjDecl const* Sema::lookup(ast::Iden const& iden) const
     auto find_in_scope = [&](auto& scope) -> ast::ObjDecl const*
     {
         auto it = std::find_if(scope.begin(), scope.end(),
-                               [&](auto const* var) { return var->iden_->name() == iden.name(); });
+                               [&](auto const* var) { return var->iden_->symbol() == iden.symbol(); });
         if (it != scope.end())
         {
             return *it;
@@ -63,6 +63,49 @@ ast::ObjDecl const* Sema::lookup(ast::Iden const& iden) const
     return nullptr;
 }
 
+void Sema::add(ast::FlatAst const& ast, ast::NodeId decl)
+{
+    auto const symbol = ast.symbol(ast.iden(decl));
+    auto const same_name = [&](ast::NodeId present) { return ast.symbol(ast.iden(present)) == symbol; };
+    auto const name = Interner::global().text(symbol);
+    if (ast.kind(decl) == ast::FlatAst::Kind::FunctionDecl)
+    {
+        if (flat_scope_.objs_.size() != 1)
+        {
+            ast.loc(decl).err() << "Function declaration is not possible here\n";
+            return;
+        }
+        if (std::ranges::any_of(flat_scope_.functions_, same_name))
+        {
+            ast.loc(decl).err() << std::format("Redefinition of: {}\n", name);
+            return;
+        }
+        flat_scope_.functions_.emplace_back(decl);
+        return;
+    }
+
+    auto& scope_decls = flat_scope_.objs_.back();
+    if (std::ranges::any_of(scope_decls, same_name))
+    {
+        ast.loc(decl).err() << std::format("Redefinition of {}\n", name);
+        return;
+    }
+    scope_decls.emplace_back(decl);
+}
+
+ast::NodeId Sema::lookup(ast::FlatAst const& ast, ast::NodeId iden) const
+{
+    auto const symbol = ast.symbol(iden);
+    for (auto& scope : flat_scope_.objs_ | std::views::reverse)
+    {
+        auto it = std::ranges::find_if(scope, [&](ast::NodeId var) { return ast.symbol(ast.iden(var)) == symbol; });
+        if (it != scope.end()) return *it;
+    }
+
+    ast.loc(iden).err() << "Usage of undefined identifier\n";
+    return ast::NodeId::None;
+}
+
 ast::FunctionDecl const& Sema::current_fuction() { return *scope_.functions_.back(); }
 
 TypeCamp::TypeCamp()
@@ -78,6 +121,7 @@ TypeCamp::TypeCamp()
 
 Type const* TypeCamp::add(Type const& t)
 {
+    std::scoped_lock lock{ mutex_ };
     auto it = std::find_if(types_.begin(), types_.end(), [&t](auto const& present) { return *present == t; });
     if (it != types_.end()) return it->get();
     return types_.emplace_back(std::make_unique<Type>(t)).get();
@@ -1,7 +1,9 @@
 #pragma once
 #include "ast.hpp"
+#include "flat.hpp"
 #include "sema.fwd.hpp"
 #include "type.hpp"
+#include <mutex>
 
 namespace compiler
 {
@@ -13,9 +15,11 @@ public:
 
     Type const* add(Type const&);
     Type const* get(BasicType) const;
+    size_t size() const { return types_.size(); }
 
 private:
     std::vector<std::unique_ptr<Type>> types_;
+    std::mutex mutex_; // Function bodies may be parsed concurrently
 };
 
 class Sema
@@ -24,19 +28,33 @@ public:
     Sema()
     {
         scope_.objs_.emplace_back(); // Global scope
+        flat_scope_.objs_.emplace_back();
     }
 
     Type const* new_type(Type const& t) { return types_.add(t); }
     void add(ast::ObjDecl const& obj);
     void add(ast::FunctionDecl const& f);
+    // Declarations of a FlatAst, told apart by node
+    void add(ast::FlatAst const& ast, ast::NodeId decl);
 
-    void push() { scope_.objs_.emplace_back(); }
-    void pop() { scope_.objs_.pop_back(); }
+    void push()
+    {
+        scope_.objs_.emplace_back();
+        flat_scope_.objs_.emplace_back();
+    }
+    void pop()
+    {
+        scope_.objs_.pop_back();
+        flat_scope_.objs_.pop_back();
+    }
 
     ast::FunctionDecl const& current_fuction();
     ast::ObjDecl const* lookup(ast::Iden const& iden) const;
+    // The ObjDecl `iden` names, None if there is none in scope
+    ast::NodeId lookup(ast::FlatAst const& ast, ast::NodeId iden) const;
 
     Type const* get_type(BasicType type) const { return types_.get(type); }
+    TypeCamp const& types() const { return types_; }
     // TODO after changing the type, reevaluate the value
 private:
     struct
@@ -44,6 +62,11 @@ private:
         std::vector<ast::FunctionDecl const*> functions_;
         std::vector<std::vector<ast::ObjDecl const*>> objs_;
     } scope_;
+    struct
+    {
+        std::vector<ast::NodeId> functions_;
+        std::vector<std::vector<ast::NodeId>> objs_;
+    } flat_scope_;
     TypeCamp types_;
 };
 
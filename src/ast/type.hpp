@@ -36,17 +36,20 @@ public:
     using Qualifiers = std::bitset<to_underlying(Qualifier::Restrict) + 1>;
 
     explicit Type(Loc loc, std::vector<tokens::Keyword>&& keywords);
-    explicit Type(BasicType basic) : basic_{ basic } {}
+    explicit Type(BasicType basic, bool is_signed = true) : basic_{ basic }, signed_{ is_signed } {}
+    Type(BasicType basic, bool is_signed, Qualifiers quals) : quals_{ quals }, basic_{ basic }, signed_{ is_signed } {}
 
     bool operator==(Type const&) const = default;
-    BasicType basic_type() { return basic_; }
+    BasicType basic_type() const { return basic_; }
+    bool is_signed() const { return signed_; }
+    Qualifiers qualifiers() const { return quals_; }
 
     std::string format() const;
 
     bool is_artithmetic() const;
     bool is_scalar() const;
     bool is_void() const { return basic_ == BasicType::Void; }
-    bool is_modifyable_lvalue() const { return !is_void() && quals_.test(to_underlying(Qualifier::Const)); }
+    bool is_modifyable_lvalue() const { return !is_void() && !quals_.test(to_underlying(Qualifier::Const)); }
 
     static Type implicit_conversion(Loc const& loc, Type const& lhs, Type const& rhs);
 
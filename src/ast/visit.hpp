@@ -0,0 +1,81 @@
+#pragma once
+#include "ast.hpp"
+#include "util/ice.hpp"
+#include "util/visitor.hpp"
+#include <type_traits>
+
+namespace compiler::ast
+{
+
+// Static dispatch on the NodeKind tag. `visitor` is called with the concrete node and must accept every class of the
+// visited category, typically an Overload of lambdas; all of them must return the same type.
+
+template <typename Visitor> decltype(auto) visit(Expr const& expr, Visitor&& visitor)
+{
+    switch (expr.kind())
+    {
+    case NodeKind::BinExpr: return visitor(static_cast<BinExpr const&>(expr));
+    case NodeKind::IntLiteral: return visitor(static_cast<IntLiteral const&>(expr));
+    case NodeKind::Iden: return visitor(static_cast<Iden const&>(expr));
+    case NodeKind::UnaryExpr: return visitor(static_cast<UnaryExpr const&>(expr));
+    default: REPORT_ICE("Not an expression");
+    }
+}
+
+template <typename Visitor> decltype(auto) visit(Stmt const& stmt, Visitor&& visitor)
+{
+    switch (stmt.kind())
+    {
+    case NodeKind::ExprStmt: return visitor(static_cast<ExprStmt const&>(stmt));
+    case NodeKind::IfStmt: return visitor(static_cast<IfStmt const&>(stmt));
+    case NodeKind::CompoundStmt: return visitor(static_cast<CompoundStmt const&>(stmt));
+    case NodeKind::ReturnStmt: return visitor(static_cast<ReturnStmt const&>(stmt));
+    case NodeKind::NullStmt: return visitor(static_cast<NullStmt const&>(stmt));
+    default: REPORT_ICE("Not a statement");
+    }
+}
+
+template <typename Visitor> decltype(auto) visit(Declaration const& decl, Visitor&& visitor)
+{
+    switch (decl.kind())
+    {
+    case NodeKind::ObjDecl: return visitor(static_cast<ObjDecl const&>(decl));
+    case NodeKind::FunctionDecl: return visitor(static_cast<FunctionDecl const&>(decl));
+    default: REPORT_ICE("Not a declaration");
+    }
+}
+
+// NodeKind of each concrete class
+template <typename T> struct KindOf;
+template <> struct KindOf<BinExpr> : std::integral_constant<NodeKind, NodeKind::BinExpr> {};
+template <> struct KindOf<IntLiteral> : std::integral_constant<NodeKind, NodeKind::IntLiteral> {};
+template <> struct KindOf<Iden> : std::integral_constant<NodeKind, NodeKind::Iden> {};
+template <> struct KindOf<UnaryExpr> : std::integral_constant<NodeKind, NodeKind::UnaryExpr> {};
+template <> struct KindOf<ExprStmt> : std::integral_constant<NodeKind, NodeKind::ExprStmt> {};
+template <> struct KindOf<IfStmt> : std::integral_constant<NodeKind, NodeKind::IfStmt> {};
+template <> struct KindOf<CompoundStmt> : std::integral_constant<NodeKind, NodeKind::CompoundStmt> {};
+template <> struct KindOf<ReturnStmt> : std::integral_constant<NodeKind, NodeKind::ReturnStmt> {};
+template <> struct KindOf<NullStmt> : std::integral_constant<NodeKind, NodeKind::NullStmt> {};
+template <> struct KindOf<ObjDecl> : std::integral_constant<NodeKind, NodeKind::ObjDecl> {};
+template <> struct KindOf<FunctionDecl> : std::integral_constant<NodeKind, NodeKind::FunctionDecl> {};
+template <> struct KindOf<TypeDecl> : std::integral_constant<NodeKind, NodeKind::TypeDecl> {};
+template <> struct KindOf<Item> : std::integral_constant<NodeKind, NodeKind::Item> {};
+template <> struct KindOf<Items> : std::integral_constant<NodeKind, NodeKind::Items> {};
+template <> struct KindOf<TranslationUnit> : std::integral_constant<NodeKind, NodeKind::TranslationUnit> {};
+
+// Checked downcast by tag, null if `node` is not a T. T is a concrete class or one of Expr, Stmt and Declaration.
+template <typename T> T const* node_cast(Node const& node)
+{
+    bool matches{ false };
+    if constexpr (std::is_abstract_v<T>)
+    {
+        matches = T::is(node.kind());
+    }
+    else
+    {
+        matches = node.kind() == KindOf<T>::value;
+    }
+    return matches ? static_cast<T const*>(&node) : nullptr;
+}
+
+} // namespace compiler::ast
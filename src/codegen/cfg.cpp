@@ -1,4 +1,6 @@
 #include "cfg.hpp"
+#include "ast/dfs.hpp"
+#include "ast/visit.hpp"
 #include "cfgGraph.hpp"
 #include "util/ice.hpp"
 #include <cassert>
@@ -79,12 +81,14 @@ private:
 class SSAGenerator
 {
 public:
-    explicit SSAGenerator(ast::FunctionDecl const& func) : func_{ func } {}
+    explicit SSAGenerator(std::string_view name) : cfg{ name } {}
+    SSAGenerator(ast::FlatAst const& flat, std::string_view name) : flat_{ &flat }, cfg{ name } {}
 
-    CFG construct()
+    // `body` are the items of a function, of either AST
+    template <typename Body> CFG construct(Body const& body)
     {
         auto starting = insert_node();
-        on_items(starting, func_.body().items());
+        on_items(starting, body);
         split_critical_edges();
 
         return std::move(cfg);
@@ -119,6 +123,12 @@ private:
         return block->insert(std::make_unique<T>(names_.get(), std::forward<Args>(args)...));
     }
 
+    // Variables are told apart by their declaration: the ObjDecl of a pointer AST or the row of a flat one
+    using Var = uintptr_t;
+
+    static Var var(ast::ObjDecl const* decl) { return reinterpret_cast<Var>(decl); }
+    static Var var(ast::NodeId decl) { return static_cast<Var>(decl); }
+
     Block* on_items(Block* block, ast::Items const& items)
     {
         for (auto& item : items.items())
@@ -132,7 +142,9 @@ private:
     {
         if (auto decl = item.decl())
         {
-            on_decl(block, dynamic_cast<ast::ObjDecl const&>(*decl));
+            auto obj = ast::node_cast<ast::ObjDecl>(*decl);
+            assert(obj);
+            on_decl(block, *obj);
         }
         else
         {
@@ -171,28 +183,16 @@ private:
     // Returns the last created successor by this procedure
     Block* on_stmt(Block* block, ast::Stmt const& stmt)
     {
-        if (auto expr = dynamic_cast<ast::ExprStmt const*>(&stmt))
-        {
-            on_expr(block, expr->expr());
-            return block;
-        }
-        else if (auto compound = dynamic_cast<ast::CompoundStmt const*>(&stmt))
-        {
-            return on_items(block, compound->items());
-        }
-        else if (auto ifstmt = dynamic_cast<ast::IfStmt const*>(&stmt))
-        {
-            return on_if(block, *ifstmt);
-        }
-        else if (auto retstmt = dynamic_cast<ast::ReturnStmt const*>(&stmt))
-        {
-            return on_return(block, retstmt);
-        }
-        else if (dynamic_cast<ast::NullStmt const*>(&stmt))
-        {
-            return block;
-        }
-        REPORT_ICE("Unhandled statement");
+        return ast::visit(stmt, Overload{
+            [&](ast::ExprStmt const& expr) {
+                on_expr(block, expr.expr());
+                return block;
+            },
+            [&](ast::CompoundStmt const& compound) { return on_items(block, compound.items()); },
+            [&](ast::IfStmt const& ifstmt) { return on_if(block, ifstmt); },
+            [&](ast::ReturnStmt const& retstmt) { return on_return(block, &retstmt); },
+            [&](ast::NullStmt const&) { return block; },
+        });
     }
 
     Block* on_return(Block* block, ast::ReturnStmt const* ret)
@@ -210,61 +210,203 @@ private:
 
     Inst* on_expr(Block* block, ast::Expr const& expr)
     {
-        if (auto iden = dynamic_cast<ast::Iden const*>(&expr))
+        // Operands are lowered before their operator, which takes their values from the top of the stack
+        std::vector<Inst*> values;
+        auto const pop = [&] {
+            auto value = values.back();
+            values.pop_back();
+            return value;
+        };
+        // Identifier assigned by the enclosing BinExpr, it is written rather than read
+        ast::Iden const* target{ nullptr };
+
+        auto const pre = [&](ast::Node const& node) {
+            auto bin = ast::node_cast<ast::BinExpr>(node);
+            if (bin == nullptr || math_op(bin->op()).has_value()) return;
+            assert(bin->op() == tokens::Punctuator::Equal);
+            target = ast::node_cast<ast::Iden>(bin->lhs());
+            assert(target);
+        };
+        auto const post = [&](ast::Node const& node) {
+            ast::visit(static_cast<ast::Expr const&>(node), Overload{
+                [&](ast::Iden const& iden) {
+                    if (&iden == target)
+                    {
+                        target = nullptr;
+                        values.emplace_back(nullptr);
+                        return;
+                    }
+                    values.emplace_back(read_variable(var(iden.referenced()), block));
+                },
+                [&](ast::IntLiteral const& constant) { values.emplace_back(emit<ConstInst>(block, constant.value())); },
+                [&](ast::BinExpr const& bin) {
+                    auto rhs = pop();
+                    auto lhs = pop();
+                    if (auto math = math_op(bin.op()))
+                    {
+                        values.emplace_back(emit<MathInst>(block, *math, lhs, rhs));
+                        return;
+                    }
+                    write_var(var(static_cast<ast::Iden const&>(bin.lhs()).referenced()), block, rhs);
+                    values.emplace_back(rhs);
+                },
+                [&](ast::UnaryExpr const& un) {
+                    assert(un.op() == tokens::Punctuator::Exclaim);
+                    values.emplace_back(emit<Unary>(block, Opcode::LogicalNegate, pop()));
+                },
+            });
+        };
+        ast::dfs(expr, pre, post);
+
+        assert(values.size() == 1);
+        return values.back();
+    }
+
+    void on_decl(Block* block, ast::ObjDecl const& decl)
+    {
+        if (decl.initalizer() == nullptr) return;
+        Inst* init = on_expr(block, *decl.initalizer());
+        write_var(var(decl.iden().referenced()), block, init);
+    }
+
+    // The same walk over a FlatAst
+
+    Block* on_items(Block* block, std::span<ast::NodeId const> items)
+    {
+        for (auto item : items)
         {
-            return read_variable(iden->referenced(), block);
+            block = on_item(block, item);
         }
+        return block;
+    }
 
-        if (auto constant = dynamic_cast<ast::IntLiteral const*>(&expr))
+    Block* on_item(Block* block, ast::NodeId item)
+    {
+        if (flat_->kind(item) == ast::FlatAst::Kind::ObjDecl)
         {
-            return emit<ConstInst>(block, constant->value());
+            on_decl(block, item);
+            return block;
         }
+        return on_stmt(block, item);
+    }
 
-        if (auto bin = dynamic_cast<ast::BinExpr const*>(&expr))
-        {
-            if (math_op(bin->op()).has_value())
-            {
-                return on_math(block, *bin);
-            }
+    Block* on_if_branch(Block* parent, ast::NodeId stmt)
+    {
+        auto suc = insert_node();
+        parent->add_successor(suc);
+        Block* child = stmt != ast::NodeId::None ? on_stmt(suc, stmt) : suc;
+        seal(child);
+        child->fill();
+        return child;
+    }
 
-            assert(bin->op() == tokens::Punctuator::Equal);
-            auto iden = dynamic_cast<ast::Iden const*>(&bin->lhs());
-            assert(iden);
-            return on_assign(block, iden, bin->rhs());
-        }
+    Block* on_if(Block* block, ast::NodeId ifstmt)
+    {
+        seal(block);
+        auto cond = on_expr(block, flat_->cond(ifstmt));
+        emit<JumpIf>(block, cond);
+        block->fill();
 
-        if (auto un = dynamic_cast<ast::UnaryExpr const*>(&expr))
-        {
-            assert(un->op() == tokens::Punctuator::Exclaim);
-            auto arg = on_expr(block, un->expr());
-            return emit<Unary>(block, Opcode::LogicalNegate, arg);
-        }
+        Block* lhs = on_if_branch(block, flat_->cons(ifstmt));
+        Block* rhs = on_if_branch(block, flat_->alt(ifstmt));
 
-        REPORT_ICE("Unhandled expression evaluation");
+        auto exit = insert_node();
+        lhs->add_successor(exit);
+        rhs->add_successor(exit);
+
+        return exit;
     }
 
-    Inst* on_math(Block* block, ast::BinExpr const& bin)
+    Block* on_stmt(Block* block, ast::NodeId stmt)
     {
-        auto lhs = on_expr(block, bin.lhs());
-        auto rhs = on_expr(block, bin.rhs());
-        return emit<MathInst>(block, math_op(bin.op()).value(), lhs, rhs);
+        using Kind = ast::FlatAst::Kind;
+        switch (flat_->kind(stmt))
+        {
+        case Kind::ExprStmt: on_expr(block, flat_->expr(stmt)); return block;
+        case Kind::CompoundStmt: return on_items(block, flat_->items(stmt));
+        case Kind::IfStmt: return on_if(block, stmt);
+        case Kind::ReturnStmt:
+        {
+            seal(block);
+            auto const value = flat_->expr(stmt);
+            emit<Ret>(block, value != ast::NodeId::None ? on_expr(block, value) : nullptr);
+            block->fill();
+            return find_unfilled(block);
+        }
+        case Kind::NullStmt: return block;
+        default: REPORT_ICE("Unhandled statement");
+        }
     }
 
-    Inst* on_assign(Block* block, ast::Iden const* iden, ast::Expr const& rhs)
+    Inst* on_expr(Block* block, ast::NodeId expr)
     {
-        auto value = on_expr(block, rhs);
-        write_var(iden->referenced(), block, value);
-        return value;
+        using Kind = ast::FlatAst::Kind;
+        auto const first = static_cast<uint32_t>(flat_->first(expr));
+        auto const last = static_cast<uint32_t>(expr);
+
+        // Identifiers assigned to are written by their BinExpr rather than read
+        targets_.assign(last - first + 1, false);
+        for (auto i = first; i <= last; ++i)
+        {
+            auto const id = static_cast<ast::NodeId>(i);
+            if (flat_->kind(id) == Kind::BinExpr && !math_op(flat_->op(id)).has_value())
+            {
+                targets_[static_cast<uint32_t>(flat_->lhs(id)) - first] = true;
+            }
+        }
+
+        std::vector<Inst*> values;
+        auto const pop = [&] {
+            auto value = values.back();
+            values.pop_back();
+            return value;
+        };
+        for (auto i = first; i <= last; ++i)
+        {
+            auto const id = static_cast<ast::NodeId>(i);
+            switch (flat_->kind(id))
+            {
+            case Kind::Iden:
+                values.emplace_back(targets_[i - first] ? nullptr : read_variable(var(flat_->declaration(id)), block));
+                break;
+            case Kind::IntLiteral: values.emplace_back(emit<ConstInst>(block, flat_->value(id))); break;
+            case Kind::BinExpr:
+            {
+                auto rhs = pop();
+                auto lhs = pop();
+                auto const op = flat_->op(id);
+                if (auto const math = math_op(op))
+                {
+                    values.emplace_back(emit<MathInst>(block, *math, lhs, rhs));
+                    break;
+                }
+                assert(op == tokens::Punctuator::Equal);
+                auto const target = flat_->lhs(id);
+                assert(flat_->kind(target) == Kind::Iden);
+                write_var(var(flat_->declaration(target)), block, rhs);
+                values.emplace_back(rhs);
+                break;
+            }
+            case Kind::UnaryExpr:
+                assert(flat_->op(id) == tokens::Punctuator::Exclaim);
+                values.emplace_back(emit<Unary>(block, Opcode::LogicalNegate, pop()));
+                break;
+            default: REPORT_ICE("Unhandled expression evaluation");
+            }
+        }
+
+        assert(values.size() == 1);
+        return values.back();
     }
 
-    void on_decl(Block* block, ast::ObjDecl const& decl)
+    void on_decl(Block* block, ast::NodeId decl)
     {
-        if (decl.initalizer() == nullptr) return;
-        Inst* init = on_expr(block, *decl.initalizer());
-        write_var(decl.iden().referenced(), block, init);
+        auto const init = flat_->init(decl);
+        if (init == ast::NodeId::None) return;
+        write_var(var(decl), block, on_expr(block, init));
     }
 
-    Inst* read_variable(ast::ObjDecl const* var, Block* block)
+    Inst* read_variable(Var var, Block* block)
     {
         auto& values = current_defs.at(var);
         if (auto it = values.find(block); it != values.end())
@@ -275,7 +417,7 @@ private:
         return read_var_recursive(var, block);
     }
 
-    Inst* read_var_recursive(ast::ObjDecl const* var, Block* block)
+    Inst* read_var_recursive(Var var, Block* block)
     {
         Inst* value;
         if (!block->is_sealed())
@@ -300,9 +442,9 @@ private:
         return value;
     }
 
-    void write_var(ast::ObjDecl const* var, Block* block, Inst* value) { current_defs[var][block] = value; }
+    void write_var(Var var, Block* block, Inst* value) { current_defs[var][block] = value; }
 
-    Inst* add_phi_operands(Block* block, ast::ObjDecl const* var, Phi* phi)
+    Inst* add_phi_operands(Block* block, Var var, Phi* phi)
     {
         for (Block* pred : block->predecessors())
         {
@@ -355,12 +497,13 @@ private:
         }
     }
 
-    ast::FunctionDecl const& func_;
-    CFG cfg{ func_.iden().name() };
+    ast::FlatAst const* flat_{ nullptr };
+    std::vector<bool> targets_; // Scratch of the flat on_expr
+    CFG cfg;
     NameCounter names_;
 
-    std::unordered_map<Block*, std::unordered_map<ast::ObjDecl const*, Phi*>> incomplete_phis;
-    std::unordered_map<ast::ObjDecl const*, std::unordered_map<Block*, Inst*>> current_defs;
+    std::unordered_map<Block*, std::unordered_map<Var, Phi*>> incomplete_phis;
+    std::unordered_map<Var, std::unordered_map<Block*, Inst*>> current_defs;
 };
 
 std::vector<Inst*> CFG::users(Inst* inst) const
@@ -424,8 +567,14 @@ void CFG::phi_resolution()
 
 CFG CFG::construct(ast::FunctionDecl const& func)
 {
-    SSAGenerator gen(func);
-    return gen.construct();
+    SSAGenerator gen{ func.iden().name() };
+    return gen.construct(func.body().items());
+}
+
+CFG CFG::construct(ast::FlatAst const& ast, ast::NodeId func)
+{
+    SSAGenerator gen{ ast, Interner::global().text(ast.symbol(ast.iden(func))) };
+    return gen.construct(ast.items(ast.body(func)));
 }
 
 // Put blocks and jumps somehow on a single tape
@@ -444,6 +593,19 @@ CFG::~CFG()
     assert(std::all_of(blocks_.begin(), blocks_.end(), [](auto& b) { return b->is_sealed(); }));
 }
 
+CFG::Stats CFG::stats() const
+{
+    Stats stats;
+    stats.bytes = blocks_.capacity() * sizeof(blocks_[0]);
+    for (auto const& block : blocks_)
+    {
+        ++stats.blocks;
+        stats.insts += block->ins().size();
+        stats.bytes += block->bytes();
+    }
+    return stats;
+}
+
 void CFG::dumpCFG() const
 {
     auto filename = std::format(".cfg.{}.dot", name_);
@@ -1,5 +1,6 @@
 #pragma once
 #include "ast/ast.hpp"
+#include "ast/flat.hpp"
 #include "cfgGraph.fwd.hpp"
 #include "inst.hpp"
 
@@ -37,6 +38,18 @@ public:
     std::span<Block*> successors() { return successors_; }
     std::span<Block*> predecessors() { return predecessors_; }
     std::span<std::unique_ptr<Inst>> ins() { return ins_; }
+    std::span<std::unique_ptr<Inst> const> ins() const { return ins_; }
+
+    size_t bytes() const
+    {
+        auto bytes = sizeof(Block) + (successors_.capacity() + predecessors_.capacity()) * sizeof(Block*)
+                     + ins_.capacity() * sizeof(ins_[0]);
+        for (auto const& ins : ins_)
+        {
+            bytes += ins->bytes();
+        }
+        return bytes;
+    }
 
     bool is_sealed() const { return sealed_; }
     bool is_filled() const { return filled_; }
@@ -65,6 +78,7 @@ class CFG
 
 public:
     static CFG construct(ast::FunctionDecl const& func);
+    static CFG construct(ast::FlatAst const& ast, ast::NodeId func);
     explicit CFG(std::string_view name) : name_{ name } {}
 
     ~CFG();
@@ -77,6 +91,14 @@ public:
     std::string_view name() const { return name_; }
     std::vector<std::unique_ptr<Block>> const& blocks() const { return blocks_; }
 
+    struct Stats
+    {
+        size_t blocks{ 0 };
+        size_t insts{ 0 };
+        size_t bytes{ 0 }; // Blocks, their edge and instruction lists and the instructions
+    };
+    Stats stats() const;
+
     std::vector<Inst*> lower();
 
     // TODO this is in fact the 2nd type of IR, already lowered one 
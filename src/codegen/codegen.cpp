@@ -1,20 +1,82 @@
 #include "codegen.hpp"
+#include "ast/dfs.hpp"
+#include "ast/visit.hpp"
 #include "codegen/x86_64.hpp"
+#include <algorithm>
+#include <format>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace compiler::codegen
 {
+namespace
+{
+
+// Names used in expressions rather than declared. A function among them may have its address taken, which has to
+// stay distinct from that of every other function.
+std::unordered_set<Symbol> referenced_names(ast::TranslationUnit const& tu)
+{
+    std::unordered_set<Symbol> names;
+    std::unordered_set<ast::Node const*> declarators;
+    ast::dfs(tu,
+             [&](ast::Node const& node)
+             {
+                 switch (node.kind())
+                 {
+                 case ast::NodeKind::ObjDecl: declarators.insert(&static_cast<ast::ObjDecl const&>(node).iden()); break;
+                 case ast::NodeKind::FunctionDecl:
+                     declarators.insert(&static_cast<ast::FunctionDecl const&>(node).iden());
+                     break;
+                 case ast::NodeKind::Iden:
+                     if (!declarators.contains(&node)) names.insert(static_cast<ast::Iden const&>(node).symbol());
+                     break;
+                 default: break;
+                 }
+             });
+    return names;
+}
+
+} // namespace
 
 void Codegen::run()
 {
-    for (auto& func : tu_.items()->items())
+    if (flat_ != nullptr)
+    {
+        // Never aliases, so its output differs from the pointer tree's for duplicated functions
+        for (auto func : flat_->items())
+        {
+            assert(flat_->kind(func) == ast::FlatAst::Kind::FunctionDecl);
+            auto& cfg = cfgs_.emplace_back(codegen::CFG::construct(*flat_, func));
+            cfg.add_labels();
+        }
+    }
+    else
     {
-        auto d = func->decl();
-        assert(d);
-        auto* f = dynamic_cast<ast::FunctionDecl const*>(d);
-        assert(f);
-        auto& cfg = cfgs_.emplace_back(codegen::CFG::construct(*f));
-        cfg.add_labels();
+        auto const referenced = referenced_names(*tu_);
+        std::unordered_multimap<uint64_t, ast::FunctionDecl const*> generated;
+        for (auto& func : tu_->items()->items())
+        {
+            auto d = func->decl();
+            assert(d);
+            auto* f = ast::node_cast<ast::FunctionDecl>(*d);
+            assert(f);
+            // Equal hashes only make a match likely, the bodies decide
+            auto const [first, last] = generated.equal_range(f->hash());
+            auto const same
+                = std::find_if(first, last, [&](auto const& entry) { return f->same_structure(*entry.second); });
+            // An alias shares its address with the target, so neither may be taken
+            if (same != last && !referenced.contains(f->iden().symbol())
+                && !referenced.contains(same->second->iden().symbol()))
+            {
+                auto const exported = f->type().storage() != ast::Storage::Static;
+                aliases_.emplace_back(Alias{ f->iden().name(), same->second->iden().name(), exported });
+                continue;
+            }
+            generated.emplace(f->hash(), f);
+            auto& cfg = cfgs_.emplace_back(codegen::CFG::construct(*f));
+            cfg.add_labels();
+        }
     }
 
     std::stringstream ss;
@@ -22,4 +84,15 @@ void Codegen::run()
     asm_ = ss.str();
 }
 
+std::ostream& Codegen::assembly(std::ostream& os) const
+{
+    os << asm_;
+    for (auto const& alias : aliases_)
+    {
+        if (alias.exported) os << std::format(".globl {}\n", alias.name);
+        os << std::format(".set {}, {}\n", alias.name, alias.target);
+    }
+    return os;
+}
+
 } // namespace compiler::codegen
@@ -7,15 +7,27 @@ namespace compiler::codegen
 class Codegen
 {
 public:
-    explicit Codegen(ast::TranslationUnit const& tu) : tu_{ tu } {}
+    explicit Codegen(ast::TranslationUnit const& tu) : tu_{ &tu } {}
+    explicit Codegen(ast::FlatAst const& flat) : flat_{ &flat } {}
 
     void run();
-    std::ostream& assembly(std::ostream& os) const { return os << asm_; }
+    std::ostream& assembly(std::ostream& os) const;
     std::vector<codegen::CFG> const& ssa() const { return cfgs_; }
 
 private:
-    ast::TranslationUnit const& tu_;
+    // One of them
+    ast::TranslationUnit const* tu_{ nullptr };
+    ast::FlatAst const* flat_{ nullptr };
     std::vector<codegen::CFG> cfgs_;
+    // Functions structurally equal to an earlier one are not generated again but made its alias, unless the address of
+    // either is taken. The flat path generates every function.
+    struct Alias
+    {
+        std::string_view name;
+        std::string_view target;
+        bool exported; // Not static
+    };
+    std::vector<Alias> aliases_;
     std::string asm_;
 };
 
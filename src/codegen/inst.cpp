@@ -44,4 +44,21 @@ std::string ConstInst::to_string() const
     return std::format("{} {} = Cons({})", ::compiler::codegen::to_string(type()), format_inst_ref(this), value_);
 }
 
+size_t Inst::bytes() const
+{
+    // The opcode tells the class, except for a Nop which was whatever it replaced and is counted as a plain Inst
+    auto const size = [&]
+    {
+        switch (op_)
+        {
+        case Opcode::Constant: return sizeof(ConstInst);
+        case Opcode::Phi: return sizeof(Phi);
+        case Opcode::Upsilon: return sizeof(Upsilon);
+        case Opcode::Label: return sizeof(Label);
+        default: return sizeof(Inst);
+        }
+    }();
+    return size + args_.capacity() * sizeof(Inst*);
+}
+
 } // namespace compiler::codegen
@@ -105,6 +105,8 @@ public:
     }
 
     virtual std::string to_string() const;
+    // Heap bytes of the instruction and its operand list
+    size_t bytes() const;
 
 private:
     Opcode op_;
@@ -1,36 +1,231 @@
 #include "driver.hpp"
+#include "ast/dfs.hpp"
 #include "codegen/codegen.hpp"
+#include "lexer/chunked.hpp"
+#include "util/stopwatch.hpp"
+#include <array>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
 
 namespace compiler
 {
 
-void Driver::lexems()
+namespace
 {
-    Lexer lexer{ file_ };
 
-    for (auto tok = lexer.advance(); tok.tag != compiler::tokens::Tag::EoF; tok = lexer.advance())
+// Peak resident set size of the process so far
+size_t peak_rss_kb()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss); // KB on Linux
+}
+
+size_t node_size(ast::NodeKind kind)
+{
+    using ast::NodeKind;
+    switch (kind)
+    {
+    case NodeKind::BinExpr: return sizeof(ast::BinExpr);
+    case NodeKind::IntLiteral: return sizeof(ast::IntLiteral);
+    case NodeKind::Iden: return sizeof(ast::Iden);
+    case NodeKind::UnaryExpr: return sizeof(ast::UnaryExpr);
+    case NodeKind::ExprStmt: return sizeof(ast::ExprStmt);
+    case NodeKind::IfStmt: return sizeof(ast::IfStmt);
+    case NodeKind::CompoundStmt: return sizeof(ast::CompoundStmt);
+    case NodeKind::ReturnStmt: return sizeof(ast::ReturnStmt);
+    case NodeKind::NullStmt: return sizeof(ast::NullStmt);
+    case NodeKind::ObjDecl: return sizeof(ast::ObjDecl);
+    case NodeKind::FunctionDecl: return sizeof(ast::FunctionDecl);
+    case NodeKind::TypeDecl: return sizeof(ast::TypeDecl);
+    case NodeKind::Item: return sizeof(ast::Item);
+    case NodeKind::Items: return sizeof(ast::Items);
+    case NodeKind::TranslationUnit: return sizeof(ast::TranslationUnit);
+    }
+    return 0;
+}
+
+} // namespace
+
+File const& Driver::load(std::string const& filename)
+{
+    if (filename == "-")
+    {
+        stream_ = std::make_unique<Stream>(STDIN_FILENO, "<stdin>");
+        return stream_->file();
+    }
+
+    Stopwatch watch;
+    auto const& file = SourceManager::global().load(filename);
+    load_ms_ = watch.elapsed_ms();
+    return file;
+}
+
+tokens::Tape Driver::lex()
+{
+    Stopwatch watch;
+    if (stream_ == nullptr && !flags_.ast_cache.empty() && !flags_.lex)
+    {
+        // A hit leaves nothing to lex, the parser is never run on the empty tape
+        cached_ = cache_.load(file_, sema_);
+        cache_ms_ = watch.elapsed_ms();
+        bytes_ = file_.content.size();
+        if (cached())
+        {
+            peak_kb_.lex = peak_rss_kb();
+            return { file_.id, {}, {} };
+        }
+        watch = Stopwatch{};
+    }
+    if (stream_ == nullptr)
     {
+        auto tape = lex_chunked(file_, flags_.jobs);
+        lex_ms_ = watch.elapsed_ms();
+        bytes_ = file_.content.size();
+
+        Stopwatch preprocess_watch;
+        tape = preprocessor_.run(flags_.filename, file_, std::move(tape));
+        preprocess_ms_ = preprocess_watch.elapsed_ms();
+        peak_kb_.lex = peak_rss_kb();
+        return tape;
+    }
+
+    // Input from stdin is taken to be preprocessed already. Streamed bytes are gone once lexed, so tokens are printed
+    // as they come instead of from the tape
+    if (flags_.lex_only)
+    {
+        // Nothing is parsed, so neither the tokens nor the lines behind the window are kept
+        stream_->forget_lines();
+        Lexer{ *stream_ }.drain(
+            [](tokens::Token const& tok)
+            {
+                if (tok.tag != tokens::Tag::EoF) std::cout << tok.specific_format() << '\n';
+            });
+        lex_ms_ = watch.elapsed_ms();
+        bytes_ = stream_->consumed();
+        stream_.reset();
+        peak_kb_.lex = peak_rss_kb();
+        return { file_.id, {}, {} };
+    }
+    auto tape = Lexer{ *stream_ }.tape(
+        [&](tokens::Token const& tok)
+        {
+            if (flags_.lex && tok.tag != tokens::Tag::EoF) std::cout << tok.specific_format() << '\n';
+        });
+    lex_ms_ = watch.elapsed_ms();
+    bytes_ = stream_->consumed();
+    stream_.reset();
+    peak_kb_.lex = peak_rss_kb();
+    return tape;
+}
+
+void Driver::timings() const
+{
+    auto const backing = [&]
+    {
+        switch (file_.backing())
+        {
+        case File::Backing::Mapped: return "mmap";
+        case File::Backing::Buffered: return "read";
+        case File::Backing::Streamed: return "stream";
+        }
+        return "";
+    }();
+    auto const mb_per_s = static_cast<double>(bytes_) / 1e3 / lex_ms_;
+    std::cerr << std::format("load: {:.3f} ms ({}, {} bytes)\n", load_ms_, backing, bytes_);
+    if (!flags_.ast_cache.empty())
+    {
+        std::cerr << std::format("cache: {:.3f} ms ({})\n", cache_ms_, cached() ? "hit" : "miss");
+    }
+    if (cached()) return;
+    std::cerr << std::format("lex: {:.3f} ms ({} tokens, {:.1f} MB/s)\n", lex_ms_, tape_.size() - 1, mb_per_s);
+    auto const& pp = preprocessor_.stats();
+    std::cerr << std::format("preprocess: {:.3f} ms ({} files lexed, {} includes replayed, {} skipped, {} expanded)\n",
+                             preprocess_ms_, pp.files_lexed, pp.includes_replayed, pp.includes_skipped, pp.expansions);
+    std::cerr << std::format("parse: {:.3f} ms\n", parse_ms_);
+}
+
+void Driver::lexems() const
+{
+    for (auto& tok : tape_.tokens)
+    {
+        if (tok.tag == tokens::Tag::EoF) break;
         std::cout << tok.specific_format() << '\n';
     }
 }
 
 void Driver::compile()
 {
-    if (flags_.lex)
+    if (flags_.lex && file_.backing() != File::Backing::Streamed)
     {
         lexems();
     }
+    if (flags_.lex_only) return;
 
-    auto tu = parser_.parse();
+    ast::Ptr<ast::TranslationUnit> tu{ nullptr };
+    ast::FlatAst flat;
+    if (cached())
+    {
+        flat = std::move(*cached_);
+        // The flat path only needs the pointer tree to dump it
+        if (!flags_.flat_ast || flags_.parse || flags_.ast_graph)
+        {
+            Stopwatch tree_watch;
+            tu = flat.tree(ast_, file_.loc(0));
+            cache_ms_ += tree_watch.elapsed_ms();
+        }
+    }
+    else
+    {
+        Stopwatch parse_watch;
+        tu = parser_.parse();
+        parse_ms_ = parse_watch.elapsed_ms();
+        // A hit skips the preprocessor, the lexer and the parser, so whatever they reported would not be reported again
+        if (!flags_.ast_cache.empty() && file_.backing() != File::Backing::Streamed && !Loc::has_diagnostic())
+        {
+            flat = ast::FlatAst::flatten(*tu);
+            cache_.store(file_, flat, preprocessor_.dependencies(), preprocessor_.absent());
+        }
+    }
+    peak_kb_.parse = peak_rss_kb();
+    if (flags_.time)
+    {
+        timings();
+    }
     if (flags_.parse)
     {
         tu->dump();
     }
-    analyze(*tu);
-    if (!success()) return;
+    if (flags_.ast_graph)
+    {
+        graph(*tu);
+    }
+    if (flags_.flat_ast)
+    {
+        if (flat.size() == 0) flat = ast::FlatAst::flatten(*tu);
+        flat.check(sema_);
+    }
+    else
+    {
+        analyze(*tu);
+    }
+    peak_kb_.check = peak_rss_kb();
+    if (!success())
+    {
+        if (flags_.stats) stats(tu, flat, nullptr);
+        return;
+    }
 
-    codegen::Codegen codegen{ *tu };
+    auto codegen = flags_.flat_ast ? codegen::Codegen{ flat } : codegen::Codegen{ *tu };
     codegen.run();
+    peak_kb_.codegen = peak_rss_kb();
+    if (flags_.stats)
+    {
+        stats(tu, flat, &codegen);
+    }
     if (flags_.ssa)
     {
         for (auto& cfg : codegen.ssa())
@@ -42,11 +237,68 @@ void Driver::compile()
     {
         codegen.assembly(std::cout);
     }
-     
 }
 
 void Driver::analyze(ast::TranslationUnit& tu) { tu.check(sema_); }
 
+void Driver::stats(ast::TranslationUnit const* tu, ast::FlatAst const& flat, codegen::Codegen const* codegen) const
+{
+    auto const token_bytes = tape_.tokens.capacity() * sizeof(tokens::Token);
+    auto const literal_bytes = tape_.literals.capacity() * sizeof(int64_t);
+    std::cerr << std::format("tokens: {} ({} bytes), literals: {} ({} bytes)\n", tape_.tokens.size(), token_bytes,
+                             tape_.literals.size(), literal_bytes);
+
+    auto const arena = ast_.stats();
+    std::cerr << std::format("ast: {} nodes, {} lists, {} bytes in {} blocks\n", arena.nodes, arena.lists,
+                             arena.bytes, arena.blocks);
+    if (tu != nullptr)
+    {
+        constexpr auto kinds = static_cast<size_t>(ast::NodeKind::TranslationUnit) + 1;
+        std::array<size_t, kinds> counts{};
+        ast::dfs(*tu, [&](ast::Node const& node) { ++counts[static_cast<size_t>(node.kind())]; });
+        for (size_t i = 0; i < kinds; ++i)
+        {
+            if (counts[i] == 0) continue;
+            auto const kind = static_cast<ast::NodeKind>(i);
+            std::cerr << std::format("  {}: {} ({} bytes)\n", ast::to_string(kind), counts[i],
+                                     counts[i] * node_size(kind));
+        }
+    }
+    if (flat.size() != 0)
+    {
+        std::cerr << std::format("flat ast: {} rows ({} bytes)\n", flat.size(), flat.bytes());
+    }
+    std::cerr << std::format("types: {}\n", sema_.types().size());
+
+    if (codegen != nullptr)
+    {
+        for (auto const& cfg : codegen->ssa())
+        {
+            auto const cfg_stats = cfg.stats();
+            std::cerr << std::format("cfg {}: {} blocks, {} insts ({} bytes)\n", cfg.name(), cfg_stats.blocks,
+                                     cfg_stats.insts, cfg_stats.bytes);
+        }
+    }
+
+    std::cerr << std::format("peak rss: lex {} KB, parse {} KB, check {} KB", peak_kb_.lex, peak_kb_.parse,
+                             peak_kb_.check);
+    if (codegen != nullptr) std::cerr << std::format(", codegen {} KB", peak_kb_.codegen);
+    std::cerr << '\n';
+}
+
+void Driver::graph(ast::TranslationUnit const& tu) const
+{
+    auto const filename = std::format(".ast.{}.dot", std::filesystem::path{ file_.name }.filename().string());
+    std::ofstream file(filename, std::ios::out);
+    if (!file.is_open())
+    {
+        std::cerr << "Cannot write " << filename << '\n';
+        return;
+    }
+    ast::GraphAdapter adapter{ tu, flags_.ast_graph_limits };
+    graph::GraphWriter<ast::GraphAdapter>::dump(file, adapter);
+}
+
 bool Driver::success() const { return !Loc::has_error(); }
 
 } // namespace compiler
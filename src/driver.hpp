@@ -1,35 +1,91 @@
 #pragma once
+#include "ast/astGraph.hpp"
+#include "ast/cache.hpp"
+#include "ast/flat.hpp"
 #include "ast/parser.hpp"
 #include "ast/sema.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/preprocessor.hpp"
 
 namespace compiler
 {
 
+namespace codegen
+{
+class Codegen;
+} // namespace codegen
+
 struct Flags
 {
-    std::string filename;
+    std::string filename; // "-" reads the source from stdin
     bool lex{ false };
+    bool lex_only{ false }; // Stop once the tokens are printed
     bool parse{ false };
     bool ssa{ false };
     bool compile {true};
+    bool time{ false };
+    bool stats{ false }; // Memory used by each phase
+    bool flat_ast{ false }; // Check and generate code from the FlatAst
+    bool ast_graph{ false }; // Write the AST as a DOT graph
+    ast::GraphLimits ast_graph_limits;
+    size_t jobs{ 1 }; // Threads for lexing and for parsing function bodies
+    std::vector<std::filesystem::path> include_dirs;
+    std::filesystem::path ast_cache; // Directory of parsed ASTs, empty disables the cache
 };
 
 // TODO redesign (design lol!)
 class Driver
 {
 public:
-    explicit Driver(Flags const& flag) : flags_{ flag }, file_{ flag.filename }, parser_{ file_, sema_ } {}
+    explicit Driver(Flags const& flag) :
+        flags_{ flag },
+        preprocessor_{ flag.include_dirs },
+        cache_{ flag.ast_cache, flag.filename, flag.include_dirs },
+        file_{ load(flag.filename) },
+        tape_{ lex() },
+        parser_{ tape_, sema_, ast_, flag.jobs }
+    {
+    }
 
     void compile();
     bool success() const;
 
 private:
-    void lexems();
+    File const& load(std::string const& filename);
+    tokens::Tape lex();
+    void lexems() const;
+    void timings() const;
     void analyze(ast::TranslationUnit& tu);
+    void graph(ast::TranslationUnit const& tu) const;
+    void stats(ast::TranslationUnit const* tu, ast::FlatAst const& flat, codegen::Codegen const* codegen) const;
+    bool cached() const { return cached_.has_value(); }
 
     Flags const flags_;
-    File const file_;
+    // Phase timings, load and lex are filled while file_ and tape_ are initialized so keep them declared first
+    double load_ms_{ 0 };
+    double lex_ms_{ 0 };
+    double preprocess_ms_{ 0 };
+    double parse_ms_{ 0 };
+    double cache_ms_{ 0 };
+    size_t bytes_{ 0 };
+    // Peak resident set size in KB by the end of each phase, for --stats
+    struct
+    {
+        size_t lex{ 0 };
+        size_t parse{ 0 };
+        size_t check{ 0 };
+        size_t codegen{ 0 };
+    } peak_kb_;
+    Preprocessor preprocessor_;
+    ast::AstCache cache_;
+    // Loading from the cache makes types, so sema_ comes before tape_ as well
     Sema sema_;
+    std::optional<ast::FlatAst> cached_;
+    // Only set while stdin is being lexed
+    std::unique_ptr<Stream> stream_;
+    File const& file_;
+    tokens::Tape const tape_;
+    ast::AstContext ast_;
     Parser parser_;
 };
 
@@ -1,31 +1,315 @@
 #include "file.hpp"
-#include <fstream>
+#include "lexer/scan.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace compiler
 {
 namespace
 {
 
-std::string load_file(std::filesystem::path const& path)
+// Below a page the mapping setup costs more than just copying the bytes
+constexpr size_t mmap_threshold = 4096;
+constexpr size_t read_chunk = 64 * 1024;
+
+[[noreturn]] void fail(std::filesystem::path const& path, std::string_view what)
+{
+    std::cerr << "compiler error: " << what << ": " << path.string() << '\n';
+    exit(1);
+}
+
+class Descriptor
 {
-    std::stringstream contents;
-    std::ifstream file{ path };
-    if(!file.is_open())
+public:
+    explicit Descriptor(int fd) : fd_{ fd } {}
+    ~Descriptor()
+    {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    Descriptor(Descriptor const&) = delete;
+    Descriptor& operator=(Descriptor const&) = delete;
+
+    int get() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+void read_all(std::filesystem::path const& path, int fd, size_t size_hint, std::vector<char>& buffer)
+{
+    buffer.resize(std::max(size_hint, read_chunk));
+    size_t filled{ 0 };
+    while (true)
+    {
+        if (filled == buffer.size()) buffer.resize(buffer.size() * 2);
+
+        auto const got = ::read(fd, buffer.data() + filled, buffer.size() - filled);
+        if (got == 0) break;
+        if (got < 0)
         {
-            std::cerr << "compiler error: file not found\n";
-            exit(1);
+            if (errno == EINTR) continue;
+            fail(path, "read failed");
         }
-    contents << file.rdbuf();
-    return contents.str();
+        filled += static_cast<size_t>(got);
+    }
+    buffer.resize(filled);
 }
 
 } // namespace
 
-File::File(std::filesystem::path const& path) :
-    name{ path.filename() },
-    content{ load_file(path) }
+File::File(std::filesystem::path const& path, FileId file_id) :
+    id{ file_id },
+    name{ path.filename() }
+{
+    Descriptor fd{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd.get() < 0)
+    {
+        fail(path, "file not found");
+    }
+
+    struct stat st{};
+    if (::fstat(fd.get(), &st) != 0)
+    {
+        fail(path, "cannot stat file");
+    }
+
+    auto const size = static_cast<size_t>(st.st_size);
+    if (S_ISREG(st.st_mode) && size >= mmap_threshold)
+    {
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+        if (mapped != MAP_FAILED)
+        {
+            ::madvise(mapped, size, MADV_SEQUENTIAL);
+            backing_ = Backing::Mapped;
+            mapping_ = mapped;
+            mapped_size_ = size;
+            content = { static_cast<char const*>(mapped), size };
+            return;
+        }
+    }
+
+    read_all(path, fd.get(), S_ISREG(st.st_mode) ? size : 0, buffer_);
+    content = { buffer_.data(), buffer_.size() };
+}
+
+File::File(std::string stream_name, FileId file_id) :
+    id{ file_id },
+    name{ std::move(stream_name) },
+    backing_{ Backing::Streamed }
+{
+    line_starts_.emplace_back(0);
+}
+
+File::File(std::string buffer_name, std::string_view text, FileId file_id) :
+    id{ file_id },
+    name{ std::move(buffer_name) },
+    buffer_(text.begin(), text.end())
+{
+    content = { buffer_.data(), buffer_.size() };
+}
+
+File::File(std::string buffer_name, size_t capacity, FileId file_id) :
+    id{ file_id },
+    name{ std::move(buffer_name) },
+    growing_{ true }
+{
+    buffer_.reserve(capacity);
+    content = { buffer_.data(), 0 };
+    line_starts_.emplace_back(0);
+}
+
+File::~File()
+{
+    if (mapping_ != nullptr)
+    {
+        ::munmap(mapping_, mapped_size_);
+    }
+}
+
+// Streamed and growing files collect their line starts as the bytes arrive
+void File::index_lines() const
+{
+    if (backing_ == Backing::Streamed || growing_) return;
+    line_starts_.emplace_back(0);
+    scan::line_starts(content, line_starts_);
+}
+
+void File::add_lines(std::string_view block, size_t offset)
+{
+    auto const first = line_starts_.size();
+    scan::line_starts(block, line_starts_);
+    for (auto i = first; i < line_starts_.size(); ++i)
+    {
+        line_starts_[i] += static_cast<uint32_t>(offset);
+    }
+}
+
+void File::drop_lines(size_t offset)
+{
+    auto const line = std::prev(std::upper_bound(line_starts_.begin(), line_starts_.end(), offset));
+    dropped_lines_ += static_cast<size_t>(std::distance(line_starts_.begin(), line));
+    line_starts_.erase(line_starts_.begin(), line);
+}
+
+size_t File::append(std::string_view text)
+{
+    assert(growing_ && text.size() <= room());
+    auto const offset = buffer_.size();
+    buffer_.insert(buffer_.end(), text.begin(), text.end());
+    content = { buffer_.data(), buffer_.size() };
+    add_lines(text, offset);
+    return offset;
+}
+
+void File::replace(size_t offset, size_t removed, std::string_view text)
+{
+    assert(backing_ == Backing::Buffered && mapping_ == nullptr && !growing_);
+    assert(offset + removed <= buffer_.size());
+    // Indexed from the text before the edit, which is kept up to date below
+    std::call_once(indexed_, [this] { index_lines(); });
+
+    // The bytes after the edit move once, and not at all if the size stays
+    auto const at = buffer_.begin() + static_cast<std::ptrdiff_t>(offset);
+    if (text.size() > removed)
+    {
+        buffer_.insert(at + static_cast<std::ptrdiff_t>(removed), text.begin() + removed, text.end());
+    }
+    else
+    {
+        buffer_.erase(at + static_cast<std::ptrdiff_t>(text.size()), at + static_cast<std::ptrdiff_t>(removed));
+    }
+    std::copy_n(text.begin(), std::min(text.size(), removed), buffer_.begin() + static_cast<std::ptrdiff_t>(offset));
+    content = { buffer_.data(), buffer_.size() };
+
+    // The lines starting within the removed bytes go, those of `text` come in and the later ones move along
+    auto const first = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);
+    auto const last = std::upper_bound(first, line_starts_.end(), offset + removed);
+    auto const delta = static_cast<uint32_t>(text.size() - removed);
+    if (delta != 0)
+    {
+        for (auto it = last; it != line_starts_.end(); ++it)
+        {
+            *it += delta;
+        }
+    }
+    std::vector<uint32_t> added;
+    scan::line_starts(text, added);
+    for (auto& start : added)
+    {
+        start += static_cast<uint32_t>(offset);
+    }
+    line_starts_.insert(line_starts_.erase(first, last), added.begin(), added.end());
+}
+
+std::string_view File::text(size_t offset, size_t length) const
+{
+    if (offset < window_base_ || offset + length > window_base_ + content.size()) return {};
+    return content.substr(offset - window_base_, length);
+}
+
+File::Position File::position(size_t offset) const
+{
+    std::call_once(indexed_, [this] { index_lines(); });
+
+    auto const next_line = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);
+    assert(next_line != line_starts_.begin() && "Line of the offset was dropped");
+    auto const row = dropped_lines_ + static_cast<size_t>(std::distance(line_starts_.begin(), next_line));
+    return Position{ row, offset - *std::prev(next_line) + 1 };
+}
+
+Stream::Stream(int fd, std::string name, size_t capacity) :
+    file_{ SourceManager::global().open_stream(std::move(name)) },
+    fd_{ fd },
+    buffer_(capacity)
+{
+}
+
+// The bytes go away with the buffer, tokens of the file keep their offsets but lose their spelling
+Stream::~Stream()
+{
+    file_.content = {};
+    file_.window_base_ = consumed();
+}
+
+bool Stream::refill(size_t keep)
+{
+    if (exhausted_) return false;
+
+    auto const dropped = keep - base_;
+    std::memmove(buffer_.data(), buffer_.data() + dropped, size_ - dropped);
+    size_ -= dropped;
+    base_ = keep;
+    if (!keep_lines_) file_.drop_lines(base_);
+    if (size_ == buffer_.size()) buffer_.resize(buffer_.size() * 2);
+
+    ssize_t got;
+    do
+    {
+        got = ::read(fd_, buffer_.data() + size_, buffer_.size() - size_);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0) fail(file_.name, "read failed");
+
+    auto const block = std::string_view{ buffer_.data() + size_, static_cast<size_t>(got) };
+    file_.add_lines(block, base_ + size_);
+    size_ += block.size();
+    file_.content = window();
+    file_.window_base_ = base_;
+    exhausted_ = got == 0;
+    return !exhausted_;
+}
+
+SourceManager& SourceManager::global()
+{
+    static SourceManager manager;
+    return manager;
+}
+
+FileId SourceManager::next_id(std::filesystem::path const& path) const
+{
+    if (files_.size() >= max_files)
+    {
+        fail(path, std::format("more than {} source files", max_files));
+    }
+    return static_cast<FileId>(files_.size());
+}
+
+File const& SourceManager::load(std::filesystem::path const& path)
+{
+    auto const id = next_id(path);
+    return *files_.emplace_back(std::make_unique<File>(path, id));
+}
+
+File& SourceManager::open_stream(std::string name)
+{
+    auto const id = next_id(name);
+    return *files_.emplace_back(std::make_unique<File>(std::move(name), id));
+}
+
+File const& SourceManager::add_buffer(std::string name, std::string_view text)
+{
+    auto const id = next_id(name);
+    return *files_.emplace_back(std::make_unique<File>(std::move(name), text, id));
+}
+
+File& SourceManager::add_growing(std::string name, size_t capacity)
+{
+    auto const id = next_id(name);
+    return *files_.emplace_back(std::make_unique<File>(std::move(name), capacity, id));
+}
+
+File& SourceManager::add_editable(std::string name, std::string_view text)
 {
+    auto const id = next_id(name);
+    return *files_.emplace_back(std::make_unique<File>(std::move(name), text, id));
 }
 
 } // namespace compiler
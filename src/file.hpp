@@ -1,15 +1,151 @@
 #pragma once
+#include "loc.hpp"
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
 
-namespace compiler 
+namespace compiler
 {
-    
-struct File 
+
+using FileId = uint32_t;
+
+// Source bytes of a single input. Regular files big enough to amortize the mapping are mmap'ed read-only,
+// everything else (pipes, character devices, tiny files) is read(2) into an owned buffer. Either way the
+// lexer only ever sees `content`, a view into the backing storage. Streamed input is the exception: a Stream
+// feeds it piecewise and `content` is only the window the Stream currently holds.
+class File
 {
-    explicit File(std::filesystem::path const& path);
+    friend class Stream;
+
+public:
+    enum class Backing : uint8_t
+    {
+        Mapped,
+        Buffered,
+        Streamed,
+    };
+
+    File(std::filesystem::path const& path, FileId id);
+    File(std::string stream_name, FileId id);
+    // In memory text, e.g. an editor buffer
+    File(std::string buffer_name, std::string_view text, FileId id);
+    // Empty text that grows by append() up to `capacity`, which is reserved up front so `content` never moves
+    File(std::string buffer_name, size_t capacity, FileId id);
+    ~File();
+
+    File(File const&) = delete;
+    File& operator=(File const&) = delete;
+
+    struct Position
+    {
+        size_t row;
+        size_t column;
+    };
+
+    Backing backing() const { return backing_; }
 
+    // Spelling of [offset, offset + length), empty if those bytes are not held anymore (streamed input)
+    std::string_view text(size_t offset, size_t length) const;
+
+    Loc loc(size_t offset) const { return Loc{ id, static_cast<uint32_t>(offset) }; }
+
+    // 1 based row and column of a byte offset. The table of line starts is only built by the first call, which
+    // normally means the first diagnostic.
+    Position position(size_t offset) const;
+
+    // Bytes append() still takes
+    size_t room() const { return buffer_.capacity() - buffer_.size(); }
+    // Adds `text` at the end and returns its offset, the text has to fit into room()
+    size_t append(std::string_view text);
+    // Replaces the bytes [offset, offset + removed) of an in memory buffer by `text`. The id stays, so tokens and
+    // locations past the edit are off by the size change until they are relexed.
+    void replace(size_t offset, size_t removed, std::string_view text);
+
+    FileId id;
     std::string name;
-    std::string content;
+    std::string_view content;
+
+private:
+    void index_lines() const;
+    void add_lines(std::string_view block, size_t offset);
+    // Forgets the starts of the lines before the one holding `offset`, their rows stay counted
+    void drop_lines(size_t offset);
+
+    Backing backing_{ Backing::Buffered };
+    size_t window_base_{ 0 };
+    void* mapping_{ nullptr };
+    size_t mapped_size_{ 0 };
+    std::vector<char> buffer_;
+    mutable std::once_flag indexed_;
+    mutable std::vector<uint32_t> line_starts_;
+    size_t dropped_lines_{ 0 };
+    bool growing_{ false }; // Collects its line starts in append()
+};
+
+// Incremental reader for input that should not be held whole, stdin or a pipe fed by a code generator. One buffer
+// holds the window the lexer works on: refill() drops everything before the first byte still needed, moves the rest
+// to the front and tops the buffer up. The window stays contiguous, so the DFMA and the SIMD scans run on it
+// unchanged, and the buffer only grows when a single token does not fit. The descriptor is not owned.
+class Stream
+{
+public:
+    static constexpr size_t default_capacity = 64 * 1024;
+
+    Stream(int fd, std::string name, size_t capacity = default_capacity);
+    ~Stream();
+
+    Stream(Stream const&) = delete;
+    Stream& operator=(Stream const&) = delete;
+
+    File const& file() const { return file_; }
+    std::string_view window() const { return { buffer_.data(), size_ }; }
+    // Offset of the first byte of window() in the whole input
+    size_t base() const { return base_; }
+    size_t consumed() const { return base_ + size_; }
+    size_t capacity() const { return buffer_.size(); }
+
+    // Drops the window up to `keep` and reads more input. False once the input is exhausted.
+    bool refill(size_t keep);
+    // Only the window can be reported on from now on, so the starts of the lines before it are dropped as well
+    void forget_lines() { keep_lines_ = false; }
+
+private:
+    File& file_;
+    int fd_;
+    std::vector<char> buffer_;
+    size_t size_{ 0 };
+    size_t base_{ 0 };
+    bool exhausted_{ false };
+    bool keep_lines_{ true };
+};
+
+// Owns every loaded File for the lifetime of the compilation, so tokens and locations can refer to sources through a
+// FileId alone
+class SourceManager
+{
+public:
+    // Tokens carry the FileId of their source in 16 bits
+    static constexpr size_t max_files = size_t{ 1 } << 16;
+
+    static SourceManager& global();
+
+    File const& load(std::filesystem::path const& path);
+    // Registers an input read through a Stream
+    File& open_stream(std::string name);
+    File const& add_buffer(std::string name, std::string_view text);
+    File& add_growing(std::string name, size_t capacity);
+    // In memory text which is edited in place by File::replace, e.g. the buffer of an open editor
+    File& add_editable(std::string name, std::string_view text);
+    File const& file(FileId id) const { return *files_[id]; }
+
+private:
+    FileId next_id(std::filesystem::path const& path) const;
+
+    std::vector<std::unique_ptr<File>> files_;
 };
 
 }
@@ -1,5 +1,9 @@
 #pragma once
 #include <format>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <string_view>
 
 namespace compiler::graph
 {
@@ -16,52 +20,89 @@ struct Vertex
     std::string label;
 };
 
+// Graph handed over as whole ranges of vertices and edges
 template <typename T>
-concept GraphAdapter = requires(const T& t) {
+concept RangeAdapter = requires(const T& t) {
     { t.name() } -> std::convertible_to<std::string>;
     { t.vertices() } -> std::ranges::range;
     { t.edges() } -> std::ranges::range;
 };
 
-template <GraphAdapter Adapter> class GraphWriter
+// Graph produced while it is written: stream() calls vertex(idx, label) and edge(from, to) as it goes, so nothing
+// has to be held at once
+template <typename T>
+concept StreamAdapter = requires(const T& t, void (*vertex)(size_t, std::string_view), void (*edge)(size_t, size_t)) {
+    { t.name() } -> std::convertible_to<std::string>;
+    t.stream(vertex, edge);
+};
+
+template <typename T>
+concept GraphAdapter = RangeAdapter<T> || StreamAdapter<T>;
+
+// Collects formatted output and passes it on to the stream in large writes
+class Sink
 {
 public:
-    static void dump(std::ostream& os, Adapter const& graph)
+    explicit Sink(std::ostream& os) : os_{ os } { buffer_.reserve(capacity + capacity / 4); }
+    ~Sink() { flush(); }
+
+    Sink(Sink const&) = delete;
+    Sink& operator=(Sink const&) = delete;
+
+    template <typename... Args> void print(std::format_string<Args...> fmt, Args&&... args)
+    {
+        std::format_to(std::back_inserter(buffer_), fmt, std::forward<Args>(args)...);
+        if (buffer_.size() >= capacity) flush();
+    }
+
+    void flush()
     {
-        os << std::format("digraph {}", graph.name()) << " {" << endline << graph_opts << endline << node_opts
-           << endline << verticies(graph.vertices()) << endline << edges(graph.edges()) << "\n}\n";
+        os_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
     }
 
 private:
-    static constexpr std::string_view endline = "\n\t";
-    static constexpr std::string_view graph_opts = "graph [fontname=\"Helvetica\", rankdir=TB]";
-    static constexpr std::string_view node_opts
-        = "node [shape=record, fontsize=10, style=filled, fillcolor=lightyellow]";
+    static constexpr size_t capacity = 64 * 1024;
 
-    template <typename Range>
-    static std::string verticies(Range const& verticies)
+    std::ostream& os_;
+    std::string buffer_;
+};
+
+template <GraphAdapter Adapter> class GraphWriter
+{
+public:
+    static void dump(std::ostream& os, Adapter const& graph)
     {
-        std::string res;
+        Sink sink{ os };
+        sink.print("digraph {} {{{}{}{}{}{}", graph.name(), endline, graph_opts, endline, node_opts, endline);
+        auto const vertex = [&](size_t idx, std::string_view label)
+        { sink.print("{} [label=\"{}\"]{}", idx, label, endline); };
+        auto const edge = [&](size_t from, size_t to) { sink.print("{} -> {}{}", from, to, endline); };
 
-        for (auto& [idx, label] : verticies)
+        if constexpr (StreamAdapter<Adapter>)
         {
-            res += std::format("{} [label=\"{}\"]", idx, label);
-            res += "\n\t";
+            graph.stream(vertex, edge);
         }
-
-        return res;
-    }
-
-    template <typename Range>
-    static std::string edges(Range const& edges)
-    {
-        std::string res;
-        for (auto& [from, to] : edges)
+        else
         {
-            res += std::format("{} -> {}\n\t", from, to);
+            for (auto& [idx, label] : graph.vertices())
+            {
+                vertex(idx, label);
+            }
+            sink.print("{}", endline);
+            for (auto& [from, to] : graph.edges())
+            {
+                edge(from, to);
+            }
         }
-        return res;
+        sink.print("\n}}\n");
     }
+
+private:
+    static constexpr std::string_view endline = "\n\t";
+    static constexpr std::string_view graph_opts = "graph [fontname=\"Helvetica\", rankdir=TB]";
+    static constexpr std::string_view node_opts
+        = "node [shape=record, fontsize=10, style=filled, fillcolor=lightyellow]";
 };
 
 } // namespace compiler::graph
@@ -1,8 +1,9 @@
 #pragma once
 #include "util/underlying.hpp"
 #include <array>
+#include <cstddef>
 #include <cstdint>
-#include <limits>
+#include <utility>
 
 namespace compiler
 {
@@ -58,12 +59,30 @@ enum class DFMAState : uint8_t
     AmpersandEqual,      // &=
     CaretEqual,          // ^=
     PipeEqual = 48,      // |=
+    Comma,               // ,
+    Hash,                // #
+    HashHash,            // ##
 
     Whitespace,
     Integer,
     Identifier,
 
     DotDot,
+
+    // Comments, consumed by the lexer without producing a token. A backslash-newline is taken as a comment too.
+    LineSplice,
+    LineComment,
+    BlockComment,
+    BlockCommentStar,
+    Comment,
+
+    // String and character literals
+    StringBody,
+    StringEscape,
+    StringLiteral,
+    CharBody,
+    CharEscape,
+    CharLiteral,
     _Count
 };
 
@@ -118,6 +137,13 @@ constexpr bool is_final(DFMAState state)
         case DFMAState::AmpersandEqual:
         case DFMAState::CaretEqual:
         case DFMAState::PipeEqual:
+        case DFMAState::Comma:
+        case DFMAState::Hash:
+        case DFMAState::HashHash:
+        case DFMAState::LineComment:
+        case DFMAState::Comment:
+        case DFMAState::StringLiteral:
+        case DFMAState::CharLiteral:
             return true;
         default:
             break;
@@ -125,11 +151,22 @@ constexpr bool is_final(DFMAState state)
     return false;
 }
 
+constexpr bool is_comment(DFMAState state)
+{
+    return state == DFMAState::LineComment || state == DFMAState::Comment;
+}
+
+// Token a state stands for, Error for the states which do not end a token
+constexpr DFMAState accepted(DFMAState state)
+{
+    return is_final(state) ? state : DFMAState::Error;
+}
+
+// Reference automaton, a full states x bytes matrix written the way the language reads. It is only ever used at
+// compile time to derive CompactDFMA below.
 class DFMATable
 {
-    using Storage
-        = std::array<std::array<DFMAState, std::numeric_limits<char>::max()>,
-                     to_underlying(DFMAState::_Count)>;
+    using Storage = std::array<std::array<DFMAState, 256>, to_underlying(DFMAState::_Count)>;
 
 public:
     consteval DFMATable()
@@ -138,11 +175,13 @@ public:
         fill_identifiers();
         fill_punctuators();
         fill_constants();
+        fill_comments();
+        fill_literals();
     }
 
-    constexpr DFMAState operator()(DFMAState state, char c) const
+    constexpr DFMAState operator()(DFMAState state, uint8_t c) const
     {
-        return storage_.at(to_underlying(state)).at(c);
+        return storage_[to_underlying(state)][c];
     }
 
 private:
@@ -157,7 +196,12 @@ private:
     consteval void fill_constants()
     {
         fill(DFMAState::Initial, '0', '9', DFMAState::Integer);
+        // Like a preprocessing number the spelling runs over letters as well, prefix, digits and suffix are split
+        // and checked by literal::parse_integer
         fill(DFMAState::Integer, '0', '9', DFMAState::Integer);
+        fill(DFMAState::Integer, 'a', 'z', DFMAState::Integer);
+        fill(DFMAState::Integer, 'A', 'Z', DFMAState::Integer);
+        fill(DFMAState::Integer, '_', DFMAState::Integer);
     }
 
     consteval void fill_punctuators()
@@ -234,6 +278,45 @@ private:
         // Ellipsis (...)
         fill(DFMAState::Dot, '.', DFMAState::DotDot);
         fill(DFMAState::DotDot, '.', DFMAState::Ellipsis);
+
+        fill(DFMAState::Initial, ',', DFMAState::Comma);
+
+        // Preprocessing operators, left in the tape for the Preprocessor
+        fill(DFMAState::Initial, '#', DFMAState::Hash);
+        fill(DFMAState::Hash, '#', DFMAState::HashHash);
+    }
+
+    // Bodies loop on themselves, the lexer skips over those runs in bulk
+    consteval void fill_comments()
+    {
+        fill(DFMAState::Initial, '\\', DFMAState::LineSplice);
+        fill(DFMAState::LineSplice, '\n', DFMAState::Comment);
+
+        fill(DFMAState::Slash, '/', DFMAState::LineComment);
+        fill_except(DFMAState::LineComment, { '\n' }, DFMAState::LineComment);
+
+        fill(DFMAState::Slash, '*', DFMAState::BlockComment);
+        fill_except(DFMAState::BlockComment, { '*' }, DFMAState::BlockComment);
+        fill(DFMAState::BlockComment, '*', DFMAState::BlockCommentStar);
+        fill_except(DFMAState::BlockCommentStar, { '*', '/' }, DFMAState::BlockComment);
+        fill(DFMAState::BlockCommentStar, '*', DFMAState::BlockCommentStar);
+        fill(DFMAState::BlockCommentStar, '/', DFMAState::Comment);
+    }
+
+    // Any escaped byte is taken, the lexer validates character constants once their extent is known
+    consteval void fill_literals()
+    {
+        fill(DFMAState::Initial, '"', DFMAState::StringBody);
+        fill_except(DFMAState::StringBody, { '"', '\\', '\n' }, DFMAState::StringBody);
+        fill(DFMAState::StringBody, '\\', DFMAState::StringEscape);
+        fill_except(DFMAState::StringEscape, { '\n' }, DFMAState::StringBody);
+        fill(DFMAState::StringBody, '"', DFMAState::StringLiteral);
+
+        fill(DFMAState::Initial, '\'', DFMAState::CharBody);
+        fill_except(DFMAState::CharBody, { '\'', '\\', '\n' }, DFMAState::CharBody);
+        fill(DFMAState::CharBody, '\\', DFMAState::CharEscape);
+        fill_except(DFMAState::CharEscape, { '\n' }, DFMAState::CharBody);
+        fill(DFMAState::CharBody, '\'', DFMAState::CharLiteral);
     }
 
     consteval void fill_identifiers()
@@ -250,7 +333,7 @@ private:
 
     consteval void fill(DFMAState state, char c, DFMAState value)
     {
-        storage_.at(to_underlying(state)).at(c) = value;
+        storage_.at(to_underlying(state)).at(static_cast<uint8_t>(c)) = value;
     }
 
     consteval void fill(DFMAState state, std::initializer_list<char> elements,
@@ -260,15 +343,213 @@ private:
             fill(state, c, value);
     }
 
+    consteval void fill_except(DFMAState state, std::initializer_list<char> excluded, DFMAState value)
+    {
+        for(size_t c = 0; c < 256; ++c)
+            {
+                bool skipped = false;
+                for(auto&& e : excluded)
+                    skipped = skipped || static_cast<uint8_t>(e) == c;
+                if(!skipped)
+                    fill(state, static_cast<char>(c), value);
+            }
+    }
+
     consteval void fill(DFMAState state, char from, char to, DFMAState value)
     {
-        for(char c = from; c < to; ++c)
+        for(char c = from; c <= to; ++c)
             {
-                storage_.at(to_underlying(state)).at(c) = value;
+                fill(state, c, value);
             }
     }
 
     Storage storage_{};
 };
 
+// Shape of the minimized automaton: the equivalence class of every byte and the minimized state every DFMAState
+// collapses into
+struct DFMAPartition
+{
+    static constexpr uint8_t unreachable = 0xFF;
+
+    std::array<uint8_t, 256> byte_class{};
+    std::array<uint8_t, to_underlying(DFMAState::_Count)> state_block{};
+    size_t class_count{ 0 };
+    size_t state_count{ 0 };
+};
+
+// Bytes are grouped when every state treats them alike, then the states reachable from Initial are refined
+// (Moore) starting from the token they accept. Dead states, like Whitespace which never leads to a token, fold
+// into Error. Error and Initial are the first two blocks.
+consteval DFMAPartition partition(DFMATable const& table)
+{
+    constexpr size_t states = to_underlying(DFMAState::_Count);
+    auto const step = [&](size_t state, size_t byte)
+    { return to_underlying(table(static_cast<DFMAState>(state), static_cast<uint8_t>(byte))); };
+
+    DFMAPartition result;
+    std::array<size_t, 256> representative{};
+    for (size_t byte = 0; byte < 256; ++byte)
+    {
+        size_t cls = 0;
+        for (; cls < result.class_count; ++cls)
+        {
+            bool same = true;
+            for (size_t state = 0; state < states && same; ++state)
+            {
+                same = step(state, byte) == step(state, representative[cls]);
+            }
+            if (same) break;
+        }
+        if (cls == result.class_count) representative[result.class_count++] = byte;
+        result.byte_class[byte] = static_cast<uint8_t>(cls);
+    }
+
+    std::array<bool, states> reachable{};
+    std::array<size_t, states> work{};
+    size_t pending = 0;
+    reachable[to_underlying(DFMAState::Error)] = true;
+    reachable[to_underlying(DFMAState::Initial)] = true;
+    work[pending++] = to_underlying(DFMAState::Initial);
+    while (pending > 0)
+    {
+        auto const state = work[--pending];
+        for (size_t cls = 0; cls < result.class_count; ++cls)
+        {
+            auto const next = step(state, representative[cls]);
+            if (!reachable[next])
+            {
+                reachable[next] = true;
+                work[pending++] = next;
+            }
+        }
+    }
+
+    std::array<size_t, states> block{};
+    for (size_t state = 0; state < states; ++state)
+    {
+        block[state] = to_underlying(accepted(static_cast<DFMAState>(state)));
+    }
+    size_t block_count = 0;
+    while (true)
+    {
+        std::array<size_t, states> next{};
+        size_t next_count = 0;
+        for (size_t state = 0; state < states; ++state)
+        {
+            if (!reachable[state]) continue;
+            size_t other = 0;
+            for (; other < state; ++other)
+            {
+                if (!reachable[other] || block[other] != block[state]) continue;
+                bool same = true;
+                for (size_t cls = 0; cls < result.class_count && same; ++cls)
+                {
+                    same = block[step(other, representative[cls])] == block[step(state, representative[cls])];
+                }
+                if (same) break;
+            }
+            next[state] = other < state ? next[other] : next_count++;
+        }
+        block = next;
+        if (next_count == block_count) break;
+        block_count = next_count;
+    }
+
+    if (block[to_underlying(DFMAState::Error)] != 0 || block[to_underlying(DFMAState::Initial)] != 1)
+        throw "Error and Initial must be the first two minimized states";
+    for (size_t state = 0; state < states; ++state)
+    {
+        result.state_block[state] = reachable[state] ? static_cast<uint8_t>(block[state]) : DFMAPartition::unreachable;
+    }
+    result.state_count = block_count;
+    return result;
+}
+
+// The lexer's automaton: a byte -> class map in front of a minimized states x classes matrix. Every byte value has
+// a class, so any input, including UTF-8 and other bytes above 0x7F, is safe to feed without bounds checks.
+template <size_t States, size_t Classes> class CompactDFMA
+{
+    static_assert(States <= 256 && Classes <= 256);
+
+public:
+    using State = uint8_t;
+    static constexpr State dead = 0;
+    static constexpr State initial = 1;
+
+    consteval CompactDFMA(DFMATable const& reference, DFMAPartition const& partition)
+        : classes_{ partition.byte_class }
+    {
+        std::array<bool, States> named{};
+        for (size_t state = 0; state < partition.state_block.size(); ++state)
+        {
+            auto const from = partition.state_block[state];
+            if (from == DFMAPartition::unreachable) continue;
+            accepts_[from] = accepted(static_cast<DFMAState>(state));
+            if (!named[from]) origins_[from] = static_cast<DFMAState>(state);
+            named[from] = true;
+            for (size_t byte = 0; byte < 256; ++byte)
+            {
+                auto const to = reference(static_cast<DFMAState>(state), static_cast<uint8_t>(byte));
+                transitions_[from * Classes + classes_[byte]] = partition.state_block[to_underlying(to)];
+            }
+        }
+    }
+
+    constexpr State operator()(State state, char c) const
+    {
+        return transitions_[state * Classes + classes_[static_cast<uint8_t>(c)]];
+    }
+
+    // Token the state stands for, Error if it does not end one
+    constexpr DFMAState accepts(State state) const { return accepts_[state]; }
+
+    // First DFMAState folded into the state, the lexer keys its bulk skipping on it
+    constexpr DFMAState origin(State state) const { return origins_[state]; }
+
+private:
+    std::array<uint8_t, 256> classes_{};
+    std::array<State, States * Classes> transitions_{};
+    std::array<DFMAState, States> accepts_{};
+    std::array<DFMAState, States> origins_{};
+};
+
+// Walks the product of both automata over all 256 bytes: they recognize the same tokens if every reachable pair
+// of states accepts the same one
+template <size_t States, size_t Classes>
+consteval bool equivalent(DFMATable const& reference, CompactDFMA<States, Classes> const& compact)
+{
+    constexpr size_t states = to_underlying(DFMAState::_Count);
+    using Compact = CompactDFMA<States, Classes>;
+
+    std::array<bool, states * States> seen{};
+    std::array<std::pair<DFMAState, uint8_t>, states * States> work{};
+    size_t pending = 0;
+    auto const visit = [&](DFMAState lhs, uint8_t rhs)
+    {
+        auto& flag = seen[to_underlying(lhs) * States + rhs];
+        if (flag) return;
+        flag = true;
+        work[pending++] = { lhs, rhs };
+    };
+
+    visit(DFMAState::Initial, Compact::initial);
+    while (pending > 0)
+    {
+        auto const [lhs, rhs] = work[--pending];
+        if (accepted(lhs) != compact.accepts(rhs)) return false;
+        for (size_t byte = 0; byte < 256; ++byte)
+        {
+            visit(reference(lhs, static_cast<uint8_t>(byte)), compact(rhs, static_cast<char>(byte)));
+        }
+    }
+    return true;
+}
+
+inline constexpr DFMAPartition dfma_partition = partition(DFMATable{});
+using LexerDFMA = CompactDFMA<dfma_partition.state_count, dfma_partition.class_count>;
+inline constexpr LexerDFMA lexer_dfma{ DFMATable{}, dfma_partition };
+
+static_assert(equivalent(DFMATable{}, lexer_dfma), "Minimized DFMA differs from the reference table");
+
 } // namespace compiler
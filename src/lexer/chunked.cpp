@@ -0,0 +1,132 @@
+#include "chunked.hpp"
+#include "lexer.hpp"
+#include <thread>
+
+namespace compiler
+{
+namespace
+{
+
+// Below this a chunk costs more in thread start-up and stitching than it saves
+constexpr size_t min_chunk_size = 256 * 1024;
+
+// Chunk boundaries: the first newline after evenly spaced targets. A newline ends every token but block comments,
+// so these are the natural restart points; a comment running over a boundary is caught when the chunks are
+// stitched.
+std::vector<size_t> boundaries(std::string_view content, size_t chunks)
+{
+    std::vector<size_t> cuts{ 0 };
+    for (size_t i = 1; i < chunks; ++i)
+    {
+        auto const target = std::max(content.size() / chunks * i, cuts.back() + 1);
+        auto const newline = content.find('\n', target);
+        if (newline == std::string_view::npos) break;
+        cuts.emplace_back(newline);
+    }
+    cuts.emplace_back(content.size());
+    return cuts;
+}
+
+struct Speculative
+{
+    Interner names;
+    Lexer::Chunk chunk;
+};
+
+class Stitcher
+{
+public:
+    explicit Stitcher(File const& file) : file_{ file }, tape_{ file.id, {}, {} } {}
+
+    size_t resume() const { return resume_; }
+
+    // Moves the tokens of a speculative chunk over, rebinding its local symbols and literal indices to the tape
+    void append(Speculative& part)
+    {
+        std::vector<Symbol> symbols;
+        symbols.reserve(part.names.size());
+        for (uint32_t local = 0; local < part.names.size(); ++local)
+        {
+            symbols.emplace_back(Interner::global().intern(part.names.text(static_cast<Symbol>(local))));
+        }
+
+        auto const literal_base = static_cast<uint32_t>(tape_.literals.size());
+        for (auto tok : part.chunk.tokens)
+        {
+            if (tok.tag == tokens::Tag::Identifier) tok.payload = static_cast<uint32_t>(symbols[tok.payload]);
+            if (tok.tag == tokens::Tag::Constant) tok.payload += literal_base;
+            tape_.tokens.emplace_back(tok);
+        }
+        tape_.literals.insert(tape_.literals.end(), part.chunk.literals.begin(), part.chunk.literals.end());
+        resume_ = part.chunk.resume;
+    }
+
+    // Sequential, non speculative lexing from the last verified position up to `end`
+    void relex(size_t end)
+    {
+        Lexer lexer{ file_, Interner::global(), resume_ };
+        auto redone = lexer.chunk(end, false);
+
+        auto const literal_base = static_cast<uint32_t>(tape_.literals.size());
+        for (auto tok : redone.tokens)
+        {
+            if (tok.tag == tokens::Tag::Constant) tok.payload += literal_base;
+            tape_.tokens.emplace_back(tok);
+        }
+        tape_.literals.insert(tape_.literals.end(), redone.literals.begin(), redone.literals.end());
+        resume_ = redone.resume;
+    }
+
+    tokens::Tape finish()
+    {
+        tape_.tokens.emplace_back(Lexer{ file_, Interner::global(), resume_ }.advance());
+        return std::move(tape_);
+    }
+
+private:
+    File const& file_;
+    tokens::Tape tape_;
+    size_t resume_{ 0 };
+};
+
+} // namespace
+
+tokens::Tape lex_chunked(File const& file, size_t threads)
+{
+    auto const chunks = std::min(threads, file.content.size() / min_chunk_size);
+    if (chunks <= 1)
+    {
+        return Lexer{ file }.tape();
+    }
+
+    auto const cuts = boundaries(file.content, chunks);
+    std::vector<Speculative> parts(cuts.size() - 1);
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            workers.emplace_back(
+                [&, i]
+                {
+                    Lexer lexer{ file, parts[i].names, cuts[i] };
+                    parts[i].chunk = lexer.chunk(cuts[i + 1], true);
+                });
+        }
+    }
+
+    Stitcher stitcher{ file };
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        // Valid only if everything before ended ahead of this chunk's start, i.e. no token or comment spans
+        // the boundary
+        if (stitcher.resume() <= cuts[i])
+        {
+            stitcher.append(parts[i]);
+            if (parts[i].chunk.clean) continue;
+        }
+        stitcher.relex(cuts[i + 1]);
+    }
+    return stitcher.finish();
+}
+
+} // namespace compiler
@@ -0,0 +1,14 @@
+#pragma once
+#include "file.hpp"
+#include "tape.hpp"
+
+namespace compiler
+{
+
+// Lexes a file on up to `threads` threads. The buffer is cut into per-thread chunks at newlines, every chunk is
+// lexed speculatively into its own tape and the tapes are stitched in order. A chunk whose start turns out not to
+// be a token boundary (the previous chunk ran past it) or which hit a byte the DFMA rejects is re-lexed sequentially
+// from the point where the verified part ended, so the result is always identical to Lexer::tape().
+tokens::Tape lex_chunked(File const& file, size_t threads);
+
+} // namespace compiler
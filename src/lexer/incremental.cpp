@@ -0,0 +1,106 @@
+#include "incremental.hpp"
+#include "lexer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+namespace compiler
+{
+namespace
+{
+
+// Token ends grow strictly along a tape, so tapes can be searched by them
+size_t end_of(tokens::Token const& tok) { return tok.offset + tok.length; }
+
+// Replaces `count` elements from `first` on by `with`, moving the ones after at most once
+template <typename T> void splice(std::vector<T>& list, size_t first, size_t count, std::vector<T> const& with)
+{
+    auto const at = list.begin() + static_cast<ptrdiff_t>(first);
+    if (with.size() > count)
+    {
+        list.insert(at + static_cast<ptrdiff_t>(count), with.begin() + static_cast<ptrdiff_t>(count), with.end());
+        std::copy_n(with.begin(), count, list.begin() + static_cast<ptrdiff_t>(first));
+        return;
+    }
+    list.erase(at + static_cast<ptrdiff_t>(with.size()), at + static_cast<ptrdiff_t>(count));
+    std::copy(with.begin(), with.end(), list.begin() + static_cast<ptrdiff_t>(first));
+}
+
+} // namespace
+
+void apply_edit(File& file, Edit const& edit)
+{
+    assert(edit.offset + edit.removed <= file.content.size());
+    file.replace(edit.offset, edit.removed, edit.text);
+}
+
+tokens::Tape relex(tokens::Tape tape, File const& file, Edit const& edit)
+{
+    assert(tape.file == file.id);
+    auto& list = tape.tokens;
+    assert(!list.empty() && list.back().tag == tokens::Tag::EoF);
+    auto const at = [&list](size_t index) { return list.begin() + static_cast<ptrdiff_t>(index); };
+    auto const last = list.end() - 1;
+
+    // A token never ends past a newline and its lookahead stops at one, so every token ending before the line of
+    // the edit was decided by unchanged bytes alone. Restarting at a token end also starts outside of any comment.
+    auto const newline = edit.offset == 0 ? std::string_view::npos : file.content.rfind('\n', edit.offset - 1);
+    auto const line_break = newline == std::string_view::npos ? 0 : newline;
+    auto const kept = static_cast<size_t>(
+        std::partition_point(list.begin(), last, [line_break](auto const& tok) { return end_of(tok) <= line_break; })
+        - list.begin());
+    auto const restart = kept == 0 ? 0 : end_of(list[kept - 1]);
+
+    auto const inserted_end = edit.offset + edit.text.size();
+    auto const delta = static_cast<int64_t>(edit.text.size()) - static_cast<int64_t>(edit.removed);
+    std::vector<tokens::Token> fresh;
+    std::vector<int64_t> fresh_literals;
+    // First old token which is still valid, none if the lexer had to run to the end
+    auto resume = list.size();
+    Lexer lexer{ file, Interner::global(), restart };
+    while (true)
+    {
+        auto const tok = lexer.advance();
+        if (tok.tag == tokens::Tag::Constant) fresh_literals.emplace_back(lexer.literal(tok));
+        fresh.emplace_back(tok);
+        if (tok.tag == tokens::Tag::EoF) break;
+
+        // Resynchronized once a token past the edit ends where an old one did
+        auto const end = end_of(tok);
+        if (end < inserted_end) continue;
+        auto const old_end = static_cast<size_t>(static_cast<int64_t>(end) - delta);
+        auto const match =
+            std::partition_point(at(kept), last, [old_end](auto const& other) { return end_of(other) < old_end; });
+        if (match != last && end_of(*match) == old_end)
+        {
+            resume = static_cast<size_t>(match - list.begin()) + 1;
+            break;
+        }
+    }
+
+    // Literal indices follow token order: the fresh ones go where the dropped ones were and those after move along.
+    // The first constant from the restart on holds the index of the first dropped literal, or of the next kept one.
+    auto const is_constant = [](tokens::Token const& tok) { return tok.tag == tokens::Tag::Constant; };
+    auto const next_constant = std::find_if(at(kept), last, is_constant);
+    auto const literal_base = next_constant == last ? tape.literals.size() : size_t{ next_constant->payload };
+    auto const dropped = static_cast<size_t>(std::count_if(at(kept), at(resume), is_constant));
+    auto const literal_shift = static_cast<int64_t>(fresh_literals.size()) - static_cast<int64_t>(dropped);
+    for (auto& tok : fresh)
+    {
+        if (is_constant(tok)) tok.payload += static_cast<uint32_t>(literal_base);
+    }
+    if (delta != 0 || literal_shift != 0)
+    {
+        for (auto it = at(resume); it != list.end(); ++it)
+        {
+            it->offset = static_cast<uint32_t>(it->offset + delta);
+            if (is_constant(*it)) it->payload = static_cast<uint32_t>(it->payload + literal_shift);
+        }
+    }
+
+    splice(list, kept, resume - kept, fresh);
+    splice(tape.literals, literal_base, dropped, fresh_literals);
+    return tape;
+}
+
+} // namespace compiler
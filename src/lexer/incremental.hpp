@@ -0,0 +1,28 @@
+#pragma once
+#include "file.hpp"
+#include "tape.hpp"
+#include <string_view>
+
+namespace compiler
+{
+
+// Replacement of the bytes [offset, offset + removed) of a file by `text`
+struct Edit
+{
+    size_t offset;
+    size_t removed;
+    std::string_view text;
+};
+
+// Applies `edit` to `file` in place, which has to come from SourceManager::add_editable. The file keeps its id, so
+// any number of edits take no further file slots.
+void apply_edit(File& file, Edit const& edit);
+
+// Tape of `file` after apply_edit derived from `tape`, its tape before `edit`. Lexing restarts at the last token
+// boundary before the line of the edit and stops as soon as a token ends where one of the old tape ended, shifted
+// by the size change of the edit: from there on the lexer would see the same bytes in the same state, so the rest
+// of the old tape is kept. Tokens before the edit are not touched, those after it only when the edit changes their
+// offsets or literal indices. The result is identical to Lexer{ file }.tape().
+tokens::Tape relex(tokens::Tape tape, File const& file, Edit const& edit);
+
+} // namespace compiler
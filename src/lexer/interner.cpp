@@ -0,0 +1,51 @@
+#include "interner.hpp"
+#include "util/hash.hpp"
+#include <algorithm>
+
+namespace compiler
+{
+
+Interner& Interner::global()
+{
+    static Interner interner;
+    return interner;
+}
+
+Symbol Interner::intern(std::string_view text)
+{
+    if (auto it = symbols_.find(text); it != symbols_.end())
+    {
+        return it->second;
+    }
+
+    auto const stored = store(text);
+    auto const sym = static_cast<Symbol>(texts_.size());
+    texts_.emplace_back(stored);
+    hashes_.emplace_back(Hasher::of(stored));
+    symbols_.emplace(stored, sym);
+    return sym;
+}
+
+std::string_view Interner::store(std::string_view text)
+{
+    // Oversized spellings get a block of their own, the current block keeps being filled
+    if (text.size() > block_size / 4)
+    {
+        auto& block = oversized_.emplace_back(std::make_unique<char[]>(text.size()));
+        std::copy(text.begin(), text.end(), block.get());
+        return { block.get(), text.size() };
+    }
+
+    if (block_used_ + text.size() > block_size)
+    {
+        blocks_.emplace_back(std::make_unique<char[]>(block_size));
+        block_used_ = 0;
+    }
+
+    char* dest = blocks_.back().get() + block_used_;
+    std::copy(text.begin(), text.end(), dest);
+    block_used_ += text.size();
+    return { dest, text.size() };
+}
+
+} // namespace compiler
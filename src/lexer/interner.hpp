@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace compiler
+{
+
+// Handle of an interned spelling, equal spellings always share the same Symbol
+enum class Symbol : uint32_t
+{
+};
+
+// Deduplicated storage for identifier spellings. Every distinct spelling is copied once into an arena of large
+// blocks and is referred to by its 32 bit Symbol from then on, so name equality is an integer compare and the
+// spellings stay valid (and never move) for the lifetime of the process.
+class Interner
+{
+public:
+    static Interner& global();
+
+    Symbol intern(std::string_view text);
+    std::string_view text(Symbol sym) const { return texts_[static_cast<uint32_t>(sym)]; }
+    // Hasher::of the spelling, the same in every run unlike the Symbol
+    uint64_t hash(Symbol sym) const { return hashes_[static_cast<uint32_t>(sym)]; }
+
+    size_t size() const { return texts_.size(); }
+
+private:
+    std::string_view store(std::string_view text);
+
+    static constexpr size_t block_size = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_used_{ block_size };
+    std::vector<std::unique_ptr<char[]>> oversized_;
+
+    std::vector<std::string_view> texts_;
+    std::vector<uint64_t> hashes_;
+    std::unordered_map<std::string_view, Symbol> symbols_;
+};
+
+} // namespace compiler
@@ -0,0 +1,93 @@
+#pragma once
+#include "reflection.hpp"
+#include "token.hpp"
+#include "util/underlying.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace compiler::tokens
+{
+
+// Perfect hash over the spellings of tokens::Keyword, built entirely at compile time.
+// A key made of the length, the first two and the last character is scrambled by a multiplier searched for
+// during constant evaluation, such that every keyword lands in its own slot. A lookup is then one multiply, one
+// slot load and a single string compare.
+class KeywordTable
+{
+    static constexpr size_t keyword_count = to_underlying(Keyword::Imaginary) + 1;
+    static constexpr size_t slot_bits = 7;
+    static constexpr size_t slot_count = size_t{ 1 } << slot_bits;
+    static constexpr size_t min_length = 2;
+    static constexpr size_t max_length = 10;
+    static constexpr uint8_t empty = 0xFF;
+
+    struct Spelling
+    {
+        std::array<char, max_length> text{};
+        uint8_t length{ 0 };
+    };
+
+public:
+    consteval KeywordTable()
+    {
+        for (size_t i = 0; i < keyword_count; ++i)
+        {
+            auto const text = to_string(static_cast<Keyword>(i));
+            if (text.size() < min_length || text.size() > max_length) throw "Keyword spelling out of range";
+            spellings_[i].length = static_cast<uint8_t>(text.size());
+            for (size_t c = 0; c < text.size(); ++c)
+            {
+                spellings_[i].text[c] = text[c];
+            }
+        }
+
+        uint32_t candidate{ 0x9E3779B1 };
+        for (size_t attempt = 0; attempt < 100000; ++attempt)
+        {
+            if (try_seed(candidate | 1)) return;
+            candidate = candidate * 1664525 + 1013904223;
+        }
+        throw "No collision free multiplier found for the keyword table";
+    }
+
+    constexpr std::optional<Keyword> operator()(std::string_view lexem) const
+    {
+        if (lexem.size() < min_length || lexem.size() > max_length) return std::nullopt;
+
+        auto const idx = slots_[slot(seed_, lexem)];
+        if (idx == empty) return std::nullopt;
+
+        auto const& spelling = spellings_[idx];
+        if (lexem != std::string_view{ spelling.text.data(), spelling.length }) return std::nullopt;
+        return static_cast<Keyword>(idx);
+    }
+
+private:
+    static constexpr size_t slot(uint32_t seed, std::string_view lexem)
+    {
+        uint32_t const key = static_cast<uint8_t>(lexem[0]) | static_cast<uint8_t>(lexem[1]) << 8
+                             | static_cast<uint8_t>(lexem.back()) << 16 | static_cast<uint32_t>(lexem.size()) << 24;
+        return (key * seed) >> (32 - slot_bits);
+    }
+
+    consteval bool try_seed(uint32_t seed)
+    {
+        slots_.fill(empty);
+        for (size_t i = 0; i < keyword_count; ++i)
+        {
+            auto& target = slots_[slot(seed, { spellings_[i].text.data(), spellings_[i].length })];
+            if (target != empty) return false;
+            target = static_cast<uint8_t>(i);
+        }
+        seed_ = seed;
+        return true;
+    }
+
+    std::array<Spelling, keyword_count> spellings_{};
+    std::array<uint8_t, slot_count> slots_{};
+    uint32_t seed_{ 0 };
+};
+
+} // namespace compiler::tokens
@@ -1,106 +1,207 @@
 #include "lexer.hpp"
+#include "literal.hpp"
+#include "scan.hpp"
 #include "util/ice.hpp"
 #include <cassert>
-#include <charconv>
-#include <unordered_map>
+#include <algorithm>
+#include <format>
+#include <optional>
 
 namespace compiler
 {
 using tokens::Token;
 
-namespace
-{
-
-// TODO try implementing comptime map container / string interning
-static const std::unordered_map<std::string_view, tokens::Keyword> KEYWORDS{
-    { "auto", tokens::Keyword::Auto },
-    { "break", tokens::Keyword::Break },
-    { "case", tokens::Keyword::Case },
-    { "char", tokens::Keyword::Char },
-    { "const", tokens::Keyword::Const },
-    { "continue", tokens::Keyword::Continue },
-    { "default", tokens::Keyword::Default },
-    { "do", tokens::Keyword::Do },
-    { "double", tokens::Keyword::Double },
-    { "else", tokens::Keyword::Else },
-    { "enum", tokens::Keyword::Enum },
-    { "extern", tokens::Keyword::Extern },
-    { "float", tokens::Keyword::Float },
-    { "for", tokens::Keyword::For },
-    { "goto", tokens::Keyword::Goto },
-    { "if", tokens::Keyword::If },
-    { "inline", tokens::Keyword::Inline },
-    { "int", tokens::Keyword::Int },
-    { "long", tokens::Keyword::Long },
-    { "register", tokens::Keyword::Register },
-    { "restrict", tokens::Keyword::Restrict },
-    { "return", tokens::Keyword::Return },
-    { "short", tokens::Keyword::Short },
-    { "signed", tokens::Keyword::Signed },
-    { "sizeof", tokens::Keyword::Sizeof },
-    { "static", tokens::Keyword::Static },
-    { "struct", tokens::Keyword::Struct },
-    { "switch", tokens::Keyword::Switch },
-    { "typedef", tokens::Keyword::Typedef },
-    { "union", tokens::Keyword::Union },
-    { "unsigned", tokens::Keyword::Unsigned },
-    { "void", tokens::Keyword::Void },
-    { "volatile", tokens::Keyword::Volatile },
-    { "while", tokens::Keyword::While },
-    { "_Bool", tokens::Keyword::Bool },
-    { "_Complex", tokens::Keyword::Complex },
-    { "_Imaginary", tokens::Keyword::Imaginary },
-};
-
-} // namespace
-
-Lexer::FilePos Lexer::skip_whitespace() const
-{
-    FilePos new_pos = position_;
-    DFMAState state{ DFMAState::Initial };
+Lexer::FilePos Lexer::skip_whitespace(FilePos pos) const
+{
+    do
+    {
+        pos.index = base_ + scan::skip(scan::CharClass::Whitespace, file_content_, pos.index - base_);
+    } while (is_eof(pos) && refill(pos.index));
+    return pos;
+}
+
+// Streamed input only: everything before `keep` is done with, slide the window and read on
+bool Lexer::refill(size_t keep) const
+{
+    if (stream_ == nullptr || !stream_->refill(keep)) return false;
+    file_content_ = stream_->window();
+    base_ = stream_->base();
+    return true;
+}
+
+Lexer::FilePos Lexer::line_end(FilePos pos) const
+{
     while (true)
     {
-        if (is_eof(new_pos)) break;
-        char c{ peek_char(new_pos) };
-        state = table(state, c);
-        if (state != DFMAState::Whitespace) break;
-        new_pos.advance(c);
+        auto const newline = file_content_.find('\n', pos.index - base_);
+        if (newline != std::string_view::npos) return FilePos{ base_ + newline };
+        pos.index = base_ + file_content_.size();
+        if (!refill(pos.index)) return pos;
     }
-    return new_pos;
 }
 
-Lexer::BufferedPeek Lexer::peek_with_offset() const
+Lexer::FilePos Lexer::input_end() const
+{
+    FilePos end{ base_ + file_content_.size() };
+    while (refill(end.index))
+    {
+        end.index = base_ + file_content_.size();
+    }
+    return end;
+}
+
+// Nothing could be lexed at start. Reports why and returns where lexing carries on: past a malformed constant, at
+// the end of the line for an unterminated literal, or one byte further for a stray character.
+Lexer::FilePos Lexer::reject(FilePos start, FilePos stop) const
+{
+    auto const loc = file_.loc(start.index);
+    if (stop.index > start.index)
+    {
+        auto const lexem = slice(start.index, stop.index);
+        if (lexem.front() == '\'')
+        {
+            loc.err() << "Invalid character constant\n";
+            return stop;
+        }
+        auto const parsed = literal::parse_integer(lexem);
+        switch (parsed.error)
+        {
+        case literal::IntError::MissingDigits: loc.err() << "Integer constant has no digits\n"; break;
+        case literal::IntError::InvalidDigit:
+        {
+            auto const radix = parsed.radix == 8 ? "octal" : "binary";
+            loc.err() << "Invalid digit '" << lexem[parsed.error_at] << "' in " << radix << " constant\n";
+            break;
+        }
+        case literal::IntError::InvalidSuffix:
+            loc.err() << "Invalid suffix '" << lexem.substr(parsed.error_at) << "' on integer constant\n";
+            break;
+        case literal::IntError::TooLarge: loc.err() << "Integer constant is too large\n"; break;
+        case literal::IntError::None: REPORT_ICE("Rejected a valid integer constant");
+        }
+        return stop;
+    }
+
+    auto const rest = slice(start.index, base_ + file_content_.size());
+    if (rest.starts_with("/*"))
+    {
+        loc.err() << "Unterminated comment\n";
+        return input_end();
+    }
+    if (rest.front() == '"')
+    {
+        loc.err() << "Unterminated string literal\n";
+        return line_end(start);
+    }
+    if (rest.front() == '\'')
+    {
+        loc.err() << "Unterminated character constant\n";
+        return line_end(start);
+    }
+
+    auto const c = static_cast<unsigned char>(rest.front());
+    if (c >= 0x20 && c < 0x7F)
+    {
+        loc.err() << "Unexpected character '" << c << "'\n";
+    }
+    else
+    {
+        loc.err() << std::format("Unexpected byte 0x{:02X}\n", c);
+    }
+    start.advance(1);
+    return start;
+}
+
+// Identifiers, integers and the bodies of comments and literals loop on their own state until the run ends, so
+// the rest of the run is consumed in bulk and the DFMA only sees the byte which terminates it
+void Lexer::skip_run(FilePos& pos, DFMAState state) const
 {
-    FilePos new_position{ skip_whitespace() };
-    if (is_eof(new_position))
+    scan::CharClass cls;
+    switch (state)
     {
-        return BufferedPeek{ position_, { tokens::Tag::EoF, std::monostate{}, position_.loc } };
+    case DFMAState::Identifier: cls = scan::CharClass::Identifier; break;
+    case DFMAState::Integer: cls = scan::CharClass::Identifier; break;
+    case DFMAState::LineComment: cls = scan::CharClass::LineComment; break;
+    case DFMAState::BlockComment: cls = scan::CharClass::BlockComment; break;
+    case DFMAState::StringBody: cls = scan::CharClass::StringBody; break;
+    case DFMAState::CharBody: cls = scan::CharClass::CharBody; break;
+    default: return;
     }
+    pos.index = base_ + scan::skip(cls, file_content_, pos.index - base_);
+}
 
-    FilePos const starting{ new_position };
+Lexer::BufferedPeek Lexer::peek_with_offset() const
+{
+    FilePos start{ skip_whitespace(position_) };
+    while (!is_eof(start))
+    {
+        auto const found = match(start);
+        if (is_comment(found.state))
+        {
+            start = skip_whitespace(found.end);
+            continue;
+        }
+        if (found.state != DFMAState::Error)
+        {
+            assert(is_final(found.state) && "Result not final");
+            return BufferedPeek{ found.end, create(start, found), found.value };
+        }
+        start = skip_whitespace(reject(start, found.end));
+    }
+    return BufferedPeek{ start, make(tokens::Tag::EoF, 0, position_.index, position_.index), 0 };
+}
 
+// Longest match: the end of the last accepted prefix is kept, so bytes consumed by a state which turns out not to
+// end a token (the second '.' of "..") are left for the next token. Unterminated block comments and malformed
+// constants come back as Error.
+Lexer::Match Lexer::match(FilePos start) const
+{
     DFMAState result{ DFMAState::Error };
-    DFMAState state{ DFMAState::Initial };
+    FilePos pos{ start };
+    FilePos end{ start };
+    auto state{ LexerDFMA::initial };
 
     while (true)
     {
-        char c{ peek_char(new_position) };
-        if (is_final(state)) result = state;
-        state = table(state, c);
-        if (state == DFMAState::Error) break;
-        new_position.advance(c);
+        // On streamed input the window slides but keeps the token, a token crossing a refill is matched in one go
+        if (is_eof(pos) && !refill(start.index)) break;
+        state = table(state, peek_char(pos));
+        if (state == LexerDFMA::dead) break;
+        pos.advance(1);
+        skip_run(pos, table.origin(state));
+        if (auto const token = table.accepts(state); token != DFMAState::Error)
+        {
+            result = token;
+            end = pos;
+        }
     }
 
-    assert(result != DFMAState::Initial && "DFMA state is initial");
-    assert(result != DFMAState::Error && "DFMA state is error");
-    assert(is_final(result) && "Result not final");
-
-    return BufferedPeek{ new_position, create(starting, new_position.index, result) };
+    auto const open = table.origin(state);
+    if (is_eof(pos) && (open == DFMAState::BlockComment || open == DFMAState::BlockCommentStar))
+    {
+        return { start, DFMAState::Error };
+    }
+    if (result == DFMAState::Integer)
+    {
+        auto const parsed = literal::parse_integer(slice(start.index, end.index));
+        if (parsed.error != literal::IntError::None) return { end, DFMAState::Error };
+        return { end, result, parsed.form.pack(), static_cast<int64_t>(parsed.value) };
+    }
+    if (result == DFMAState::CharLiteral)
+    {
+        auto const value = literal::parse_char(slice(start.index, end.index));
+        if (!value) return { end, DFMAState::Error };
+        return { end, result, tokens::IntForm{ .character = true }.pack(), *value };
+    }
+    return { end, result };
 }
 
 Token Lexer::peek() const
 {
-    buffered_ = peek_with_offset();
+    if (!buffered_.has_value())
+    {
+        buffered_ = peek_with_offset();
+    }
     return buffered_->token;
 }
 
@@ -113,30 +214,109 @@ Token Lexer::advance()
 
     position_ = buffered_->pos;
     auto const res = buffered_->token;
+    if (res.tag == tokens::Tag::Constant)
+    {
+        literals_.emplace_back(buffered_->value);
+    }
     buffered_ = std::nullopt;
     return res;
 }
 
-tokens::Token Lexer::create(FilePos const& start, size_t current, DFMAState state) const
+tokens::Tape Lexer::tape(std::function<void(tokens::Token const&)> const& seen)
+{
+    tokens::Tape tape{ file_.id, {}, {} };
+    // Dense code averages a token every few bytes, this avoids most regrowth without overcommitting on sparse input
+    tape.tokens.reserve(file_content_.size() / 6 + 1);
+    while (true)
+    {
+        auto const& tok = tape.tokens.emplace_back(advance());
+        if (seen) seen(tok);
+        if (tok.tag == tokens::Tag::EoF) break;
+    }
+    tape.literals = std::move(literals_);
+    literals_.clear();
+    return tape;
+}
+
+void Lexer::drain(std::function<void(tokens::Token const&)> const& seen)
 {
-    auto const lexem = file_content_.substr(start.index, current - start.index);
+    while (true)
+    {
+        auto const tok = advance();
+        seen(tok);
+        literals_.clear();
+        if (tok.tag == tokens::Tag::EoF) break;
+    }
+}
+
+Lexer::Chunk Lexer::chunk(size_t end, bool speculative)
+{
+    assert(!buffered_.has_value());
+    Chunk result{ {}, {}, position_.index, true };
+    while (true)
+    {
+        FilePos const start{ skip_whitespace(position_) };
+        if (is_eof(start) || start.index >= end) break;
+
+        auto const found = match(start);
+        if (is_comment(found.state))
+        {
+            position_ = found.end;
+            continue;
+        }
+        if (found.state == DFMAState::Error)
+        {
+            if (speculative)
+            {
+                result.clean = false;
+                break;
+            }
+            position_ = reject(start, found.end);
+            continue;
+        }
+
+        auto const tok = create(start, found);
+        if (tok.tag == tokens::Tag::Constant)
+        {
+            literals_.emplace_back(found.value);
+        }
+        result.tokens.emplace_back(tok);
+        position_ = found.end;
+    }
+    result.resume = position_.index;
+    result.literals = std::move(literals_);
+    literals_.clear();
+    return result;
+}
+
+tokens::Token Lexer::make(tokens::Tag tag, uint8_t kind, size_t start, size_t end, uint32_t payload) const
+{
+    return Token{ tag, kind, static_cast<decltype(Token::file)>(file_.id), static_cast<uint32_t>(start),
+                  static_cast<uint32_t>(end - start), payload };
+}
+
+tokens::Token Lexer::create(FilePos const& start, Match const& match) const
+{
+    auto const current = match.end.index;
+    auto const state = match.state;
+    auto const lexem = slice(start.index, current);
     switch (state)
     {
     case DFMAState::Identifier:
     {
-        if (auto it = KEYWORDS.find(lexem); it != KEYWORDS.end())
+        if (auto keyword = keywords(lexem))
         {
-            return Token{ tokens::Tag::Keyword, it->second, start.loc };
+            return make(tokens::Tag::Keyword, to_underlying(*keyword), start.index, current);
         }
-        return Token{ tokens::Tag::Identifier, std::string{ lexem }, start.loc };
+        auto const sym = names_.intern(lexem);
+        return make(tokens::Tag::Identifier, 0, start.index, current, static_cast<uint32_t>(sym));
     }
 
     case DFMAState::Integer:
+    case DFMAState::CharLiteral:
     {
-        int value;
-        auto res = std::from_chars(lexem.data(), lexem.data() + lexem.size(), value);
-        assert(res.ec == std::errc{});
-        return Token{ tokens::Tag::Constant, value, start.loc };
+        // The literal is only recorded once the token is consumed, peeking hands out the index it is going to get
+        return make(tokens::Tag::Constant, match.kind, start.index, current, static_cast<uint32_t>(literals_.size()));
     }
     case DFMAState::LBracket:
     case DFMAState::RBracket:
@@ -183,13 +363,29 @@ tokens::Token Lexer::create(FilePos const& start, size_t current, DFMAState stat
     case DFMAState::AmpersandEqual:
     case DFMAState::CaretEqual:
     case DFMAState::PipeEqual:
+    case DFMAState::Comma:
+    case DFMAState::Hash:
+    case DFMAState::HashHash:
+    {
+        return make(tokens::Tag::Punctuator, to_underlying(state), start.index, current);
+    }
+    case DFMAState::StringLiteral:
     {
-        return Token{ tokens::Tag::Punctuator, tokens::Punctuator{ to_underlying(state) }, start.loc };
+        return make(tokens::Tag::StringLiteral, 0, start.index, current);
     }
     case DFMAState::Initial:
     case DFMAState::Whitespace:
     case DFMAState::Error:
     case DFMAState::DotDot:
+    case DFMAState::LineSplice:
+    case DFMAState::LineComment:
+    case DFMAState::BlockComment:
+    case DFMAState::BlockCommentStar:
+    case DFMAState::Comment:
+    case DFMAState::StringBody:
+    case DFMAState::StringEscape:
+    case DFMAState::CharBody:
+    case DFMAState::CharEscape:
     case DFMAState::_Count: break;
     }
     REPORT_ICE("Lexer ended in an invalid state: " << static_cast<int>(state));
@@ -1,66 +1,131 @@
 #pragma once
 #include "DFMA.hpp"
 #include "file.hpp"
+#include "keywords.hpp"
 #include "loc.hpp"
+#include "tape.hpp"
 #include "token.hpp"
+#include <functional>
+#include <limits>
 #include <optional>
 
 namespace compiler
 {
 
+// SourceManager stops handing out FileIds before they no longer fit a token
+static_assert(SourceManager::max_files - 1 <= std::numeric_limits<decltype(tokens::Token::file)>::max());
+
 class Lexer
 {
     struct FilePos
     {
-        Loc loc;
         size_t index;
 
-        void advance(char c)
-        {
-            loc.advance(c);
-            ++index;
-        }
+        void advance(size_t consumed) { index += consumed; }
+    };
+
+    // Longest match at some position. Constants are converted while they are validated, so the value and IntForm
+    // travel with the match instead of reparsing the spelling later.
+    struct Match
+    {
+        FilePos end;
+        DFMAState state;
+        uint8_t kind{ 0 };
+        int64_t value{ 0 };
     };
 
     struct BufferedPeek
     {
         FilePos pos;
         tokens::Token token;
+        int64_t value; // Of a Constant, recorded in the literal table once the token is consumed
     };
 
 public:
-    explicit Lexer(File const& file) :
-        position_{ Loc{ file.name }, 0 },
+    // Tokens of a byte range, produced by chunk()
+    struct Chunk
+    {
+        std::vector<tokens::Token> tokens;
+        std::vector<int64_t> literals;
+        size_t resume; // Offset right after the last token or comment
+        bool clean;    // False if a speculative run stopped on a byte the DFMA rejects
+    };
+
+    explicit Lexer(File const& file, Interner& names = Interner::global(), size_t begin = 0) :
+        file_{ file },
+        names_{ names },
+        position_{ begin },
         file_content_{ file.content }
     {
     }
 
+    // Pulls the input through the stream as it goes, positions and token offsets stay absolute
+    explicit Lexer(Stream& stream, Interner& names = Interner::global()) :
+        file_{ stream.file() },
+        names_{ names },
+        position_{ stream.base() },
+        file_content_{ stream.window() },
+        base_{ stream.base() },
+        stream_{ &stream }
+    {
+    }
+
     tokens::Token peek() const;
     tokens::Token advance();
 
-    Loc loc() const { return position_.loc; }
+    // Lexes everything that is left, the lexer is exhausted afterwards. `seen` gets every token as soon as it is
+    // lexed, while its spelling is still in the window of a streamed file.
+    tokens::Tape tape(std::function<void(tokens::Token const&)> const& seen = {});
+    // Lexes everything that is left without keeping anything: each token and the value of a Constant are only valid
+    // during their call of `seen`
+    void drain(std::function<void(tokens::Token const&)> const& seen);
+
+    // Lexes the tokens starting before `end`. A speculative run may have been started in the middle of a token, so
+    // instead of reporting the first byte the DFMA rejects it stops there and leaves the decision to the caller.
+    Chunk chunk(size_t end, bool speculative);
+
+    // Value of a Constant token returned by advance()
+    int64_t literal(tokens::Token const& tok) const { return literals_.at(tok.payload); }
+
+    Loc loc() const { return file_.loc(position_.index); }
 
 private:
     BufferedPeek peek_with_offset() const;
-    tokens::Token create(FilePos const& start, size_t current,
-                         DFMAState state) const;
+    Match match(FilePos start) const;
+    tokens::Token create(FilePos const& start, Match const& match) const;
+    tokens::Token make(tokens::Tag tag, uint8_t kind, size_t start, size_t end, uint32_t payload = 0) const;
+    // End of the window, which is the end of the input unless refill() says otherwise
     bool is_eof(FilePos const& pos) const
     {
-        return pos.index >= file_content_.size();
+        return pos.index >= base_ + file_content_.size();
     }
+    bool refill(size_t keep) const;
+    FilePos line_end(FilePos pos) const;
+    FilePos input_end() const;
 
-    FilePos skip_whitespace() const;
+    FilePos skip_whitespace(FilePos pos) const;
+    FilePos reject(FilePos start, FilePos stop) const;
+    void skip_run(FilePos& pos, DFMAState state) const;
 
     char peek_char(FilePos const& fp) const
     {
-        return file_content_.at(fp.index);
+        return file_content_[fp.index - base_];
     }
 
-    static constexpr DFMATable table{};
+    std::string_view slice(size_t from, size_t to) const { return file_content_.substr(from - base_, to - from); }
+
+    static constexpr LexerDFMA table{ lexer_dfma };
+    static constexpr tokens::KeywordTable keywords{};
 
+    File const& file_;
+    Interner& names_;
     mutable std::optional<BufferedPeek> buffered_;
     FilePos position_;
-    std::string_view file_content_;
+    // The window slides over streamed input, which can happen during a (const) peek
+    mutable std::string_view file_content_;
+    mutable size_t base_{ 0 };
+    Stream* stream_{ nullptr };
+    std::vector<int64_t> literals_;
 };
 
 } // namespace compiler
@@ -0,0 +1,256 @@
+#include "literal.hpp"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+namespace compiler::literal
+{
+namespace
+{
+
+constexpr uint64_t ones = 0x0101010101010101;
+constexpr uint64_t high_bits = 0x8080808080808080;
+
+// Eight characters, the first one in the lowest byte whatever the byte order of the machine
+uint64_t load8(char const* data)
+{
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        word = __builtin_bswap64(word);
+    }
+    return word;
+}
+
+// High bit of every byte lane with lo <= byte <= hi, for words whose bytes are all below 0x80. Neither addition
+// carries into the next lane.
+constexpr uint64_t in_range(uint64_t word, uint8_t lo, uint8_t hi)
+{
+    auto const at_least_lo = word + ones * (0x80 - lo);
+    auto const above_hi = word + ones * (0x7F - hi);
+    return at_least_lo & ~above_hi & high_bits;
+}
+
+bool eight_decimal(uint64_t word)
+{
+    return ((word & 0xF0F0F0F0F0F0F0F0) | (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+           == 0x3333333333333333;
+}
+
+// Value of eight decimal digits: neighbouring lanes are merged pairwise, 2 then 4 then 8 digits wide
+uint64_t decimal_value(uint64_t word)
+{
+    word -= ones * '0';
+    word = word * 10 + (word >> 8);
+    word = ((word & 0x000000FF000000FF) * (100 + (1000000ULL << 32))
+            + ((word >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))
+           >> 32;
+    return word & 0xFFFFFFFF;
+}
+
+bool eight_hex(uint64_t word)
+{
+    if ((word & high_bits) != 0) return false;
+    // Setting bit 5 folds A-F onto a-f and leaves the digits alone
+    return (in_range(word, '0', '9') | in_range(word | ones * 0x20, 'a', 'f')) == high_bits;
+}
+
+// Value of eight hex digits: every lane is turned into its nibble, then lanes are merged pairwise as above
+uint64_t hex_value(uint64_t word)
+{
+    auto const letters = (word >> 6) & ones;
+    auto nibbles = (word & ones * 0x0F) + letters * 9;
+    nibbles = ((nibbles & 0x000F000F000F000F) << 4) | ((nibbles & 0x0F000F000F000F00) >> 8);
+    nibbles = ((nibbles & 0x000000FF000000FF) << 8) | ((nibbles & 0x00FF000000FF0000) >> 16);
+    return ((nibbles & 0xFFFF) << 16) | ((nibbles >> 32) & 0xFFFF);
+}
+
+int digit_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Accumulates the digits at the front of `digits` until the first character which is not one of them and returns
+// its index. Overflow is recorded in `result` but the digits are still consumed.
+size_t accumulate(std::string_view digits, ParsedInt& result)
+{
+    auto const radix = result.radix;
+    auto overflow = [&](uint64_t scale, uint64_t add)
+    {
+        if (__builtin_mul_overflow(result.value, scale, &result.value)
+            || __builtin_add_overflow(result.value, add, &result.value))
+        {
+            result.error = IntError::TooLarge;
+        }
+    };
+
+    size_t i{ 0 };
+    if (radix == 10)
+    {
+        for (; i + 8 <= digits.size(); i += 8)
+        {
+            auto const word = load8(digits.data() + i);
+            if (!eight_decimal(word)) break;
+            overflow(100'000'000, decimal_value(word));
+        }
+    }
+    else if (radix == 16)
+    {
+        for (; i + 8 <= digits.size(); i += 8)
+        {
+            auto const word = load8(digits.data() + i);
+            if (!eight_hex(word)) break;
+            overflow(uint64_t{ 1 } << 32, hex_value(word));
+        }
+    }
+
+    // Octal and binary constants scan all decimal digits, so that 9 in 0779 is reported as a digit
+    auto const scan_radix = radix == 16 ? 16 : 10;
+    for (; i < digits.size(); ++i)
+    {
+        auto const digit = digit_value(digits[i]);
+        if (digit < 0 || digit >= scan_radix) break;
+        if (digit >= radix && result.error == IntError::None)
+        {
+            result.error = IntError::InvalidDigit;
+            result.error_at = i;
+        }
+        overflow(radix, static_cast<uint64_t>(digit));
+    }
+    return i;
+}
+
+// u, l, ll and the combinations of u with either, in both orders. ll has to be a single case.
+bool parse_suffix(std::string_view suffix, tokens::IntForm& form)
+{
+    auto take_u = [&]
+    {
+        if (suffix.empty() || (suffix[0] != 'u' && suffix[0] != 'U')) return false;
+        form.is_unsigned = true;
+        suffix.remove_prefix(1);
+        return true;
+    };
+    auto take_l = [&]
+    {
+        if (suffix.starts_with("ll") || suffix.starts_with("LL"))
+        {
+            form.longs = 2;
+            suffix.remove_prefix(2);
+        }
+        else if (!suffix.empty() && (suffix[0] == 'l' || suffix[0] == 'L'))
+        {
+            form.longs = 1;
+            suffix.remove_prefix(1);
+        }
+    };
+
+    if (take_u())
+    {
+        take_l();
+    }
+    else
+    {
+        take_l();
+        take_u();
+    }
+    return suffix.empty();
+}
+
+} // namespace
+
+ParsedInt parse_integer(std::string_view lexem)
+{
+    ParsedInt result;
+    size_t prefix{ 0 };
+    if (lexem.size() > 1 && lexem[0] == '0')
+    {
+        switch (lexem[1])
+        {
+        case 'x':
+        case 'X':
+            result.radix = 16;
+            prefix = 2;
+            break;
+        case 'b':
+        case 'B':
+            result.radix = 2;
+            prefix = 2;
+            break;
+        default:
+            result.radix = 8;
+            prefix = 1;
+        }
+    }
+    result.form.decimal = result.radix == 10;
+
+    auto const digits = accumulate(lexem.substr(prefix), result);
+    auto const suffix_at = prefix + digits;
+    if (result.error == IntError::InvalidDigit)
+    {
+        result.error_at += prefix;
+        return result;
+    }
+    if (prefix == 2 && digits == 0)
+    {
+        result.error = IntError::MissingDigits;
+        return result;
+    }
+    if (!parse_suffix(lexem.substr(suffix_at), result.form))
+    {
+        result.error = IntError::InvalidSuffix;
+        result.error_at = suffix_at;
+    }
+    return result;
+}
+
+std::optional<int64_t> parse_char(std::string_view lexem)
+{
+    auto const body = lexem.substr(1, lexem.size() - 2);
+    if (body.empty()) return std::nullopt;
+    if (body[0] != '\\')
+    {
+        if (body.size() != 1) return std::nullopt;
+        return static_cast<signed char>(body[0]);
+    }
+    if (body.size() < 2) return std::nullopt;
+
+    unsigned value{ 0 };
+    size_t used{ 2 };
+    switch (body[1])
+    {
+    case '\'': value = '\''; break;
+    case '"': value = '"'; break;
+    case '?': value = '?'; break;
+    case '\\': value = '\\'; break;
+    case 'a': value = '\a'; break;
+    case 'b': value = '\b'; break;
+    case 'f': value = '\f'; break;
+    case 'n': value = '\n'; break;
+    case 'r': value = '\r'; break;
+    case 't': value = '\t'; break;
+    case 'v': value = '\v'; break;
+    case 'x':
+    {
+        auto const [ptr, ec] = std::from_chars(body.data() + 2, body.data() + body.size(), value, 16);
+        if (ec != std::errc{}) return std::nullopt;
+        used = static_cast<size_t>(ptr - body.data());
+        break;
+    }
+    default:
+    {
+        auto const digits = std::min<size_t>(body.size(), 4);
+        auto const [ptr, ec] = std::from_chars(body.data() + 1, body.data() + digits, value, 8);
+        if (ec != std::errc{}) return std::nullopt;
+        used = static_cast<size_t>(ptr - body.data());
+    }
+    }
+    if (used != body.size() || value > 0xFF) return std::nullopt;
+    return static_cast<signed char>(value);
+}
+
+} // namespace compiler::literal
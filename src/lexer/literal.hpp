@@ -0,0 +1,37 @@
+#pragma once
+#include "token.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace compiler::literal
+{
+
+enum class IntError : uint8_t
+{
+    None,
+    MissingDigits, // "0x" or "0b" alone
+    InvalidDigit,  // 8 or 9 in an octal constant, 2-9 in a binary one
+    InvalidSuffix,
+    TooLarge, // Does not fit in 64 bits
+};
+
+struct ParsedInt
+{
+    uint64_t value{ 0 };
+    tokens::IntForm form{};
+    uint8_t radix{ 10 };
+    IntError error{ IntError::None };
+    size_t error_at{ 0 }; // Offset of the offending digit or of the suffix in the spelling
+};
+
+// Integer constant in any of the C forms, decimal, octal, 0x hex or 0b binary, with an optional u, l or ll suffix.
+// Decimal and hex digits are converted eight at a time in a 64 bit register, octal and binary ones one by one.
+ParsedInt parse_integer(std::string_view lexem);
+
+// Value of a character constant, quotes included. Only a single character or escape sequence is accepted, the
+// value is that of a (signed) char.
+std::optional<int64_t> parse_char(std::string_view lexem);
+
+} // namespace compiler::literal
@@ -0,0 +1,1151 @@
+#include "preprocessor.hpp"
+#include "lexer.hpp"
+#include "reflection.hpp"
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+namespace compiler
+{
+using tokens::Punctuator;
+using tokens::Tag;
+
+namespace
+{
+
+constexpr size_t max_include_depth = 200;
+
+// A newline between two tokens that is neither inside a block comment nor escaped by a backslash
+bool newline_between(std::string_view content, size_t from, size_t to)
+{
+    for (auto i = from; i < to; ++i)
+    {
+        switch (content[i])
+        {
+        case '\n': return true;
+        case '\\':
+            i += i + 1 < to && content[i + 1] == '\n';
+            break;
+        case '/':
+            if (i + 1 < to && content[i + 1] == '/') return content.find('\n', i) < to;
+            if (i + 1 < to && content[i + 1] == '*')
+            {
+                auto const close = content.find("*/", i + 2);
+                if (close == std::string_view::npos || close >= to) return false;
+                i = close + 1;
+            }
+            break;
+        default: break;
+        }
+    }
+    return false;
+}
+
+// #if expressions: integer constants, and 0 for every identifier left after expansion, combined with the C
+// operators in 64 bit two's complement arithmetic
+class Evaluator
+{
+public:
+    Evaluator(std::vector<tokens::Token> const& tokens, std::vector<int64_t> const& literals) :
+        tokens_{ tokens },
+        literals_{ literals }
+    {
+    }
+
+    // Empty for a malformed expression, `error` tells what went wrong
+    std::optional<int64_t> run()
+    {
+        auto const value = expression(0);
+        if (ok_ && pos_ != tokens_.size()) fail("Extra tokens at the end of the expression");
+        return ok_ ? std::optional{ value } : std::nullopt;
+    }
+
+    std::string_view error() const { return error_; }
+
+private:
+    static constexpr int ternary_power = 4;
+
+    static int binary_power(tokens::Token const& tok)
+    {
+        if (tok.tag != Tag::Punctuator) return -1;
+        switch (tok.punctuator())
+        {
+        case Punctuator::PipePipe: return 6;
+        case Punctuator::AmpersandAmpersand: return 8;
+        case Punctuator::Pipe: return 10;
+        case Punctuator::Caret: return 12;
+        case Punctuator::Ampersand: return 14;
+        case Punctuator::EqualEqual:
+        case Punctuator::ExclaimEqual: return 16;
+        case Punctuator::Less:
+        case Punctuator::Greater:
+        case Punctuator::LessEqual:
+        case Punctuator::GreaterEqual: return 18;
+        case Punctuator::LessLess:
+        case Punctuator::GreaterGreater: return 20;
+        case Punctuator::Plus:
+        case Punctuator::Minus: return 22;
+        case Punctuator::Star:
+        case Punctuator::Slash:
+        case Punctuator::Percent: return 24;
+        default: return -1;
+        }
+    }
+
+    int64_t expression(int min_power)
+    {
+        auto lhs = unary();
+        while (ok_ && pos_ < tokens_.size())
+        {
+            auto const& op = tokens_[pos_];
+            if (op.is(Punctuator::Question))
+            {
+                if (ternary_power < min_power) break;
+                ++pos_;
+                auto const then = branch(lhs != 0, 0);
+                expect(Punctuator::Colon);
+                auto const otherwise = branch(lhs == 0, ternary_power);
+                lhs = lhs != 0 ? then : otherwise;
+                continue;
+            }
+
+            auto const power = binary_power(op);
+            if (power < 0 || power < min_power) break;
+            ++pos_;
+            if (op.is(Punctuator::AmpersandAmpersand))
+            {
+                lhs = branch(lhs != 0, power + 1) != 0 && lhs != 0;
+            }
+            else if (op.is(Punctuator::PipePipe))
+            {
+                lhs = branch(lhs == 0, power + 1) != 0 || lhs != 0;
+            }
+            else
+            {
+                lhs = apply(op.punctuator(), lhs, expression(power + 1));
+            }
+        }
+        return lhs;
+    }
+
+    // Operand which only counts if `evaluated`, a division by zero is no error in the other case
+    int64_t branch(bool evaluated, int min_power)
+    {
+        unevaluated_ += !evaluated;
+        auto const value = expression(min_power);
+        unevaluated_ -= !evaluated;
+        return value;
+    }
+
+    int64_t unary()
+    {
+        if (pos_ >= tokens_.size())
+        {
+            fail("Expected a value");
+            return 0;
+        }
+        auto const& tok = tokens_[pos_++];
+        switch (tok.tag)
+        {
+        case Tag::Constant: return literals_[tok.payload];
+        case Tag::Identifier:
+        case Tag::Keyword: return 0;
+        case Tag::Punctuator: break;
+        default:
+            fail("Invalid token in the expression");
+            return 0;
+        }
+
+        switch (tok.punctuator())
+        {
+        case Punctuator::Plus: return unary();
+        case Punctuator::Minus: return static_cast<int64_t>(0 - static_cast<uint64_t>(unary()));
+        case Punctuator::Tilde: return ~unary();
+        case Punctuator::Exclaim: return unary() == 0;
+        case Punctuator::LParen:
+        {
+            auto const value = expression(0);
+            expect(Punctuator::RParen);
+            return value;
+        }
+        default:
+            fail("Invalid token in the expression");
+            return 0;
+        }
+    }
+
+    int64_t apply(Punctuator op, int64_t lhs, int64_t rhs)
+    {
+        auto const l = static_cast<uint64_t>(lhs);
+        auto const r = static_cast<uint64_t>(rhs);
+        auto const shift = static_cast<unsigned>(std::clamp<int64_t>(rhs, 0, 63));
+        switch (op)
+        {
+        case Punctuator::Pipe: return static_cast<int64_t>(l | r);
+        case Punctuator::Caret: return static_cast<int64_t>(l ^ r);
+        case Punctuator::Ampersand: return static_cast<int64_t>(l & r);
+        case Punctuator::EqualEqual: return lhs == rhs;
+        case Punctuator::ExclaimEqual: return lhs != rhs;
+        case Punctuator::Less: return lhs < rhs;
+        case Punctuator::Greater: return lhs > rhs;
+        case Punctuator::LessEqual: return lhs <= rhs;
+        case Punctuator::GreaterEqual: return lhs >= rhs;
+        case Punctuator::LessLess: return static_cast<int64_t>(l << shift);
+        case Punctuator::GreaterGreater: return lhs >> shift;
+        case Punctuator::Plus: return static_cast<int64_t>(l + r);
+        case Punctuator::Minus: return static_cast<int64_t>(l - r);
+        case Punctuator::Star: return static_cast<int64_t>(l * r);
+        case Punctuator::Slash:
+        case Punctuator::Percent:
+            if (rhs == 0)
+            {
+                if (unevaluated_ == 0) fail("Division by zero");
+                return 0;
+            }
+            if (lhs == std::numeric_limits<int64_t>::min() && rhs == -1)
+            {
+                return op == Punctuator::Slash ? lhs : 0;
+            }
+            return op == Punctuator::Slash ? lhs / rhs : lhs % rhs;
+        default: return 0;
+        }
+    }
+
+    void expect(Punctuator punct)
+    {
+        if (pos_ < tokens_.size() && tokens_[pos_].is(punct))
+        {
+            ++pos_;
+            return;
+        }
+        fail(punct == Punctuator::Colon ? "Expected ':'" : "Expected ')'");
+    }
+
+    void fail(std::string_view error)
+    {
+        if (ok_) error_ = error;
+        ok_ = false;
+    }
+
+    std::vector<tokens::Token> const& tokens_;
+    std::vector<int64_t> const& literals_;
+    size_t pos_{ 0 };
+    size_t unevaluated_{ 0 };
+    bool ok_{ true };
+    std::string_view error_;
+};
+
+} // namespace
+
+Preprocessor::Preprocessor(std::vector<std::filesystem::path> include_dirs) :
+    include_dirs_{ std::move(include_dirs) },
+    va_args_{ Interner::global().intern("__VA_ARGS__") },
+    defined_{ Interner::global().intern("defined") }
+{
+}
+
+std::vector<Preprocessor::Dependency> Preprocessor::dependencies() const
+{
+    std::vector<Dependency> files;
+    for (auto const& [_, header] : headers_)
+    {
+        // The main file is loaded like a header too
+        if (header.file != main_) files.emplace_back(Dependency{ header.path, header.file });
+    }
+    return files;
+}
+
+tokens::Tape Preprocessor::run(std::filesystem::path const& path, File const& main, tokens::Tape tape)
+{
+    main_ = main.id;
+    auto const is_hash = [](tokens::Token const& tok) { return tok.is(Punctuator::Hash); };
+    if (std::none_of(tape.tokens.begin(), tape.tokens.end(), is_hash)) return tape;
+
+    auto const eof = tape.tokens.back();
+    enter(load(std::filesystem::weakly_canonical(path), main, std::move(tape)));
+
+    tokens::Tape out{ main.id, {}, {} };
+    out.tokens.reserve(sources_.back().header->tokens.size() + 1);
+    Input in{ {}, true };
+    while (auto tok = next(in))
+    {
+        if (tok->line_start && tok->tok.is(Punctuator::Hash))
+        {
+            directive(*tok);
+        }
+        else if (!expand(*tok, in))
+        {
+            out.tokens.emplace_back(tok->tok);
+        }
+    }
+    out.tokens.emplace_back(eof);
+    out.literals = std::move(literals_);
+    return out;
+}
+
+Preprocessor::Header& Preprocessor::load(std::filesystem::path const& path, File const& file, tokens::Tape tape)
+{
+    auto& header = headers_[path.string()];
+    header.path = path;
+    header.file = file.id;
+    header.tokens = convert(file, tape);
+
+    // Include guard: the file is a single #ifndef X group, no #else at its level and nothing after its #endif
+    auto const& toks = header.tokens;
+    auto const directive_at = [&](size_t i)
+    {
+        return toks[i].line_start && toks[i].tok.is(Punctuator::Hash) && i + 1 < toks.size()
+                   ? directive_kind(toks[i + 1])
+                   : Directive::Unknown;
+    };
+    if (toks.size() < 3 || directive_at(0) != Directive::Ifndef || toks[2].line_start) return header;
+    size_t depth{ 0 };
+    for (size_t i = 0; i < toks.size(); ++i)
+    {
+        switch (directive_at(i))
+        {
+        case Directive::If:
+        case Directive::Ifdef:
+        case Directive::Ifndef: ++depth; break;
+        case Directive::Elif:
+        case Directive::Else:
+            if (depth == 1) return header;
+            break;
+        case Directive::Endif:
+        {
+            if (--depth > 0) break;
+            auto end = i + 2;
+            while (end < toks.size() && !toks[end].line_start) ++end;
+            if (end == toks.size()) header.guard = macro_name(toks[2].tok);
+            return header;
+        }
+        default: break;
+        }
+    }
+    return header;
+}
+
+// Cached tokens with their line and spacing flags, constants are moved over to the shared literal table
+std::vector<Preprocessor::PPToken> Preprocessor::convert(File const& file, tokens::Tape const& tape)
+{
+    auto const literal_base = static_cast<uint32_t>(literals_.size());
+    literals_.insert(literals_.end(), tape.literals.begin(), tape.literals.end());
+
+    std::vector<PPToken> out;
+    out.reserve(tape.size());
+    size_t previous_end{ 0 };
+    for (auto tok : tape.tokens)
+    {
+        if (tok.tag == Tag::EoF) break;
+        if (tok.tag == Tag::Constant) tok.payload += literal_base;
+        auto const first = out.empty();
+        out.emplace_back(PPToken{ tok, 0, first || newline_between(file.content, previous_end, tok.offset),
+                                  !first && previous_end != tok.offset });
+        previous_end = tok.offset + tok.length;
+    }
+    return out;
+}
+
+void Preprocessor::enter(Header& header)
+{
+    header.entered = true;
+    sources_.emplace_back(Source{ &header, 0, conditionals_.size() });
+}
+
+void Preprocessor::leave()
+{
+    while (conditionals_.size() > sources_.back().conditionals)
+    {
+        conditionals_.back().loc.err() << "Unterminated conditional directive\n";
+        conditionals_.pop_back();
+    }
+    sources_.pop_back();
+}
+
+std::optional<Preprocessor::PPToken> Preprocessor::next(Input& in)
+{
+    if (!in.pending.empty())
+    {
+        auto tok = in.pending.back();
+        in.pending.pop_back();
+        return tok;
+    }
+    if (!in.sources) return std::nullopt;
+    while (!sources_.empty())
+    {
+        auto& source = sources_.back();
+        if (source.pos < source.header->tokens.size()) return source.header->tokens[source.pos++];
+        leave();
+    }
+    return std::nullopt;
+}
+
+// Next token without consuming it. Does not look past the end of the current file.
+Preprocessor::PPToken const* Preprocessor::peek(Input& in) const
+{
+    if (!in.pending.empty()) return &in.pending.back();
+    if (!in.sources || sources_.empty()) return nullptr;
+    auto const& source = sources_.back();
+    return source.pos < source.header->tokens.size() ? &source.header->tokens[source.pos] : nullptr;
+}
+
+std::vector<Preprocessor::PPToken> Preprocessor::rest_of_line()
+{
+    auto& source = sources_.back();
+    auto const& toks = source.header->tokens;
+    auto const begin = source.pos;
+    while (source.pos < toks.size() && !toks[source.pos].line_start)
+    {
+        ++source.pos;
+    }
+    return { toks.begin() + static_cast<ptrdiff_t>(begin), toks.begin() + static_cast<ptrdiff_t>(source.pos) };
+}
+
+Preprocessor::Directive Preprocessor::directive_kind(PPToken const& name) const
+{
+    if (name.line_start) return Directive::Unknown;
+    if (name.tok.is(tokens::Keyword::If)) return Directive::If;
+    if (name.tok.is(tokens::Keyword::Else)) return Directive::Else;
+    if (!name.tok.is(Tag::Identifier)) return Directive::Unknown;
+
+    static constexpr std::array<std::pair<std::string_view, Directive>, 12> names{ {
+        { "include", Directive::Include },
+        { "define", Directive::Define },
+        { "undef", Directive::Undef },
+        { "ifdef", Directive::Ifdef },
+        { "ifndef", Directive::Ifndef },
+        { "elif", Directive::Elif },
+        { "endif", Directive::Endif },
+        { "pragma", Directive::Pragma },
+        { "error", Directive::Error },
+        { "warning", Directive::Warning },
+        { "line", Directive::Line },
+        { "include_next", Directive::Include },
+    } };
+    auto const text = Interner::global().text(name.tok.symbol());
+    auto const it = std::find_if(names.begin(), names.end(), [&](auto const& entry) { return entry.first == text; });
+    return it == names.end() ? Directive::Unknown : it->second;
+}
+
+void Preprocessor::directive(PPToken const& hash)
+{
+    auto line = rest_of_line();
+    // The null directive, a '#' alone on its line
+    if (line.empty()) return;
+
+    auto const name = line.front();
+    line.erase(line.begin());
+    auto const loc = name.tok.loc();
+    switch (auto const kind = directive_kind(name))
+    {
+    case Directive::Include: include(hash, std::move(line)); break;
+    case Directive::Define: define(name, line); break;
+    case Directive::Undef: undef(name, line); break;
+    case Directive::If: open_conditional(name, condition(name, std::move(line))); break;
+    case Directive::Ifdef:
+    case Directive::Ifndef:
+    {
+        auto const macro = line.empty() ? std::nullopt : macro_name(line.front().tok);
+        if (!macro)
+        {
+            loc.err() << "Macro name missing\n";
+            open_conditional(name, false);
+            break;
+        }
+        open_conditional(name, macros_.contains(*macro) == (kind == Directive::Ifdef));
+        break;
+    }
+    case Directive::Elif:
+    case Directive::Else:
+        if (conditionals_.size() <= sources_.back().conditionals)
+        {
+            loc.err() << "#" << name.tok.format() << " without #if\n";
+            break;
+        }
+        if (conditionals_.back().seen_else) loc.err() << "#" << name.tok.format() << " after #else\n";
+        conditionals_.back().seen_else |= kind == Directive::Else;
+        // Only reached at the end of the branch that was taken, the others are skipped up to the #endif
+        skip_branches();
+        break;
+    case Directive::Endif:
+        if (conditionals_.size() <= sources_.back().conditionals)
+        {
+            loc.err() << "#endif without #if\n";
+            break;
+        }
+        conditionals_.pop_back();
+        break;
+    case Directive::Pragma:
+        if (!line.empty() && line.front().tok.is(Tag::Identifier)
+            && Interner::global().text(line.front().tok.symbol()) == "once")
+        {
+            sources_.back().header->once = true;
+        }
+        break;
+    case Directive::Error:
+    case Directive::Warning:
+    {
+        std::string message;
+        for (auto const& tok : line)
+        {
+            if (!message.empty() && tok.space) message += ' ';
+            message += tok.tok.text();
+        }
+        if (kind == Directive::Error)
+        {
+            loc.err() << "#error " << message << '\n';
+        }
+        else
+        {
+            loc.wrn() << "#warning " << message << '\n';
+        }
+        break;
+    }
+    case Directive::Line: break;
+    case Directive::Unknown:
+        // Line markers, # 12 "file.c", as left behind by an external preprocessor
+        if (name.tok.is(Tag::Constant)) break;
+        loc.err() << "Invalid preprocessing directive #" << name.tok.format() << '\n';
+        break;
+    }
+}
+
+void Preprocessor::include(PPToken const& hash, std::vector<PPToken> line)
+{
+    auto const loc = hash.tok.loc();
+    // Computed includes, #include HEADER, only take their form after expansion
+    if (!line.empty() && !line.front().tok.is(Tag::StringLiteral) && !line.front().tok.is(Punctuator::Less))
+    {
+        line = expand_all(std::move(line));
+    }
+
+    std::string name;
+    bool quoted{ true };
+    if (!line.empty() && line.front().tok.is(Tag::StringLiteral))
+    {
+        auto const text = line.front().tok.text();
+        name = text.substr(1, text.size() - 2);
+    }
+    else if (!line.empty() && line.front().tok.is(Punctuator::Less))
+    {
+        // <sys/types.h> is lexed as a handful of tokens, the name is spelled from them
+        auto const close = std::find_if(line.begin() + 1, line.end(),
+                                        [](auto const& tok) { return tok.tok.is(Punctuator::Greater); });
+        if (close == line.end())
+        {
+            loc.err() << "Missing '>' after the header name\n";
+            return;
+        }
+        for (auto it = line.begin() + 1; it != close; ++it)
+        {
+            if (it != line.begin() + 1 && it->space) name += ' ';
+            name += it->tok.text();
+        }
+        quoted = false;
+    }
+    else
+    {
+        loc.err() << "Expected \"FILENAME\" or <FILENAME>\n";
+        return;
+    }
+
+    if (sources_.size() >= max_include_depth)
+    {
+        loc.err() << "#include nested too deeply\n";
+        return;
+    }
+    auto const path = resolve(name, quoted);
+    if (!path)
+    {
+        loc.err() << "'" << name << "' file not found\n";
+        return;
+    }
+
+    if (auto const it = headers_.find(path->string()); it != headers_.end())
+    {
+        auto& header = it->second;
+        if ((header.once && header.entered) || (header.guard && macros_.contains(*header.guard)))
+        {
+            ++stats_.includes_skipped;
+            return;
+        }
+        ++stats_.includes_replayed;
+        enter(header);
+        return;
+    }
+
+    auto const& file = SourceManager::global().load(*path);
+    ++stats_.files_lexed;
+    enter(load(*path, file, Lexer{ file }.tape()));
+}
+
+// "name" is looked up next to the including file first, <name> only in the include directories
+std::optional<std::filesystem::path> Preprocessor::resolve(std::string_view name, bool quoted)
+{
+    std::error_code ec;
+    auto found = [&](std::filesystem::path const& candidate) -> std::optional<std::filesystem::path>
+    {
+        if (!std::filesystem::is_regular_file(candidate, ec))
+        {
+            absent_.insert(candidate);
+            return std::nullopt;
+        }
+        return std::filesystem::weakly_canonical(candidate, ec);
+    };
+
+    std::filesystem::path const relative{ name };
+    if (relative.is_absolute()) return found(relative);
+    if (quoted)
+    {
+        if (auto path = found(sources_.back().header->path.parent_path() / relative)) return path;
+    }
+    for (auto const& dir : include_dirs_)
+    {
+        if (auto path = found(dir / relative)) return path;
+    }
+    return std::nullopt;
+}
+
+void Preprocessor::define(PPToken const& directive, std::vector<PPToken> const& line)
+{
+    auto const loc = directive.tok.loc();
+    auto const name = line.empty() ? std::nullopt : macro_name(line.front().tok);
+    if (!name)
+    {
+        loc.err() << "Macro name missing\n";
+        return;
+    }
+    if (*name == defined_)
+    {
+        loc.err() << "'defined' cannot be used as a macro name\n";
+        return;
+    }
+
+    Macro macro;
+    size_t i{ 1 };
+    auto const at = [&](Punctuator punct) { return i < line.size() && line[i].tok.is(punct); };
+    // Function-like only if the '(' touches the name
+    if (at(Punctuator::LParen) && !line[i].space)
+    {
+        macro.function_like = true;
+        ++i;
+        while (!at(Punctuator::RParen))
+        {
+            if (at(Punctuator::Ellipsis))
+            {
+                macro.variadic = true;
+                macro.params.emplace_back(va_args_);
+                ++i;
+                if (!at(Punctuator::RParen)) break;
+                continue;
+            }
+            auto const param = i < line.size() ? macro_name(line[i].tok) : std::nullopt;
+            if (!param) break;
+            macro.params.emplace_back(*param);
+            ++i;
+            if (at(Punctuator::Comma)) ++i;
+            else if (!at(Punctuator::RParen)) break;
+        }
+        if (!at(Punctuator::RParen))
+        {
+            loc.err() << "Invalid macro parameter list\n";
+            return;
+        }
+        ++i;
+    }
+
+    macro.body.assign(line.begin() + static_cast<ptrdiff_t>(std::min(i, line.size())), line.end());
+    if (!macro.body.empty())
+    {
+        macro.body.front().space = false;
+        if (macro.body.front().tok.is(Punctuator::HashHash) || macro.body.back().tok.is(Punctuator::HashHash))
+        {
+            loc.err() << "'##' cannot appear at either end of a macro expansion\n";
+            return;
+        }
+    }
+    if (macro.function_like)
+    {
+        for (size_t k = 0; k < macro.body.size(); ++k)
+        {
+            if (!macro.body[k].tok.is(Punctuator::Hash)) continue;
+            auto const param = k + 1 < macro.body.size() ? macro_name(macro.body[k + 1].tok) : std::nullopt;
+            if (!param || std::find(macro.params.begin(), macro.params.end(), *param) == macro.params.end())
+            {
+                loc.err() << "'#' is not followed by a macro parameter\n";
+                return;
+            }
+        }
+    }
+
+    if (auto const it = macros_.find(*name); it != macros_.end())
+    {
+        auto const& old = it->second;
+        auto const same_token = [](PPToken const& a, PPToken const& b)
+        { return a.space == b.space && a.tok.text() == b.tok.text(); };
+        if (old.function_like != macro.function_like || old.params != macro.params
+            || !std::equal(old.body.begin(), old.body.end(), macro.body.begin(), macro.body.end(), same_token))
+        {
+            loc.wrn() << "'" << line.front().tok.format() << "' macro redefined\n";
+        }
+    }
+    keyword_macros_ = keyword_macros_ || line.front().tok.is(Tag::Keyword);
+    auto const index = static_cast<uint32_t>(*name);
+    if (index >= ever_defined_.size()) ever_defined_.resize(index + 1);
+    ever_defined_[index] = true;
+    macros_[*name] = std::move(macro);
+}
+
+void Preprocessor::undef(PPToken const& directive, std::vector<PPToken> const& line)
+{
+    auto const name = line.empty() ? std::nullopt : macro_name(line.front().tok);
+    if (!name)
+    {
+        directive.tok.loc().err() << "Macro name missing\n";
+        return;
+    }
+    macros_.erase(*name);
+}
+
+void Preprocessor::open_conditional(PPToken const& directive, bool taken)
+{
+    conditionals_.emplace_back(Conditional{ directive.tok.loc(), taken, false });
+    if (!taken) skip_branches();
+}
+
+// Skips the branches of the innermost conditional which are not included. Stops after the #elif whose condition
+// holds or the #else, if no branch was taken so far, and otherwise after the #endif.
+void Preprocessor::skip_branches()
+{
+    while (true)
+    {
+        auto const kind = skip_group();
+        if (kind == Directive::Unknown) return; // End of file, reported when the file is left
+
+        auto const& name = sources_.back().header->tokens[sources_.back().pos - 1];
+        auto line = rest_of_line();
+        auto& open = conditionals_.back();
+        if (kind == Directive::Endif)
+        {
+            conditionals_.pop_back();
+            return;
+        }
+        if (open.seen_else) name.tok.loc().err() << "#" << name.tok.format() << " after #else\n";
+        open.seen_else |= kind == Directive::Else;
+        if (open.taken) continue;
+        if (kind == Directive::Else || condition(name, std::move(line)))
+        {
+            open.taken = true;
+            return;
+        }
+    }
+}
+
+// Moves past a group which is not included, up to the #elif, #else or #endif closing it. Returns which one with the
+// file positioned right after its name, Unknown if the file ends first.
+Preprocessor::Directive Preprocessor::skip_group()
+{
+    auto& source = sources_.back();
+    auto const& toks = source.header->tokens;
+    size_t depth{ 0 };
+    while (source.pos + 1 < toks.size())
+    {
+        auto const& tok = toks[source.pos++];
+        if (!tok.line_start || !tok.tok.is(Punctuator::Hash)) continue;
+        switch (auto const kind = directive_kind(toks[source.pos]))
+        {
+        case Directive::If:
+        case Directive::Ifdef:
+        case Directive::Ifndef: ++depth; break;
+        case Directive::Elif:
+        case Directive::Else:
+        case Directive::Endif:
+            if (depth == 0)
+            {
+                ++source.pos;
+                return kind;
+            }
+            depth -= kind == Directive::Endif;
+            break;
+        default: break;
+        }
+    }
+    source.pos = toks.size();
+    return Directive::Unknown;
+}
+
+bool Preprocessor::condition(PPToken const& directive, std::vector<PPToken> line)
+{
+    auto const loc = directive.tok.loc();
+    // defined X and defined(X) are resolved first, their operand is not expanded
+    std::vector<PPToken> resolved;
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        auto const name = macro_name(line[i].tok);
+        if (!name || *name != defined_)
+        {
+            resolved.emplace_back(line[i]);
+            continue;
+        }
+        auto const paren = i + 1 < line.size() && line[i + 1].tok.is(Punctuator::LParen);
+        auto const at = i + 1 + paren;
+        auto const operand = at < line.size() ? macro_name(line[at].tok) : std::nullopt;
+        if (!operand || (paren && (at + 1 >= line.size() || !line[at + 1].tok.is(Punctuator::RParen))))
+        {
+            loc.err() << "Macro name missing after 'defined'\n";
+            return false;
+        }
+        resolved.emplace_back(scratch(macros_.contains(*operand) ? "1" : "0").front());
+        i = at + paren;
+    }
+
+    std::vector<tokens::Token> expanded;
+    for (auto const& tok : expand_all(std::move(resolved)))
+    {
+        expanded.emplace_back(tok.tok);
+    }
+    Evaluator evaluator{ expanded, literals_ };
+    auto const value = evaluator.run();
+    if (!value)
+    {
+        loc.err() << "Invalid #" << directive.tok.format() << " expression: " << evaluator.error() << '\n';
+        return false;
+    }
+    return *value != 0;
+}
+
+std::optional<Symbol> Preprocessor::macro_name(tokens::Token const& tok) const
+{
+    if (tok.tag == Tag::Identifier) return tok.symbol();
+    if (tok.tag == Tag::Keyword) return Interner::global().intern(tokens::to_string(tok.keyword()));
+    return std::nullopt;
+}
+
+// True if `tok` names a macro, its expansion is then pushed back onto the input to be rescanned
+bool Preprocessor::expand(PPToken const& tok, Input& in)
+{
+    if (macros_.empty() || (tok.tok.tag == Tag::Keyword && !keyword_macros_)) return false;
+    auto const name = macro_name(tok.tok);
+    auto const index = name ? static_cast<uint32_t>(*name) : 0;
+    if (!name || index >= ever_defined_.size() || !ever_defined_[index]) return false;
+    auto const it = macros_.find(*name);
+    if (it == macros_.end() || hidden(tok.hide, *name)) return false;
+    // Copied, the expansion may outlive the definition
+    auto const macro = it->second;
+    auto const self = hide_set({ *name });
+
+    std::vector<PPToken> body;
+    if (!macro.function_like)
+    {
+        auto const hide = hide_union(tok.hide, self);
+        // Without parameters only the pastes are left to do
+        body = substitute(macro, {});
+        for (auto& part : body)
+        {
+            part.hide = hide_union(part.hide, hide);
+        }
+    }
+    else
+    {
+        // A function-like macro name not followed by '(' is an ordinary identifier
+        auto const* paren = peek(in);
+        if (paren == nullptr || !paren->tok.is(Punctuator::LParen)) return false;
+        next(in);
+        PPToken rparen{};
+        auto const args = arguments(in, macro, tok, rparen);
+        if (!args) return true;
+        body = substitute(macro, *args);
+        auto const hide = hide_union(hide_intersection(tok.hide, rparen.hide), self);
+        for (auto& part : body)
+        {
+            part.hide = hide_union(part.hide, hide);
+        }
+    }
+
+    ++stats_.expansions;
+    if (!body.empty()) body.front().space = tok.space;
+    in.pending.insert(in.pending.end(), body.rbegin(), body.rend());
+    return true;
+}
+
+std::vector<Preprocessor::PPToken> Preprocessor::expand_all(std::vector<PPToken> toks)
+{
+    Input in{ { toks.rbegin(), toks.rend() }, false };
+    std::vector<PPToken> out;
+    while (auto tok = next(in))
+    {
+        if (!expand(*tok, in)) out.emplace_back(*tok);
+    }
+    return out;
+}
+
+// Arguments of a function-like macro whose '(' has just been consumed, split at the commas outside of parentheses.
+// The variadic parameter takes the remaining commas along.
+std::optional<std::vector<std::vector<Preprocessor::PPToken>>>
+Preprocessor::arguments(Input& in, Macro const& macro, PPToken const& name, PPToken& rparen)
+{
+    std::vector<std::vector<PPToken>> args(1);
+    size_t depth{ 0 };
+    while (true)
+    {
+        auto tok = next(in);
+        if (!tok)
+        {
+            name.tok.loc().err() << "Unterminated argument list invoking macro '" << name.tok.format() << "'\n";
+            return std::nullopt;
+        }
+        tok->line_start = false;
+        if (depth == 0 && tok->tok.is(Punctuator::RParen))
+        {
+            rparen = *tok;
+            break;
+        }
+        if (depth == 0 && tok->tok.is(Punctuator::Comma) && !(macro.variadic && args.size() == macro.params.size()))
+        {
+            args.emplace_back();
+            continue;
+        }
+        depth += tok->tok.is(Punctuator::LParen);
+        depth -= tok->tok.is(Punctuator::RParen);
+        args.back().emplace_back(*tok);
+    }
+
+    // F() passes no argument to a macro without parameters, and the variadic part may be left out as in F(a)
+    if (macro.params.empty() && args.size() == 1 && args.front().empty()) args.clear();
+    if (macro.variadic && args.size() + 1 == macro.params.size()) args.emplace_back();
+    if (args.size() != macro.params.size())
+    {
+        name.tok.loc().err() << "Macro '" << name.tok.format() << "' requires " << macro.params.size()
+                             << " arguments, but " << args.size() << " given\n";
+        return std::nullopt;
+    }
+    return args;
+}
+
+// Replacement list with the arguments in place: stringized after '#', unexpanded around '##' and fully expanded
+// everywhere else. Object-like macros come through here as well for their '##', their '#' is an ordinary token.
+std::vector<Preprocessor::PPToken> Preprocessor::substitute(Macro const& macro,
+                                                            std::vector<std::vector<PPToken>> const& args)
+{
+    auto const param = [&](PPToken const& tok) -> std::optional<size_t>
+    {
+        auto const symbol = macro_name(tok.tok);
+        if (!symbol) return std::nullopt;
+        auto const it = std::find(macro.params.begin(), macro.params.end(), *symbol);
+        if (it == macro.params.end()) return std::nullopt;
+        return static_cast<size_t>(it - macro.params.begin());
+    };
+    std::vector<std::optional<std::vector<PPToken>>> expanded(args.size());
+    auto const& body = macro.body;
+    auto const pastes = [&](size_t i) { return i + 1 < body.size() && body[i + 1].tok.is(Punctuator::HashHash); };
+
+    std::vector<PPToken> out;
+    auto const append = [&out](std::vector<PPToken> const& toks, bool space)
+    {
+        auto const first = out.size();
+        out.insert(out.end(), toks.begin(), toks.end());
+        if (first < out.size()) out[first].space = space;
+    };
+
+    for (size_t i = 0; i < body.size(); ++i)
+    {
+        auto const& tok = body[i];
+        if (macro.function_like && tok.tok.is(Punctuator::Hash))
+        {
+            out.emplace_back(stringize(args[*param(body[i + 1])], tok));
+            ++i;
+            continue;
+        }
+
+        if (tok.tok.is(Punctuator::HashHash))
+        {
+            auto const& rhs = body[++i];
+            auto const index = param(rhs);
+            if (!index)
+            {
+                if (out.empty())
+                {
+                    out.emplace_back(rhs);
+                }
+                else
+                {
+                    out.back() = paste(out.back(), rhs);
+                }
+                continue;
+            }
+            auto const& arg = args[*index];
+            // GNU: , ## __VA_ARGS__ drops the comma if there are no variadic arguments and pastes nothing otherwise
+            if (macro.variadic && *index + 1 == args.size() && !out.empty() && out.back().tok.is(Punctuator::Comma))
+            {
+                if (arg.empty())
+                {
+                    out.pop_back();
+                }
+                else
+                {
+                    append(arg, rhs.space);
+                }
+                continue;
+            }
+            if (arg.empty()) continue;
+            if (out.empty())
+            {
+                append(arg, rhs.space);
+                continue;
+            }
+            out.back() = paste(out.back(), arg.front());
+            out.insert(out.end(), arg.begin() + 1, arg.end());
+            continue;
+        }
+
+        auto const index = param(tok);
+        if (!index)
+        {
+            out.emplace_back(tok);
+            continue;
+        }
+        if (pastes(i))
+        {
+            // An empty left operand of ## leaves the right one alone
+            auto const& arg = args[*index];
+            if (arg.empty())
+            {
+                i += 2;
+                if (i < body.size())
+                {
+                    if (auto const rhs = param(body[i]))
+                    {
+                        append(args[*rhs], body[i].space);
+                    }
+                    else
+                    {
+                        out.emplace_back(body[i]);
+                    }
+                }
+                continue;
+            }
+            append(arg, tok.space);
+            continue;
+        }
+        if (!expanded[*index]) expanded[*index] = expand_all(args[*index]);
+        append(*expanded[*index], tok.space);
+    }
+
+    for (auto& tok : out)
+    {
+        tok.line_start = false;
+    }
+    return out;
+}
+
+Preprocessor::PPToken Preprocessor::stringize(std::vector<PPToken> const& arg, PPToken const& hash)
+{
+    std::string spelling{ '"' };
+    for (size_t i = 0; i < arg.size(); ++i)
+    {
+        if (i > 0 && arg[i].space) spelling += ' ';
+        auto const text = arg[i].tok.text();
+        // Quotes and backslashes of string and character literals are escaped
+        auto const literal = arg[i].tok.is(Tag::StringLiteral) || text.starts_with('\'');
+        for (auto c : text)
+        {
+            if (literal && (c == '"' || c == '\\')) spelling += '\\';
+            spelling += c;
+        }
+    }
+    spelling += '"';
+    auto tok = scratch(spelling).front();
+    tok.space = hash.space;
+    return tok;
+}
+
+
+Preprocessor::PPToken Preprocessor::paste(PPToken const& lhs, PPToken const& rhs)
+{
+    auto const spelling = std::string{ lhs.tok.text() } + std::string{ rhs.tok.text() };
+    auto const& pasted = scratch(spelling);
+    if (pasted.size() != 1)
+    {
+        lhs.tok.loc().err() << "Pasting \"" << lhs.tok.text() << "\" and \"" << rhs.tok.text()
+                            << "\" does not give a valid preprocessing token\n";
+        if (pasted.empty()) return lhs;
+    }
+    auto tok = pasted.front();
+    tok.space = lhs.space;
+    return tok;
+}
+
+// Tokens of a spelling made up during expansion. The spellings go into shared buffers, each on a line of its own, so
+// they have a location without taking a file each.
+std::vector<Preprocessor::PPToken> const& Preprocessor::scratch(std::string const& spelling)
+{
+    constexpr size_t scratch_capacity = 64 * 1024;
+    auto const [it, inserted] = scratch_.try_emplace(spelling);
+    if (inserted)
+    {
+        auto const line = spelling + '\n';
+        if (scratch_file_ == nullptr || scratch_file_->room() < line.size())
+        {
+            scratch_file_ = &SourceManager::global().add_growing("<scratch>", std::max(scratch_capacity, line.size()));
+        }
+        auto const offset = scratch_file_->append(line);
+        Lexer lexer{ *scratch_file_, Interner::global(), offset };
+        tokens::Tape tape{ scratch_file_->id, {}, {} };
+        do
+        {
+            tape.tokens.emplace_back(lexer.advance());
+            if (tape.tokens.back().tag == Tag::Constant) tape.literals.emplace_back(lexer.literal(tape.tokens.back()));
+        } while (tape.tokens.back().tag != Tag::EoF);
+        it->second = convert(*scratch_file_, tape);
+        for (auto& tok : it->second)
+        {
+            tok.line_start = false;
+        }
+    }
+    return it->second;
+}
+
+bool Preprocessor::hidden(uint32_t hide, Symbol name) const
+{
+    auto const& set = hide_sets_[hide];
+    return std::binary_search(set.begin(), set.end(), name);
+}
+
+uint32_t Preprocessor::hide_union(uint32_t lhs, uint32_t rhs)
+{
+    if (lhs == rhs || rhs == 0) return lhs;
+    if (lhs == 0) return rhs;
+    auto const key = (uint64_t{ std::min(lhs, rhs) } << 32) | std::max(lhs, rhs);
+    if (auto const it = hide_unions_.find(key); it != hide_unions_.end()) return it->second;
+
+    std::vector<Symbol> symbols;
+    auto const& a = hide_sets_[lhs];
+    auto const& b = hide_sets_[rhs];
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(symbols));
+    auto const set = hide_set(std::move(symbols));
+    hide_unions_.emplace(key, set);
+    return set;
+}
+
+uint32_t Preprocessor::hide_intersection(uint32_t lhs, uint32_t rhs)
+{
+    if (lhs == rhs || lhs == 0 || rhs == 0) return std::min(lhs, rhs);
+    std::vector<Symbol> symbols;
+    auto const& a = hide_sets_[lhs];
+    auto const& b = hide_sets_[rhs];
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(symbols));
+    return hide_set(std::move(symbols));
+}
+
+uint32_t Preprocessor::hide_set(std::vector<Symbol> symbols)
+{
+    std::sort(symbols.begin(), symbols.end());
+    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+    auto const [it, inserted] = hide_index_.try_emplace(symbols, static_cast<uint32_t>(hide_sets_.size()));
+    if (inserted) hide_sets_.emplace_back(std::move(symbols));
+    return it->second;
+}
+
+} // namespace compiler
@@ -0,0 +1,180 @@
+#pragma once
+#include "file.hpp"
+#include "interner.hpp"
+#include "tape.hpp"
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace compiler
+{
+
+// Translation phase 4 on lexed tapes: directives, conditional inclusion and macro expansion. Every file is read and
+// lexed at most once per compilation, its tokens are cached by canonical path and replayed on later includes. Files
+// wrapped in a single #ifndef X ... #endif, or marked #pragma once, are not even replayed again once X is defined.
+// Constants keep indices into one literal table shared by all files, which becomes the table of the output tape.
+class Preprocessor
+{
+public:
+    struct Stats
+    {
+        size_t files_lexed{ 0 };
+        size_t includes_replayed{ 0 }; // Served from the token cache
+        size_t includes_skipped{ 0 };  // Guarded or #pragma once, nothing replayed
+        size_t expansions{ 0 };
+    };
+
+    // A file read by #include
+    struct Dependency
+    {
+        std::filesystem::path path;
+        FileId file;
+    };
+
+    explicit Preprocessor(std::vector<std::filesystem::path> include_dirs = {});
+
+    // Tape of `main` with every directive executed and every macro expanded. A tape without a single '#' can not
+    // define a macro and is returned as is.
+    tokens::Tape run(std::filesystem::path const& path, File const& main, tokens::Tape tape);
+
+    Stats const& stats() const { return stats_; }
+    // Every file included by the last run, each once
+    std::vector<Dependency> dependencies() const;
+    // Paths an #include looked at and found no file at before the one it took. Creating any of them changes what the
+    // include resolves to.
+    std::vector<std::filesystem::path> absent() const { return { absent_.begin(), absent_.end() }; }
+
+private:
+    struct PPToken
+    {
+        tokens::Token tok;
+        uint32_t hide{ 0 };       // Hide set: the macros this token came out of, never to be expanded again
+        bool line_start{ false }; // First token of a line, only set for tokens read from a file
+        bool space{ false };      // Whitespace in front, for stringizing
+    };
+
+    // Tokens of a file, lexed once and replayed by every include
+    struct Header
+    {
+        std::filesystem::path path;
+        FileId file;
+        std::vector<PPToken> tokens;
+        std::optional<Symbol> guard; // X of a file wrapped in #ifndef X ... #endif
+        bool once{ false };
+        bool entered{ false };
+    };
+
+    struct Source
+    {
+        Header* header;
+        size_t pos;
+        size_t conditionals; // Depth of the conditional stack when the file was entered
+    };
+
+    // Where expansion pulls tokens from: expansions pushed back for rescanning first, then the open files unless
+    // a macro argument is expanded on its own
+    struct Input
+    {
+        std::vector<PPToken> pending; // Reversed, the next token is at the back
+        bool sources{ false };
+    };
+
+    struct Macro
+    {
+        std::vector<PPToken> body;
+        std::vector<Symbol> params;
+        bool function_like{ false };
+        bool variadic{ false };
+    };
+
+    struct Conditional
+    {
+        Loc loc;
+        bool taken;     // One of the branches was (or is being) included
+        bool seen_else;
+    };
+
+    enum class Directive : uint8_t
+    {
+        Unknown,
+        Include,
+        Define,
+        Undef,
+        If,
+        Ifdef,
+        Ifndef,
+        Elif,
+        Else,
+        Endif,
+        Pragma,
+        Error,
+        Warning,
+        Line,
+    };
+
+    Header& load(std::filesystem::path const& path, File const& file, tokens::Tape tape);
+    void enter(Header& header);
+    void leave();
+
+    std::optional<PPToken> next(Input& in);
+    PPToken const* peek(Input& in) const;
+    std::vector<PPToken> rest_of_line();
+
+    void directive(PPToken const& hash);
+    Directive directive_kind(PPToken const& name) const;
+    void include(PPToken const& hash, std::vector<PPToken> line);
+    void define(PPToken const& directive, std::vector<PPToken> const& line);
+    void undef(PPToken const& directive, std::vector<PPToken> const& line);
+    void open_conditional(PPToken const& directive, bool taken);
+    void skip_branches();
+    Directive skip_group();
+    bool condition(PPToken const& directive, std::vector<PPToken> line);
+
+    bool expand(PPToken const& tok, Input& in);
+    std::vector<PPToken> expand_all(std::vector<PPToken> tokens);
+    std::optional<std::vector<std::vector<PPToken>>> arguments(Input& in, Macro const& macro, PPToken const& name,
+                                                             PPToken& rparen);
+    std::vector<PPToken> substitute(Macro const& macro, std::vector<std::vector<PPToken>> const& args);
+    PPToken stringize(std::vector<PPToken> const& arg, PPToken const& hash);
+    PPToken paste(PPToken const& lhs, PPToken const& rhs);
+    std::vector<PPToken> const& scratch(std::string const& spelling);
+    std::vector<PPToken> convert(File const& file, tokens::Tape const& tape);
+
+    std::optional<Symbol> macro_name(tokens::Token const& tok) const;
+    std::optional<std::filesystem::path> resolve(std::string_view name, bool quoted);
+
+    bool hidden(uint32_t hide, Symbol name) const;
+    uint32_t hide_union(uint32_t lhs, uint32_t rhs);
+    uint32_t hide_intersection(uint32_t lhs, uint32_t rhs);
+    uint32_t hide_set(std::vector<Symbol> symbols);
+
+    std::vector<std::filesystem::path> include_dirs_;
+    std::unordered_map<std::string, Header> headers_;
+    std::set<std::filesystem::path> absent_;
+    std::unordered_map<std::string, std::vector<PPToken>> scratch_;
+    File* scratch_file_{ nullptr }; // Holds the spellings of scratch_, one per line
+    std::unordered_map<Symbol, Macro> macros_;
+    // Indexed by Symbol, a cheap filter in front of macros_ for the bulk of identifiers which never name a macro
+    std::vector<bool> ever_defined_;
+    bool keyword_macros_{ false };
+
+    std::vector<Source> sources_;
+    FileId main_{ 0 };
+    std::vector<Conditional> conditionals_;
+    std::vector<int64_t> literals_;
+
+    // Hide sets are sorted, deduplicated and numbered, 0 is the empty set
+    std::vector<std::vector<Symbol>> hide_sets_{ {} };
+    std::map<std::vector<Symbol>, uint32_t> hide_index_{ { {}, 0 } };
+    std::unordered_map<uint64_t, uint32_t> hide_unions_;
+
+    Symbol va_args_;
+    Symbol defined_;
+    Stats stats_;
+};
+
+} // namespace compiler
@@ -201,6 +201,12 @@ constexpr std::string to_string(Punctuator punct)
             return "^=";
         case Punctuator::PipeEqual:
             return "|=";
+        case Punctuator::Comma:
+            return ",";
+        case Punctuator::Hash:
+            return "#";
+        case Punctuator::HashHash:
+            return "##";
         }
     return "<unknown>";
 }
@@ -0,0 +1,323 @@
+#include "scan.hpp"
+#include "util/underlying.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_HAS_X86 1
+#endif
+
+namespace compiler::scan
+{
+namespace
+{
+
+constexpr size_t class_count = to_underlying(CharClass::CharBody) + 1;
+
+constexpr bool member(CharClass cls, unsigned char c)
+{
+    bool const digit = c >= '0' && c <= '9';
+    switch (cls)
+    {
+    case CharClass::Whitespace: return c == ' ' || (c >= '\t' && c <= '\r');
+    case CharClass::Identifier: return digit || c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    case CharClass::Digit: return digit;
+    case CharClass::LineComment: return c != '\n';
+    case CharClass::BlockComment: return c != '*';
+    case CharClass::StringBody: return c != '"' && c != '\\' && c != '\n';
+    case CharClass::CharBody: return c != '\'' && c != '\\' && c != '\n';
+    }
+    return false;
+}
+
+consteval auto make_membership()
+{
+    std::array<std::array<bool, 256>, class_count> table{};
+    for (size_t cls = 0; cls < class_count; ++cls)
+    {
+        for (size_t c = 0; c < 256; ++c)
+        {
+            table[cls][c] = member(static_cast<CharClass>(cls), static_cast<unsigned char>(c));
+        }
+    }
+    return table;
+}
+
+constexpr auto membership = make_membership();
+
+template <CharClass cls> size_t skip_scalar(char const* data, size_t size, size_t from)
+{
+    auto const& table = membership[to_underlying(cls)];
+    while (from < size && table[static_cast<unsigned char>(data[from])])
+    {
+        ++from;
+    }
+    return from;
+}
+
+#ifdef SCAN_HAS_X86
+
+// Unsigned lo <= v <= hi for every byte lane
+inline __m128i in_range(__m128i v, char lo, char hi)
+{
+    auto const shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(static_cast<char>(hi - lo))), shifted);
+}
+
+// Lanes holding none of the stop bytes, the comment and literal bodies are complements of a few delimiters
+template <char... stops> __m128i none_of(__m128i v)
+{
+    auto hit = _mm_setzero_si128();
+    ((hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(stops)))), ...);
+    return _mm_andnot_si128(hit, _mm_set1_epi8(-1));
+}
+
+template <CharClass cls> __m128i classify(__m128i v)
+{
+    if constexpr (cls == CharClass::Whitespace)
+    {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), in_range(v, '\t', '\r'));
+    }
+    else if constexpr (cls == CharClass::Identifier)
+    {
+        // Setting 0x20 folds 'A'-'Z' onto 'a'-'z' without dragging any other byte into that range
+        auto const letter = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        auto const digit_or_underscore = _mm_or_si128(in_range(v, '0', '9'), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        return _mm_or_si128(letter, digit_or_underscore);
+    }
+    else if constexpr (cls == CharClass::Digit)
+    {
+        return in_range(v, '0', '9');
+    }
+    else if constexpr (cls == CharClass::LineComment)
+    {
+        return none_of<'\n'>(v);
+    }
+    else if constexpr (cls == CharClass::BlockComment)
+    {
+        return none_of<'*'>(v);
+    }
+    else if constexpr (cls == CharClass::StringBody)
+    {
+        return none_of<'"', '\\', '\n'>(v);
+    }
+    else
+    {
+        return none_of<'\'', '\\', '\n'>(v);
+    }
+}
+
+template <CharClass cls> size_t skip_sse2(char const* data, size_t size, size_t from)
+{
+    while (from + 16 <= size)
+    {
+        auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + from));
+        auto const members = static_cast<uint32_t>(_mm_movemask_epi8(classify<cls>(block)));
+        if (members != 0xFFFF) return from + std::countr_one(members);
+        from += 16;
+    }
+    return skip_scalar<cls>(data, size, from);
+}
+
+__attribute__((target("avx2"))) inline __m256i in_range(__m256i v, char lo, char hi)
+{
+    auto const shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(static_cast<char>(hi - lo))), shifted);
+}
+
+template <char... stops> __attribute__((target("avx2"))) __m256i none_of(__m256i v)
+{
+    auto hit = _mm256_setzero_si256();
+    ((hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(stops)))), ...);
+    return _mm256_andnot_si256(hit, _mm256_set1_epi8(-1));
+}
+
+template <CharClass cls> __attribute__((target("avx2"))) __m256i classify(__m256i v)
+{
+    if constexpr (cls == CharClass::Whitespace)
+    {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), in_range(v, '\t', '\r'));
+    }
+    else if constexpr (cls == CharClass::Identifier)
+    {
+        auto const letter = in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        auto const digit_or_underscore
+            = _mm256_or_si256(in_range(v, '0', '9'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        return _mm256_or_si256(letter, digit_or_underscore);
+    }
+    else if constexpr (cls == CharClass::Digit)
+    {
+        return in_range(v, '0', '9');
+    }
+    else if constexpr (cls == CharClass::LineComment)
+    {
+        return none_of<'\n'>(v);
+    }
+    else if constexpr (cls == CharClass::BlockComment)
+    {
+        return none_of<'*'>(v);
+    }
+    else if constexpr (cls == CharClass::StringBody)
+    {
+        return none_of<'"', '\\', '\n'>(v);
+    }
+    else
+    {
+        return none_of<'\'', '\\', '\n'>(v);
+    }
+}
+
+template <CharClass cls> __attribute__((target("avx2"))) size_t skip_avx2(char const* data, size_t size, size_t from)
+{
+    while (from + 32 <= size)
+    {
+        auto const block = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + from));
+        auto const members = static_cast<uint32_t>(_mm256_movemask_epi8(classify<cls>(block)));
+        if (members != 0xFFFFFFFF) return from + std::countr_one(members);
+        from += 32;
+    }
+    return skip_sse2<cls>(data, size, from);
+}
+
+#endif
+
+void newlines_scalar(char const* data, size_t size, size_t from, std::vector<uint32_t>& out)
+{
+    while (from < size)
+    {
+        auto const* found = static_cast<char const*>(std::memchr(data + from, '\n', size - from));
+        if (found == nullptr) return;
+        from = static_cast<size_t>(found - data) + 1;
+        out.emplace_back(static_cast<uint32_t>(from));
+    }
+}
+
+#ifdef SCAN_HAS_X86
+
+void emit_bits(uint32_t bits, size_t base, std::vector<uint32_t>& out)
+{
+    while (bits != 0)
+    {
+        out.emplace_back(static_cast<uint32_t>(base + std::countr_zero(bits) + 1));
+        bits &= bits - 1;
+    }
+}
+
+void newlines_sse2(char const* data, size_t size, std::vector<uint32_t>& out)
+{
+    auto const newline = _mm_set1_epi8('\n');
+    size_t from{ 0 };
+    for (; from + 16 <= size; from += 16)
+    {
+        auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + from));
+        emit_bits(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline))), from, out);
+    }
+    newlines_scalar(data, size, from, out);
+}
+
+__attribute__((target("avx2"))) void newlines_avx2(char const* data, size_t size, std::vector<uint32_t>& out)
+{
+    auto const newline = _mm256_set1_epi8('\n');
+    size_t from{ 0 };
+    for (; from + 32 <= size; from += 32)
+    {
+        auto const block = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + from));
+        emit_bits(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline))), from, out);
+    }
+    newlines_scalar(data, size, from, out);
+}
+
+#endif
+
+using Kernel = size_t (*)(char const*, size_t, size_t);
+using KernelSet = std::array<Kernel, class_count>;
+
+template <template <CharClass> typename Family, size_t... cls>
+constexpr KernelSet kernel_set(std::index_sequence<cls...>)
+{
+    return { &Family<static_cast<CharClass>(cls)>::skip... };
+}
+
+template <CharClass cls> struct Scalar
+{
+    static size_t skip(char const* data, size_t size, size_t from) { return skip_scalar<cls>(data, size, from); }
+};
+
+#ifdef SCAN_HAS_X86
+template <CharClass cls> struct SSE2
+{
+    static size_t skip(char const* data, size_t size, size_t from) { return skip_sse2<cls>(data, size, from); }
+};
+
+template <CharClass cls> struct AVX2
+{
+    static size_t skip(char const* data, size_t size, size_t from) { return skip_avx2<cls>(data, size, from); }
+};
+#endif
+
+KernelSet const& kernels(Isa isa)
+{
+    constexpr auto classes = std::make_index_sequence<class_count>{};
+    static constexpr KernelSet scalar{ kernel_set<Scalar>(classes) };
+#ifdef SCAN_HAS_X86
+    static constexpr KernelSet sse2{ kernel_set<SSE2>(classes) };
+    static constexpr KernelSet avx2{ kernel_set<AVX2>(classes) };
+    switch (isa)
+    {
+    case Isa::AVX2: return avx2;
+    case Isa::SSE2: return sse2;
+    case Isa::Scalar: break;
+    }
+#endif
+    (void)isa;
+    return scalar;
+}
+
+Isa detect()
+{
+#ifdef SCAN_HAS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+    if (__builtin_cpu_supports("sse2")) return Isa::SSE2;
+#endif
+    return Isa::Scalar;
+}
+
+} // namespace
+
+Isa detected_isa()
+{
+    static Isa const isa{ detect() };
+    return isa;
+}
+
+size_t skip(CharClass cls, std::string_view text, size_t from)
+{
+    static KernelSet const& selected{ kernels(detected_isa()) };
+    return selected[to_underlying(cls)](text.data(), text.size(), from);
+}
+
+void line_starts(std::string_view text, std::vector<uint32_t>& out)
+{
+#ifdef SCAN_HAS_X86
+    switch (detected_isa())
+    {
+    case Isa::AVX2: return newlines_avx2(text.data(), text.size(), out);
+    case Isa::SSE2: return newlines_sse2(text.data(), text.size(), out);
+    case Isa::Scalar: break;
+    }
+#endif
+    newlines_scalar(text.data(), text.size(), 0, out);
+}
+
+size_t skip(Isa isa, CharClass cls, std::string_view text, size_t from)
+{
+    auto const usable = std::min(isa, detected_isa());
+    return kernels(usable)[to_underlying(cls)](text.data(), text.size(), from);
+}
+
+} // namespace compiler::scan
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace compiler::scan
+{
+
+// Character runs the lexer can consume without walking the DFMA
+enum class CharClass : uint8_t
+{
+    Whitespace, // ' ', \t, \n, \v, \f, \r
+    Identifier, // [A-Za-z0-9_]
+    Digit,      // [0-9]
+
+    // Bodies of comments and literals, everything up to the next byte the DFMA has to look at
+    LineComment,  // [^\n]
+    BlockComment, // [^*]
+    StringBody,   // [^"\\\n]
+    CharBody,     // [^'\\\n]
+};
+
+enum class Isa : uint8_t
+{
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// Index of the first byte at or after `from` which is not a member of `cls`, text.size() if there is none.
+// The widest kernel supported by the running CPU is picked on the first call.
+size_t skip(CharClass cls, std::string_view text, size_t from);
+
+// Same as above with an explicitly chosen kernel, falls back to Scalar when the CPU lacks the extension.
+size_t skip(Isa isa, CharClass cls, std::string_view text, size_t from);
+
+// Appends the offset following every '\n' of text, i.e. the start of every line but the first
+void line_starts(std::string_view text, std::vector<uint32_t>& out);
+
+Isa detected_isa();
+
+} // namespace compiler::scan
@@ -0,0 +1,24 @@
+#pragma once
+#include "file.hpp"
+#include "token.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace compiler::tokens
+{
+
+// Every token of a file, lexed once up front and terminated by an EoF token. Reads past the end keep returning
+// that EoF, which gives the parser O(1) lookahead of any depth without bounds checks at the call sites.
+struct Tape
+{
+    FileId file;
+    std::vector<Token> tokens;
+    std::vector<int64_t> literals;
+
+    Token const& operator[](size_t idx) const { return tokens[std::min(idx, tokens.size() - 1)]; }
+    size_t size() const { return tokens.size(); }
+
+    int64_t literal(Token const& tok) const { return literals.at(tok.payload); }
+};
+
+} // namespace compiler::tokens
@@ -1,32 +1,26 @@
 #include "token.hpp"
+#include "file.hpp"
 #include "reflection.hpp"
 #include <format>
 
 namespace compiler::tokens
 {
-namespace
-{
-
-std::string const_to_string(Token::Value const& val)
-{
-    return std::to_string(std::get<int64_t>(val));
-}
 
-} // namespace
+std::string_view Token::text() const { return SourceManager::global().file(file).text(offset, length); }
 
 std::string Token::format() const
 {
     switch(tag)
         {
         case Tag::Keyword:
-            return to_string(std::get<Keyword>(value));
+            return to_string(keyword());
         case Tag::Identifier:
-        case Tag::StringLiteral: // TODO ensure that this is enquoteted
-            return std::get<std::string>(value);
-        case Tag::Punctuator:
-            return to_string(std::get<Punctuator>(value));
+            return std::string{ Interner::global().text(symbol()) };
+        case Tag::StringLiteral:
         case Tag::Constant:
-            return const_to_string(value);
+            return std::string{ text() };
+        case Tag::Punctuator:
+            return to_string(punctuator());
         case Tag::EoF:
             return "<EoF>";
         }
@@ -35,7 +29,7 @@ std::string Token::format() const
 
 std::string Token::specific_format() const
 {
-    return std::format("{}:{}:{}", loc.format(), to_string(tag), format());
+    return std::format("{}:{}:{}", loc().format(), to_string(tag), format());
 }
 
 } // namespace compiler::tokens
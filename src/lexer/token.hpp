@@ -1,8 +1,10 @@
 #pragma once
+#include "interner.hpp"
 #include "loc.hpp"
 #include <cstdint>
+#include <optional>
 #include <string>
-#include <variant>
+#include <type_traits>
 
 namespace compiler::tokens
 {
@@ -107,18 +109,65 @@ enum class Punctuator : uint8_t
     AmpersandEqual,      // &=
     CaretEqual,          // ^=
     PipeEqual = 48,      // |=
+    Comma,               // ,
+    Hash,                // #
+    HashHash,            // ##
 };
 
-struct Token
+// Spelling of an integer constant that decides its type (C11 6.4.4.1), packed into Token::kind. Character constants
+// are always int, their value may be negative.
+struct IntForm
 {
-    using Value = std::variant<std::monostate, Punctuator, Keyword, std::string, int64_t>;
+    uint8_t longs{ 0 }; // 1 for an l suffix, 2 for ll
+    bool is_unsigned{ false };
+    bool decimal{ true }; // Octal, hex and binary constants may also take the unsigned types
+    bool character{ false };
+
+    constexpr uint8_t pack() const
+    {
+        return static_cast<uint8_t>(longs | is_unsigned << 2 | decimal << 3 | character << 4);
+    }
+    static constexpr IntForm unpack(uint8_t kind)
+    {
+        return IntForm{ static_cast<uint8_t>(kind & 3), (kind & 4) != 0, (kind & 8) != 0, (kind & 16) != 0 };
+    }
+};
 
+// Packed token: 16 bytes, trivially copyable. The spelling is never stored, it is a (offset, length) slice of the
+// source buffer of `file`. Keywords and punctuators keep their enumerator in `kind`, identifiers their interned
+// Symbol in `payload` and constants their IntForm in `kind` and an index into the literal table of the lexer that
+// produced them.
+struct Token
+{
     Tag tag;
-    Value value;
-    Loc loc;
+    uint8_t kind;
+    uint16_t file;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t payload;
+
+    bool is(Tag expected) const { return tag == expected; }
+    bool is(Keyword expected) const { return tag == Tag::Keyword && kind == static_cast<uint8_t>(expected); }
+    bool is(Punctuator expected) const { return tag == Tag::Punctuator && kind == static_cast<uint8_t>(expected); }
+
+    Keyword keyword() const { return static_cast<Keyword>(kind); }
+    Punctuator punctuator() const { return static_cast<Punctuator>(kind); }
+    Symbol symbol() const { return static_cast<Symbol>(payload); }
+    IntForm int_form() const { return IntForm::unpack(kind); }
+
+    std::optional<Keyword> as_keyword() const
+    {
+        return tag == Tag::Keyword ? std::optional{ keyword() } : std::nullopt;
+    }
+
+    Loc loc() const { return Loc{ file, offset }; }
+    std::string_view text() const;
 
     std::string format() const;
     std::string specific_format() const;
 };
 
+static_assert(sizeof(Token) == 16);
+static_assert(std::is_trivially_copyable_v<Token>);
+
 } // namespace compiler::tokens
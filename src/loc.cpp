@@ -1,25 +1,17 @@
 #include "loc.hpp"
+#include "file.hpp"
 #include <format>
 
 namespace compiler
 {
 
-std::string Loc::format() const 
-{
-    return std::format("{}:{}:{}", filename_, row_, column_);
-}
+std::string_view Loc::filename() const { return SourceManager::global().file(file_).name; }
 
-
-void Loc::advance(char c)
+std::string Loc::format() const 
 {
-    if (c == '\n')
-    {
-        ++row_;
-        column_ = 1;
-        return;
-    } 
-
-    ++column_;
+    auto const& file = SourceManager::global().file(file_);
+    auto const [row, column] = file.position(offset_);
+    return std::format("{}:{}:{}", file.name, row, column);
 }
 
 }
@@ -1,13 +1,22 @@
 #pragma once
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
 
 namespace compiler
 {
 
 class Loc
 {
-    inline static bool error_occured{ false };
+    // Set from parser threads as well
+    inline static std::atomic<bool> error_occured{ false };
+    inline static std::atomic<bool> diagnosed{ false }; // Warnings included
+    // Where the diagnostics of the calling thread go
+    inline static thread_local std::ostream* sink{ &std::cerr };
 
     template <typename Self> class Diagnostic
     {
@@ -17,8 +26,9 @@ class Loc
         template <typename T> std::ostream& operator<<(T&& message)
         {
             auto& self{ static_cast<Self&>(*this) };
-            error_occured = error_occured || self.is_terminating();
-            return std::cerr << self.type() << loc_.format() << " " << message;
+            diagnosed.store(true, std::memory_order_relaxed);
+            if (self.is_terminating()) error_occured.store(true, std::memory_order_relaxed);
+            return *sink << self.type() << loc_.format() << " " << message;
         }
 
     private:
@@ -42,24 +52,47 @@ class Loc
     };
 
 public:
-    explicit Loc(std::string_view filename) : filename_{ filename } {}
+    // Holds back the diagnostics of the current thread for as long as it lives
+    class Capture
+    {
+    public:
+        Capture() : previous_{ std::exchange(sink, &buffer_) } {}
+        ~Capture() { sink = previous_; }
+
+        Capture(Capture const&) = delete;
+        Capture& operator=(Capture const&) = delete;
+
+        std::string text() const { return buffer_.str(); }
+        // The text so far, which is not part of the text afterwards
+        std::string take()
+        {
+            auto text = buffer_.str();
+            buffer_.str({});
+            return text;
+        }
 
-    Loc(std::string_view filename, size_t row, size_t col) : filename_{ filename }, row_{ row }, column_{ col } {}
+    private:
+        std::ostringstream buffer_;
+        std::ostream* previous_;
+    };
 
-    static bool has_error() { return error_occured; }
+    // Files are identified by their SourceManager id, rows and columns are only resolved when a location is formatted
+    Loc(uint32_t file, uint32_t offset) : file_{ file }, offset_{ offset } {}
 
-    std::string_view filename() const { return filename_; }
+    static bool has_error() { return error_occured.load(std::memory_order_relaxed); }
+    static bool has_diagnostic() { return diagnosed.load(std::memory_order_relaxed); }
+
+    uint32_t file() const { return file_; }
+    uint32_t offset() const { return offset_; }
+    std::string_view filename() const;
     std::string format() const;
 
     Err err() const { return Err{ *this }; }
     Wrn wrn() const { return Wrn{ *this }; }
 
-    void advance(char c);
-
 private:
-    std::string_view filename_;
-    size_t row_{ 1 };
-    size_t column_{ 1 };
+    uint32_t file_;
+    uint32_t offset_;
 };
 
 } // namespace compiler
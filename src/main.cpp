@@ -1,4 +1,8 @@
 #include "driver.hpp"
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <utility>
 
 compiler::Flags parse(int argc, char** argv)
 {
@@ -16,6 +20,12 @@ compiler::Flags parse(int argc, char** argv)
             flags.lex = true;
             continue;
         }
+        if (arg == "--lex-only")
+        {
+            flags.lex = true;
+            flags.lex_only = true;
+            continue;
+        }
         if (arg == "--parse") {
             flags.parse = true;
             continue;
@@ -31,6 +41,73 @@ compiler::Flags parse(int argc, char** argv)
             flags.compile = true;
             continue;
         }
+
+        if (arg == "--time")
+        {
+            flags.time = true;
+            continue;
+        }
+
+        if (arg == "--stats")
+        {
+            flags.stats = true;
+            continue;
+        }
+
+        if (arg == "--flat-ast")
+        {
+            flags.flat_ast = true;
+            continue;
+        }
+
+        if (arg == "--ast-graph")
+        {
+            flags.ast_graph = true;
+            continue;
+        }
+
+        std::pair<std::string_view, size_t*> const graph_limits[]{
+            { "--ast-graph-depth=", &flags.ast_graph_limits.depth },
+            { "--ast-graph-nodes=", &flags.ast_graph_limits.nodes },
+        };
+        auto const limit = std::find_if(std::begin(graph_limits), std::end(graph_limits),
+                                        [&](auto const& entry) { return arg.starts_with(entry.first); });
+        if (limit != std::end(graph_limits))
+        {
+            auto const value = arg.substr(limit->first.size());
+            auto res = std::from_chars(value.data(), value.data() + value.size(), *limit->second);
+            if (res.ec != std::errc{})
+            {
+                std::cerr << "Invalid AST graph limit: " << value << '\n';
+                exit(1);
+            }
+            flags.ast_graph = true;
+            continue;
+        }
+
+        if (arg.starts_with("--include-dir="))
+        {
+            flags.include_dirs.emplace_back(arg.substr(14));
+            continue;
+        }
+
+        if (arg.starts_with("--ast-cache="))
+        {
+            flags.ast_cache = arg.substr(12);
+            continue;
+        }
+
+        if (arg.starts_with("--jobs="))
+        {
+            auto const value = arg.substr(7);
+            auto res = std::from_chars(value.data(), value.data() + value.size(), flags.jobs);
+            if (res.ec != std::errc{} || flags.jobs == 0)
+            {
+                std::cerr << "Invalid job count: " << value << '\n';
+                exit(1);
+            }
+            continue;
+        }
     }
     return flags;
 }
@@ -0,0 +1,96 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace compiler
+{
+
+// 64 bit non-cryptographic hash in the manner of xxHash64: four independent multiply-rotate lanes eat 32 bytes per
+// round, so a hash of a whole source file runs at memory speed. Good enough to key caches, not to resist collisions
+// on purpose. Only the same sequence of add() calls is guaranteed to give the same digest.
+class Hasher
+{
+public:
+    explicit Hasher(uint64_t seed = 0) : seed_{ seed } {}
+
+    static uint64_t of(std::string_view bytes, uint64_t seed = 0) { return Hasher{ seed }.add(bytes).digest(); }
+
+    // Combines two hashes, order matters
+    static constexpr uint64_t combine(uint64_t lhs, uint64_t rhs) { return avalanche(round(lhs, rhs) ^ (rhs >> 29)); }
+
+    Hasher& add(std::string_view bytes)
+    {
+        auto const* p = bytes.data();
+        auto const* const end = p + bytes.size();
+        length_ += bytes.size();
+        if (end - p >= 32)
+        {
+            uint64_t lanes[4]{ seed_ + p1 + p2, seed_ + p2, seed_, seed_ - p1 };
+            for (; end - p >= 32; p += 32)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    lanes[i] = round(lanes[i], read(p + 8 * i));
+                }
+            }
+            state_ ^= std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12)
+                      + std::rotl(lanes[3], 18);
+            for (auto const lane : lanes)
+            {
+                state_ = (state_ ^ round(0, lane)) * p1 + p4;
+            }
+        }
+        for (; end - p >= 8; p += 8)
+        {
+            state_ = std::rotl(state_ ^ round(0, read(p)), 27) * p1 + p4;
+        }
+        for (; p != end; ++p)
+        {
+            state_ = std::rotl(state_ ^ (static_cast<uint8_t>(*p) * p5), 11) * p1;
+        }
+        return *this;
+    }
+
+    // Same as adding the 8 bytes of `value`
+    Hasher& add(uint64_t value)
+    {
+        length_ += sizeof(value);
+        state_ = std::rotl(state_ ^ round(0, value), 27) * p1 + p4;
+        return *this;
+    }
+
+    uint64_t digest() const { return avalanche(state_ + seed_ + p5 + length_); }
+
+private:
+    static constexpr uint64_t p1 = 0x9E3779B185EBCA87;
+    static constexpr uint64_t p2 = 0xC2B2AE3D27D4EB4F;
+    static constexpr uint64_t p3 = 0x165667B19E3779F9;
+    static constexpr uint64_t p4 = 0x85EBCA77C2B2AE63;
+    static constexpr uint64_t p5 = 0x27D4EB2F165667C5;
+
+    static uint64_t read(char const* p)
+    {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static constexpr uint64_t round(uint64_t acc, uint64_t input) { return std::rotl(acc + input * p2, 31) * p1; }
+
+    static constexpr uint64_t avalanche(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= p2;
+        h ^= h >> 29;
+        h *= p3;
+        return h ^ (h >> 32);
+    }
+
+    uint64_t seed_;
+    uint64_t state_{ 0 };
+    uint64_t length_{ 0 };
+};
+
+} // namespace compiler
@@ -0,0 +1,21 @@
+#pragma once
+#include <chrono>
+
+namespace compiler
+{
+
+class Stopwatch
+{
+    using Clock = std::chrono::steady_clock;
+
+public:
+    Stopwatch() : start_{ Clock::now() } {}
+
+    Clock::duration elapsed() const { return Clock::now() - start_; }
+    double elapsed_ms() const { return std::chrono::duration<double, std::milli>(elapsed()).count(); }
+
+private:
+    Clock::time_point start_;
+};
+
+} // namespace compiler
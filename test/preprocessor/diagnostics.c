@@ -0,0 +1,6 @@
+#define TWICE 1
+#define TWICE 2
+#warning check me
+#define CAT(a, b) a ## b
+int pasted = CAT(+, -);
+int value = TWICE;
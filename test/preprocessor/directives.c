@@ -0,0 +1,40 @@
+#define ONE 1
+#define TWO (ONE + ONE)
+#if TWO == 2 && defined(ONE) && !defined NOPE
+int if_taken;
+#elif 1
+int elif_not_taken;
+#else
+int else_not_taken;
+#endif
+#if 0
+#if 1
+not a token sequence that survives
+#endif
+#elif TWO * 3 == 6
+int elif_taken;
+#endif
+#ifdef ONE
+int ifdef_taken;
+#endif
+#undef ONE
+#ifndef ONE
+int ifndef_taken;
+#else
+int ifndef_not_taken;
+#endif
+#if (2 + 3) * 4 == 20 ? 1 : 0 / 0
+int ternary;
+#endif
+#if -1 < 0 && 0x10 == 16 && 'a' == 97
+int arithmetic;
+#endif
+#if UNDEFINED_NAME == 0
+int undefined_is_zero;
+#endif
+#define EMPTY
+EMPTY int after_empty;
+int \
+spliced = TWO;
+#
+#pragma unknown
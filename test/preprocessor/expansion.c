@@ -0,0 +1,14 @@
+#define f(a) a * g
+#define g(a) f(a)
+#define FOO FOO + 1
+#define BAR BAZ
+#define BAZ BAR
+#define APPLY(m, x) m(x)
+#define ID(x) x
+#define NOT_CALLED(x) x
+f(2)(9)
+FOO
+BAR BAZ
+APPLY(ID, ID(1))
+NOT_CALLED
+ID(ID)(3)
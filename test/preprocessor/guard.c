@@ -0,0 +1,8 @@
+#include "guarded.h"
+#include <guarded.h>
+#include "guarded.h"
+#include "once.h"
+#include <once.h>
+#include "plain.h"
+#include "plain.h"
+int value = GUARDED + ONCE;
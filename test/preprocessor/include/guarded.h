@@ -0,0 +1,5 @@
+#ifndef GUARDED_H
+#define GUARDED_H
+#define GUARDED 3
+int guarded_value = GUARDED;
+#endif
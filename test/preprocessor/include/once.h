@@ -0,0 +1,3 @@
+#pragma once
+#define ONCE 4
+int once_value = ONCE;
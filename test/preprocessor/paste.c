@@ -0,0 +1,13 @@
+#define CAT(a, b) a ## b
+#define CAT3(a, b, c) a ## b ## c
+#define XY x ## y
+#define NUM 1 ## 2
+#define LEFT(a) a ## _suffix
+#define RIGHT(a) prefix_ ## a
+int CAT(var, 12) = CAT(1, 2);
+int CAT3(a, b, c) = NUM;
+int XY;
+int LEFT(name) = LEFT();
+int RIGHT(name) = RIGHT();
+int CAT(, alone) CAT(alone, );
+int x = 1 CAT(<, <) 2 CAT(+, =) 3;
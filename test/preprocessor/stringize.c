@@ -0,0 +1,9 @@
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define SQUARE(x) ((x) * (x))
+char *plain = STR(a + b);
+char *quotes = STR(a "b\n" 'c' +  d);
+char *spacing = STR(   leading   and   inner   );
+char *empty = STR();
+char *unexpanded = STR(SQUARE(2));
+char *expanded = XSTR(SQUARE(2));
@@ -0,0 +1,12 @@
+#define LOG(fmt, ...) printf(fmt, ## __VA_ARGS__)
+#define CALL(f, ...) f(__VA_ARGS__)
+#define ALL(...) { __VA_ARGS__ }
+#define COUNT(...) #__VA_ARGS__
+#define STR(x) #x
+LOG("a");
+LOG("b", 1, 2);
+CALL(g);
+CALL(g, 1, (2, 3));
+ALL();
+ALL(1, 2, 3);
+char *s = COUNT(1, 2);
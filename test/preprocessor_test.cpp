@@ -0,0 +1,62 @@
+#include "lexer/lexer.hpp"
+#include "lexer/preprocessor.hpp"
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+// Each case under preprocessor/ is a source file NAME.c next to NAME.lex, the tokens it preprocesses to in the
+// format of --lex, and NAME.diag, the diagnostics it reports if there are any. Headers are found through
+// preprocessor/include, as if given with --include-dir.
+
+namespace
+{
+
+std::string read(std::filesystem::path const& path)
+{
+    std::ifstream in{ path };
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+void check(std::string_view name)
+{
+    std::filesystem::path const dir{ PREPROCESSOR_CASES };
+    auto const path = dir / std::format("{}.c", name);
+    ASSERT_TRUE(std::filesystem::exists(path)) << path;
+
+    compiler::Loc::Capture diagnostics;
+    auto const& file = compiler::SourceManager::global().load(path);
+    compiler::Preprocessor preprocessor{ { dir / "include" } };
+    auto const tape = preprocessor.run(path, file, compiler::Lexer{ file }.tape());
+
+    std::string tokens;
+    for (auto const& tok : tape.tokens)
+    {
+        if (tok.tag == compiler::tokens::Tag::EoF) break;
+        tokens += tok.specific_format();
+        tokens += '\n';
+    }
+    EXPECT_EQ(tokens, read(dir / std::format("{}.lex", name)));
+    EXPECT_EQ(diagnostics.text(), read(dir / std::format("{}.diag", name)));
+}
+
+} // namespace
+
+TEST(Preprocessor, Directives) { check("directives"); }
+
+TEST(Preprocessor, Paste) { check("paste"); }
+
+TEST(Preprocessor, Stringize) { check("stringize"); }
+
+TEST(Preprocessor, VariadicArguments) { check("variadic"); }
+
+TEST(Preprocessor, RescanAndHideSets) { check("expansion"); }
+
+TEST(Preprocessor, IncludeGuards) { check("guard"); }
+
+TEST(Preprocessor, Diagnostics) { check("diagnostics"); }